@@ -21,136 +21,1365 @@
 */
 
 #include <janet.h>
+#include <string.h>
+#include "tarray.h"
 
-const char *const table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BASE64_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define BASE64_NEON
+#include <arm_neon.h>
+#endif
 
-static inline uint8_t encode_sextet_1(uint8_t byte1) {
-  return table[byte1 >> 2];
+/* Alphabets */
+
+/* MIME (RFC 2045) uses the standard alphabet, but wraps encoded lines at 76
+ * characters and ignores whitespace when decoding. */
+#define MIME_LINE_LENGTH 76
+
+typedef struct {
+  const char *name;
+  const char *encode;
+  int mime;
+  uint8_t decode[256]; /* 0xFF for characters not in the alphabet */
+} Base64Alphabet;
+
+static Base64Alphabet alphabet_standard = {
+  "standard", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", 0, {0}
+};
+
+static Base64Alphabet alphabet_url = {
+  "url", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_", 0, {0}
+};
+
+static Base64Alphabet alphabet_mime = {
+  "mime", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", 1, {0}
+};
+
+static void alphabet_init(Base64Alphabet *alphabet) {
+  memset(alphabet->decode, 0xFF, sizeof(alphabet->decode));
+  for (int i = 0; i < 64; i++) {
+    alphabet->decode[(uint8_t) alphabet->encode[i]] = (uint8_t) i;
+  }
 }
 
-static inline uint8_t encode_sextet_2(uint8_t byte1, uint8_t byte2) {
-  return table[((byte1 & 3) << 4) | (byte2 >> 4)];
+static const Base64Alphabet *optalphabet(const Janet *argv, int32_t argc, int32_t n) {
+  if (argc <= n || janet_checktype(argv[n], JANET_NIL)) return &alphabet_standard;
+  JanetKeyword kw = janet_getkeyword(argv, n);
+  if (!janet_cstrcmp(kw, alphabet_standard.name)) return &alphabet_standard;
+  if (!janet_cstrcmp(kw, alphabet_url.name)) return &alphabet_url;
+  if (!janet_cstrcmp(kw, alphabet_mime.name)) return &alphabet_mime;
+  janet_panicf("expected alphabet :standard, :url or :mime, got %v", argv[n]);
 }
 
-static inline uint8_t encode_sextet_3(uint8_t byte2, uint8_t byte3) {
-  return table[((byte2 & 15) << 2) | (byte3 >> 6)];
+/* SIMD kernels. Each kernel handles whole blocks from the front of the input
+ * and returns how many input bytes it consumed; the scalar code finishes the rest.
+ * The x86 kernels are compiled for their target and picked at runtime, so the
+ * module still loads on CPUs without SSSE3 or AVX2. */
+
+static int base64_simd_level = 0;
+
+#ifdef BASE64_X86
+
+#define BASE64_SSSE3 1
+#define BASE64_AVX2 2
+
+/* See http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html */
+__attribute__((target("ssse3")))
+static inline __m128i enc_reshuffle_ssse3(__m128i in) {
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(t1, t3);
 }
 
-static inline uint8_t encode_sextet_4(uint8_t byte3) {
-  return table[byte3 & 63];
+__attribute__((target("ssse3")))
+static inline __m128i enc_translate_ssse3(__m128i in, __m128i lut) {
+  __m128i result = _mm_subs_epu8(in, _mm_set1_epi8(51));
+  const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), in);
+  result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+  return _mm_add_epi8(_mm_shuffle_epi8(lut, result), in);
 }
 
-static Janet base64_encode(int32_t argc, Janet *argv) {
-  janet_fixarity(argc, 1);
-  const uint8_t *in = janet_getstring(argv, 0);
-  int32_t inlen = janet_length(argv[0]);
-  int rem = inlen % 3;
-  JanetBuffer *outbuf = janet_buffer(((inlen + 3 - rem) / 3) * 4);
-  int cursor = 0;
-  for (; cursor < (inlen - rem); cursor += 3) {
-    janet_buffer_push_u8(outbuf, encode_sextet_1(in[cursor]));
-    janet_buffer_push_u8(outbuf, encode_sextet_2(in[cursor], in[cursor + 1]));
-    janet_buffer_push_u8(outbuf, encode_sextet_3(in[cursor + 1], in[cursor + 2]));
-    janet_buffer_push_u8(outbuf, encode_sextet_4(in[cursor + 2]));
-  }
-  if (rem == 1) {
-    janet_buffer_push_u8(outbuf, encode_sextet_1(in[cursor]));
-    janet_buffer_push_u8(outbuf, encode_sextet_2(in[cursor], in[cursor + 1]));
-    janet_buffer_push_u8(outbuf, '=');
-    janet_buffer_push_u8(outbuf, '=');
-  } else if (rem == 2) {
-    janet_buffer_push_u8(outbuf, encode_sextet_1(in[cursor]));
-    janet_buffer_push_u8(outbuf, encode_sextet_2(in[cursor], in[cursor + 1]));
-    janet_buffer_push_u8(outbuf, encode_sextet_3(in[cursor + 1], in[cursor + 2]));
-    janet_buffer_push_u8(outbuf, '=');
-  }
-  return janet_stringv(outbuf->data, outbuf->count);
-}
-
-static uint8_t decode_character(uint8_t c) {
-  if (c >= 'a') {
-    return c - 97 + 26;
-  } else if (c >= 'A') {
-    return c - 65;
-  } else if (c >= '0' && c <= '9') {
-    return c - 48 + 52;
-  } else if (c == '+') {
-    return 62;
-  } else if (c == '/') {
-    return 63;
+__attribute__((target("ssse3")))
+static inline __m128i enc_lut_ssse3(const Base64Alphabet *alphabet) {
+  return _mm_setr_epi8(
+           'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+           (char)(alphabet->encode[62] - 62), (char)(alphabet->encode[63] - 63),
+           'A', 0, 0);
+}
+
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  const __m128i lut = enc_lut_ssse3(alphabet);
+  size_t i = 0;
+  /* Loads 16 bytes but only uses 12 */
+  for (; i + 16 <= len; i += 12) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+    x = enc_translate_ssse3(enc_reshuffle_ssse3(x), lut);
+    _mm_storeu_si128((__m128i *) out, x);
+    out += 16;
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static size_t encode_avx2(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  const __m128i lut128 = enc_lut_ssse3(alphabet);
+  const __m256i lut = _mm256_broadcastsi128_si256(lut128);
+  const __m256i shuf = _mm256_broadcastsi128_si256(
+                         _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  size_t i = 0;
+  /* Each lane loads 16 bytes but only uses 12 */
+  for (; i + 28 <= len; i += 24) {
+    __m256i x = _mm256_inserti128_si256(
+                  _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i))),
+                  _mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+    x = _mm256_shuffle_epi8(x, shuf);
+    const __m256i t0 = _mm256_and_si256(x, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(x, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    x = _mm256_or_si256(t1, t3);
+    __m256i result = _mm256_subs_epu8(x, _mm256_set1_epi8(51));
+    const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), x);
+    result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    x = _mm256_add_epi8(_mm256_shuffle_epi8(lut, result), x);
+    _mm256_storeu_si256((__m256i *) out, x);
+    out += 32;
+  }
+  return i;
+}
+
+/* Decoding validates with a pair of nibble lookups and only handles the
+ * standard alphabet - url input is translated into it first.
+ * See http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html */
+
+__attribute__((target("ssse3")))
+static int decode_block_ssse3(int url, __m128i str, __m128i *out) {
+  const __m128i lut_lo = _mm_setr_epi8(
+                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi = _mm_setr_epi8(
+                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(
+                             0, 16, 19, 4, -65, -65, -71, -71,
+                             0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2F);
+  if (url) {
+    const __m128i plus = _mm_cmpeq_epi8(str, _mm_set1_epi8('+'));
+    const __m128i slash = _mm_cmpeq_epi8(str, mask_2f);
+    if (_mm_movemask_epi8(_mm_or_si128(plus, slash))) return 1;
+    const __m128i dash = _mm_cmpeq_epi8(str, _mm_set1_epi8('-'));
+    const __m128i under = _mm_cmpeq_epi8(str, _mm_set1_epi8('_'));
+    str = _mm_add_epi8(str, _mm_and_si128(dash, _mm_set1_epi8('+' - '-')));
+    str = _mm_add_epi8(str, _mm_and_si128(under, _mm_set1_epi8('/' - '_')));
+  }
+  const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+  const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+  const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+  const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+  if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()))) return 1;
+  const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+  const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+  str = _mm_add_epi8(str, roll);
+  const __m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+  str = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+  *out = _mm_shuffle_epi8(str, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  return 0;
+}
+
+/* Stops at the first block with a character outside of the alphabet. Stores
+ * write 4 bytes of scratch past the decoded data, so always leave at least
+ * 16 input characters for the scalar code. */
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  int url = alphabet == &alphabet_url;
+  size_t i = 0;
+  for (; i + 32 <= len; i += 16) {
+    __m128i x;
+    if (decode_block_ssse3(url, _mm_loadu_si128((const __m128i *)(in + i)), &x)) break;
+    _mm_storeu_si128((__m128i *) out, x);
+    out += 12;
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static size_t decode_avx2(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  const __m256i lut_lo = _mm256_setr_epi8(
+                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lut_hi = _mm256_setr_epi8(
+                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(
+                             0, 16, 19, 4, -65, -65, -71, -71,
+                             0, 0, 0, 0, 0, 0, 0, 0,
+                             0, 16, 19, 4, -65, -65, -71, -71,
+                             0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+  const __m256i pack = _mm256_setr_epi8(
+                         2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                         2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+  int url = alphabet == &alphabet_url;
+  size_t i = 0;
+  for (; i + 48 <= len; i += 32) {
+    __m256i str = _mm256_loadu_si256((const __m256i *)(in + i));
+    if (url) {
+      const __m256i plus = _mm256_cmpeq_epi8(str, _mm256_set1_epi8('+'));
+      const __m256i slash = _mm256_cmpeq_epi8(str, mask_2f);
+      if (_mm256_movemask_epi8(_mm256_or_si256(plus, slash))) break;
+      const __m256i dash = _mm256_cmpeq_epi8(str, _mm256_set1_epi8('-'));
+      const __m256i under = _mm256_cmpeq_epi8(str, _mm256_set1_epi8('_'));
+      str = _mm256_add_epi8(str, _mm256_and_si256(dash, _mm256_set1_epi8('+' - '-')));
+      str = _mm256_add_epi8(str, _mm256_and_si256(under, _mm256_set1_epi8('/' - '_')));
+    }
+    const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+    const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+    const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256()))) break;
+    const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+    const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    str = _mm256_add_epi8(str, roll);
+    const __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+    str = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    str = _mm256_shuffle_epi8(str, pack);
+    str = _mm256_permutevar8x32_epi32(str, compact);
+    _mm256_storeu_si256((__m256i *) out, str);
+    out += 24;
+  }
+  return i;
+}
+
+static void simd_init(void) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    base64_simd_level = BASE64_AVX2;
+  } else if (__builtin_cpu_supports("ssse3")) {
+    base64_simd_level = BASE64_SSSE3;
+  }
+}
+
+static size_t encode_simd(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  if (base64_simd_level == BASE64_AVX2) return encode_avx2(alphabet, in, len, out);
+  if (base64_simd_level == BASE64_SSSE3) return encode_ssse3(alphabet, in, len, out);
+  return 0;
+}
+
+static size_t decode_simd(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  if (base64_simd_level == BASE64_AVX2) return decode_avx2(alphabet, in, len, out);
+  if (base64_simd_level == BASE64_SSSE3) return decode_ssse3(alphabet, in, len, out);
+  return 0;
+}
+
+#elif defined(BASE64_NEON)
+
+static void simd_init(void) {
+  base64_simd_level = 1;
+}
+
+/* 48 bytes in, 64 characters out, using a 64 entry table lookup */
+static size_t encode_simd(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  const uint8_t *enc = (const uint8_t *) alphabet->encode;
+  uint8x16x4_t table;
+  table.val[0] = vld1q_u8(enc);
+  table.val[1] = vld1q_u8(enc + 16);
+  table.val[2] = vld1q_u8(enc + 32);
+  table.val[3] = vld1q_u8(enc + 48);
+  const uint8x16_t mask = vdupq_n_u8(0x3F);
+  size_t i = 0;
+  for (; i + 48 <= len; i += 48) {
+    uint8x16x3_t src = vld3q_u8(in + i);
+    uint8x16x4_t idx, dst;
+    idx.val[0] = vshrq_n_u8(src.val[0], 2);
+    idx.val[1] = vandq_u8(vorrq_u8(vshrq_n_u8(src.val[1], 4), vshlq_n_u8(src.val[0], 4)), mask);
+    idx.val[2] = vandq_u8(vorrq_u8(vshrq_n_u8(src.val[2], 6), vshlq_n_u8(src.val[1], 2)), mask);
+    idx.val[3] = vandq_u8(src.val[2], mask);
+    dst.val[0] = vqtbl4q_u8(table, idx.val[0]);
+    dst.val[1] = vqtbl4q_u8(table, idx.val[1]);
+    dst.val[2] = vqtbl4q_u8(table, idx.val[2]);
+    dst.val[3] = vqtbl4q_u8(table, idx.val[3]);
+    vst4q_u8(out, dst);
+    out += 64;
+  }
+  return i;
+}
+
+/* Look up 16 characters in the 128 entry ASCII part of the decode table.
+ * Anything outside of the alphabet or ASCII comes back with the high bit set. */
+static uint8x16_t decode_lookup_neon(const uint8x16x4_t *lo, const uint8x16x4_t *hi, uint8x16_t c) {
+  uint8x16_t v = vorrq_u8(vqtbl4q_u8(*lo, c), vqtbl4q_u8(*hi, vsubq_u8(c, vdupq_n_u8(64))));
+  return vorrq_u8(v, vandq_u8(c, vdupq_n_u8(0x80)));
+}
+
+/* 64 characters in, 48 bytes out */
+static size_t decode_simd(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  const uint8_t *dec = alphabet->decode;
+  uint8x16x4_t lo, hi;
+  lo.val[0] = vld1q_u8(dec);
+  lo.val[1] = vld1q_u8(dec + 16);
+  lo.val[2] = vld1q_u8(dec + 32);
+  lo.val[3] = vld1q_u8(dec + 48);
+  hi.val[0] = vld1q_u8(dec + 64);
+  hi.val[1] = vld1q_u8(dec + 80);
+  hi.val[2] = vld1q_u8(dec + 96);
+  hi.val[3] = vld1q_u8(dec + 112);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    uint8x16x4_t src = vld4q_u8(in + i);
+    uint8x16_t a = decode_lookup_neon(&lo, &hi, src.val[0]);
+    uint8x16_t b = decode_lookup_neon(&lo, &hi, src.val[1]);
+    uint8x16_t c = decode_lookup_neon(&lo, &hi, src.val[2]);
+    uint8x16_t d = decode_lookup_neon(&lo, &hi, src.val[3]);
+    uint8x16_t bad = vorrq_u8(vorrq_u8(a, b), vorrq_u8(c, d));
+    if (vmaxvq_u8(bad) & 0x80) break;
+    uint8x16x3_t dst;
+    dst.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+    dst.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+    dst.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+    vst3q_u8(out, dst);
+    out += 48;
+  }
+  return i;
+}
+
+#else
+
+static void simd_init(void) {
+}
+
+static size_t encode_simd(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  (void) alphabet;
+  (void) in;
+  (void) len;
+  (void) out;
+  return 0;
+}
+
+static size_t decode_simd(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  (void) alphabet;
+  (void) in;
+  (void) len;
+  (void) out;
+  return 0;
+}
+
+#endif
+
+/* Scalar encoding and decoding. Output is written straight into presized memory. */
+
+static size_t encoded_length(size_t len, int pad) {
+  size_t rem = len % 3;
+  size_t full = (len / 3) * 4;
+  if (rem == 0) return full;
+  return full + (pad ? 4 : rem + 1);
+}
+
+/* Encode whole 3 byte groups, returns number of input bytes consumed */
+static size_t encode_groups(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  const char *table = alphabet->encode;
+  size_t i = encode_simd(alphabet, in, len, out);
+  out += (i / 3) * 4;
+  for (; i + 3 <= len; i += 3) {
+    uint32_t x = ((uint32_t) in[i] << 16) | ((uint32_t) in[i + 1] << 8) | in[i + 2];
+    out[0] = table[(x >> 18) & 63];
+    out[1] = table[(x >> 12) & 63];
+    out[2] = table[(x >> 6) & 63];
+    out[3] = table[x & 63];
+    out += 4;
+  }
+  return i;
+}
+
+/* Encode the final 1 or 2 bytes, returns number of characters written */
+static size_t encode_tail(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out, int pad) {
+  const char *table = alphabet->encode;
+  if (len == 0) return 0;
+  uint32_t x = ((uint32_t) in[0] << 16) | (len > 1 ? ((uint32_t) in[1] << 8) : 0);
+  out[0] = table[(x >> 18) & 63];
+  out[1] = table[(x >> 12) & 63];
+  if (len == 2) {
+    out[2] = table[(x >> 6) & 63];
+  } else if (pad) {
+    out[2] = '=';
+  }
+  if (pad) {
+    out[3] = '=';
+    return 4;
+  }
+  return len + 1;
+}
+
+static size_t encode_all(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out, int pad) {
+  size_t i = encode_groups(alphabet, in, len, out);
+  size_t n = (i / 3) * 4;
+  return n + encode_tail(alphabet, in + i, len - i, out + n, pad);
+}
+
+/* Decode whole 4 character groups. Returns number of input characters consumed,
+ * which is less than len if a character outside of the alphabet was found. */
+static size_t decode_groups(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  const uint8_t *table = alphabet->decode;
+  size_t i = decode_simd(alphabet, in, len, out);
+  out += (i / 4) * 3;
+  for (; i + 4 <= len; i += 4) {
+    uint32_t a = table[in[i]], b = table[in[i + 1]], c = table[in[i + 2]], d = table[in[i + 3]];
+    if ((a | b | c | d) & 0x80) break;
+    uint32_t x = (a << 18) | (b << 12) | (c << 6) | d;
+    out[0] = (uint8_t)(x >> 16);
+    out[1] = (uint8_t)(x >> 8);
+    out[2] = (uint8_t) x;
+    out += 3;
+  }
+  return i;
+}
+
+/* Find the first character outside of the alphabet */
+static size_t find_invalid(const Base64Alphabet *alphabet, const uint8_t *in, size_t len) {
+  size_t i = 0;
+  while (i < len && alphabet->decode[in[i]] != 0xFF) i++;
+  return i;
+}
+
+static JANET_NO_RETURN void panic_character(uint8_t c) {
+  janet_panicf("Wrong character: %c", c);
+}
+
+/* Decode the final 2 or 3 characters of unpadded data, returns number of bytes written */
+static size_t decode_tail(const Base64Alphabet *alphabet, const uint8_t *in, size_t len, uint8_t *out) {
+  size_t bad = find_invalid(alphabet, in, len);
+  if (bad < len) panic_character(in[bad]);
+  if (len < 2) return 0;
+  uint32_t x = ((uint32_t) alphabet->decode[in[0]] << 18) | ((uint32_t) alphabet->decode[in[1]] << 12);
+  if (len > 2) x |= (uint32_t) alphabet->decode[in[2]] << 6;
+  out[0] = (uint8_t)(x >> 16);
+  if (len > 2) out[1] = (uint8_t)(x >> 8);
+  return len - 1;
+}
+
+/* Streaming */
+
+typedef struct {
+  const Base64Alphabet *alphabet;
+  int pad;
+  int32_t pending;
+  int32_t padding;
+  int32_t column;
+  uint8_t tail[4];
+} Base64Stream;
+
+static const JanetAbstractType encoder_type;
+static const JanetAbstractType decoder_type;
+
+static void stream_init(Base64Stream *stream, const Base64Alphabet *alphabet, int pad) {
+  memset(stream, 0, sizeof(Base64Stream));
+  stream->alphabet = alphabet;
+  stream->pad = pad;
+}
+
+static uint8_t *stream_reserve(JanetBuffer *buffer, size_t n) {
+  if (n > (size_t)(INT32_MAX - buffer->count)) janet_panic("buffer too large");
+  janet_buffer_extra(buffer, (int32_t) n);
+  return buffer->data + buffer->count;
+}
+
+/* Encode whole groups, breaking lines for MIME. Returns number of characters written. */
+static size_t encoder_emit(Base64Stream *stream, const uint8_t *in, size_t len, uint8_t *out) {
+  if (!stream->alphabet->mime) {
+    return (encode_groups(stream->alphabet, in, len, out) / 3) * 4;
+  }
+  size_t n = 0;
+  while (len >= 3) {
+    if (stream->column == MIME_LINE_LENGTH) {
+      out[n++] = '\r';
+      out[n++] = '\n';
+      stream->column = 0;
+    }
+    size_t chunk = ((MIME_LINE_LENGTH - stream->column) / 4) * 3;
+    if (chunk > len) chunk = len - (len % 3);
+    size_t used = encode_groups(stream->alphabet, in, chunk, out + n);
+    n += (used / 3) * 4;
+    stream->column += (int32_t)((used / 3) * 4);
+    in += used;
+    len -= used;
+  }
+  return n;
+}
+
+static size_t encoder_bound(size_t len) {
+  size_t chars = (len / 3) * 4;
+  return chars + 2 * (chars / MIME_LINE_LENGTH + 1);
+}
+
+static void encoder_write(Base64Stream *stream, const uint8_t *in, size_t len, JanetBuffer *buffer) {
+  uint8_t *out = stream_reserve(buffer, encoder_bound(stream->pending + len));
+  size_t n = 0;
+  if (stream->pending) {
+    while (stream->pending < 3 && len) {
+      stream->tail[stream->pending++] = *in++;
+      len--;
+    }
+    if (stream->pending < 3) return;
+    n += encoder_emit(stream, stream->tail, 3, out);
+    stream->pending = 0;
+  }
+  size_t used = len - (len % 3);
+  n += encoder_emit(stream, in, used, out + n);
+  for (size_t i = used; i < len; i++) {
+    stream->tail[stream->pending++] = in[i];
+  }
+  buffer->count += (int32_t) n;
+}
+
+static void encoder_finish(Base64Stream *stream, JanetBuffer *buffer) {
+  uint8_t *out = stream_reserve(buffer, 6);
+  if (stream->pending && stream->column == MIME_LINE_LENGTH) {
+    *out++ = '\r';
+    *out++ = '\n';
+    buffer->count += 2;
+  }
+  buffer->count += (int32_t) encode_tail(stream->alphabet, stream->tail, stream->pending, out, stream->pad);
+  stream->pending = 0;
+  stream->column = 0;
+}
+
+static int is_whitespace(uint8_t c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* Decode a run of characters that contains no whitespace */
+static void decoder_write_run(Base64Stream *stream, const uint8_t *in, size_t len, JanetBuffer *buffer) {
+  const uint8_t *pad = memchr(in, '=', len);
+  size_t body = pad ? (size_t)(pad - in) : len;
+  if (stream->padding && body) panic_character(in[0]);
+  uint8_t *out = stream_reserve(buffer, ((stream->pending + body) / 4) * 3);
+  size_t n = 0;
+  size_t i = 0;
+  if (stream->pending) {
+    while (stream->pending < 4 && i < body) {
+      stream->tail[stream->pending++] = in[i++];
+    }
+    if (stream->pending < 4) goto tail;
+    if (decode_groups(stream->alphabet, stream->tail, 4, out) < 4) {
+      panic_character(stream->tail[find_invalid(stream->alphabet, stream->tail, 4)]);
+    }
+    n += 3;
+    stream->pending = 0;
+  }
+  size_t groups = ((body - i) / 4) * 4;
+  size_t used = decode_groups(stream->alphabet, in + i, groups, out + n);
+  if (used < groups) {
+    panic_character(in[i + used + find_invalid(stream->alphabet, in + i + used, groups - used)]);
+  }
+  n += (used / 4) * 3;
+  i += used;
+  while (i < body) {
+    stream->tail[stream->pending++] = in[i++];
+  }
+tail:
+  buffer->count += (int32_t) n;
+  for (i = body; i < len; i++) {
+    if (in[i] != '=') panic_character(in[i]);
+    stream->padding++;
+  }
+  if (stream->padding > 2) janet_panic("too much padding");
+}
+
+static void decoder_write(Base64Stream *stream, const uint8_t *in, size_t len, JanetBuffer *buffer) {
+  if (!stream->alphabet->mime) {
+    decoder_write_run(stream, in, len, buffer);
+    return;
+  }
+  size_t i = 0;
+  while (i < len) {
+    while (i < len && is_whitespace(in[i])) i++;
+    size_t start = i;
+    while (i < len && !is_whitespace(in[i])) i++;
+    if (i > start) decoder_write_run(stream, in + start, i - start, buffer);
+  }
+}
+
+static void decoder_finish(Base64Stream *stream, JanetBuffer *buffer) {
+  if (stream->pending == 1 || (stream->padding && stream->pending + stream->padding != 4)) {
+    janet_panicf("Wrong length: %d", stream->pending + stream->padding);
+  }
+  uint8_t *out = stream_reserve(buffer, 3);
+  buffer->count += (int32_t) decode_tail(stream->alphabet, stream->tail, stream->pending, out);
+  stream->pending = 0;
+  stream->padding = 0;
+}
+
+/* Read a whole file through a stream in fixed size chunks */
+#define FILE_CHUNK_SIZE (16 * 1024)
+
+static void stream_file(Base64Stream *stream, int decode, FILE *file, JanetBuffer *buffer) {
+  uint8_t chunk[FILE_CHUNK_SIZE];
+  size_t nread;
+  do {
+    nread = fread(chunk, 1, sizeof(chunk), file);
+    if (decode) {
+      decoder_write(stream, chunk, nread, buffer);
+    } else {
+      encoder_write(stream, chunk, nread, buffer);
+    }
+  } while (nread == sizeof(chunk));
+  if (ferror(file)) janet_panic("error reading file");
+  if (decode) {
+    decoder_finish(stream, buffer);
   } else {
-    janet_panicf("Wrong character: %c", c);
+    encoder_finish(stream, buffer);
   }
 }
 
-static inline uint8_t decode_byte_1(uint8_t sextet1, uint8_t sextet2) {
-  return (sextet1 << 2) | (sextet2 >> 4);
+static FILE *checkfile(const Janet *argv, int32_t n) {
+  if (!janet_checkabstract(argv[n], &janet_file_type)) return NULL;
+  int32_t flags;
+  FILE *file = janet_getfile(argv, n, &flags);
+  if (!(flags & JANET_FILE_READ)) janet_panic("file must be readable");
+  return file;
 }
 
-static inline uint8_t decode_byte_2(uint8_t sextet2, uint8_t sextet3) {
-  return (sextet2 << 4) | (sextet3 >> 2);
+static Base64Stream *getstream(const Janet *argv, int32_t n) {
+  if (janet_checktype(argv[n], JANET_ABSTRACT)) {
+    void *p = janet_unwrap_abstract(argv[n]);
+    const JanetAbstractType *at = janet_abstract_type(p);
+    if (at == &encoder_type || at == &decoder_type) return (Base64Stream *) p;
+  }
+  janet_panicf("bad slot #%d, expected base64/encoder or base64/decoder, got %v", n, argv[n]);
+}
+
+/* Get the input bytes in argv[n]. Writing to `buffer` can move its memory, so
+ * if the input is `buffer` itself it is copied to scratch memory, returned in
+ * `copy` to be freed with janet_sfree. */
+static JanetByteView stream_input(const Janet *argv, int32_t n, JanetBuffer *buffer, uint8_t **copy) {
+  JanetByteView bytes = janet_gettarray_bytes(argv, n);
+  *copy = NULL;
+  if (bytes.len > 0 && janet_checktype(argv[n], JANET_BUFFER) && janet_unwrap_buffer(argv[n]) == buffer) {
+    *copy = janet_smalloc((size_t) bytes.len);
+    memcpy(*copy, bytes.bytes, (size_t) bytes.len);
+    bytes.bytes = *copy;
+  }
+  return bytes;
+}
+
+static Janet stream_write(int32_t argc, Janet *argv) {
+  janet_arity(argc, 2, 3);
+  Base64Stream *stream = getstream(argv, 0);
+  JanetBuffer *buffer = janet_optbuffer(argv, argc, 2, 0);
+  uint8_t *copy;
+  JanetByteView bytes = stream_input(argv, 1, buffer, &copy);
+  if (janet_abstract_type(stream) == &encoder_type) {
+    encoder_write(stream, bytes.bytes, (size_t) bytes.len, buffer);
+  } else {
+    decoder_write(stream, bytes.bytes, (size_t) bytes.len, buffer);
+  }
+  if (copy != NULL) janet_sfree(copy);
+  return janet_wrap_buffer(buffer);
 }
 
-static inline uint8_t decode_byte_3(uint8_t sextet3, uint8_t sextet4) {
-  return (sextet3 << 6) | sextet4;
+static Janet stream_finish(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 2);
+  Base64Stream *stream = getstream(argv, 0);
+  JanetBuffer *buffer = janet_optbuffer(argv, argc, 1, 0);
+  if (janet_abstract_type(stream) == &encoder_type) {
+    encoder_finish(stream, buffer);
+  } else {
+    decoder_finish(stream, buffer);
+  }
+  return janet_wrap_buffer(buffer);
+}
+
+static const JanetMethod stream_methods[] = {
+  {"write", stream_write},
+  {"finish", stream_finish},
+  {NULL, NULL}
+};
+
+static int stream_get(void *p, Janet key, Janet *out) {
+  (void) p;
+  if (!janet_checktype(key, JANET_KEYWORD)) return 0;
+  return janet_getmethod(janet_unwrap_keyword(key), stream_methods, out);
+}
+
+static const JanetAbstractType encoder_type = {
+  .name = "base64/encoder",
+  .get = stream_get
+};
+
+static const JanetAbstractType decoder_type = {
+  .name = "base64/decoder",
+  .get = stream_get
+};
+
+/* Hex, base32 and base85. These convert whole strings at once into presized
+ * output, like the non-streaming base64 paths. */
+
+/* Get the output for a presized conversion - a new string, or the end of the
+ * caller's buffer if one was given. */
+static uint8_t *output_begin(const Janet *argv, int32_t argc, int32_t n, size_t len, JanetBuffer **into) {
+  if (len > INT32_MAX) janet_panic("output too large");
+  if (argc > n && !janet_checktype(argv[n], JANET_NIL)) {
+    *into = janet_getbuffer(argv, n);
+    return stream_reserve(*into, len);
+  }
+  *into = NULL;
+  return janet_string_begin((int32_t) len);
+}
+
+static Janet output_end(uint8_t *out, JanetBuffer *into, size_t len) {
+  if (into != NULL) {
+    into->count += (int32_t) len;
+    return janet_wrap_buffer(into);
+  }
+  return janet_wrap_string(janet_string_end(out));
+}
+
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
+
+#ifdef BASE64_X86
+
+/* 16 bytes in, 32 characters out */
+__attribute__((target("ssse3")))
+static size_t hex_encode_ssse3(const uint8_t *in, size_t len, uint8_t *out, const char *digits) {
+  const __m128i lut = _mm_loadu_si128((const __m128i *) digits);
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+    const __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+    const __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(x, mask));
+    _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi8(hi, lo));
+    out += 32;
+  }
+  return i;
+}
+
+/* 32 bytes in, 64 characters out. Unpacking works per lane, so the halves
+ * are put back in order afterwards. */
+__attribute__((target("avx2")))
+static size_t hex_encode_avx2(const uint8_t *in, size_t len, uint8_t *out, const char *digits) {
+  const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) digits));
+  const __m256i mask = _mm256_set1_epi8(0x0F);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    const __m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+    const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), mask));
+    const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, mask));
+    const __m256i a = _mm256_unpacklo_epi8(hi, lo);
+    const __m256i b = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256((__m256i *) out, _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    out += 64;
+  }
+  return i;
+}
+
+/* Convert 16 hex digits of either case to their values, or return 1 if
+ * there is anything else in the block. */
+__attribute__((target("ssse3")))
+static int hex_digits_ssse3(__m128i c, __m128i *out) {
+  const __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+  const __m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  const __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+  const __m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+  if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xFFFF) return 1;
+  *out = _mm_or_si128(_mm_and_si128(is_digit, d),
+                      _mm_and_si128(is_letter, _mm_add_epi8(l, _mm_set1_epi8(10))));
+  return 0;
+}
+
+/* 32 characters in, 16 bytes out. Stops at the first block with a bad character. */
+__attribute__((target("ssse3")))
+static size_t hex_decode_ssse3(const uint8_t *in, size_t len, uint8_t *out) {
+  const __m128i weights = _mm_set1_epi16(0x0110);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m128i a, b;
+    if (hex_digits_ssse3(_mm_loadu_si128((const __m128i *)(in + i)), &a)) break;
+    if (hex_digits_ssse3(_mm_loadu_si128((const __m128i *)(in + i + 16)), &b)) break;
+    a = _mm_maddubs_epi16(a, weights);
+    b = _mm_maddubs_epi16(b, weights);
+    _mm_storeu_si128((__m128i *) out, _mm_packus_epi16(a, b));
+    out += 16;
+  }
+  return i;
+}
+
+static size_t hex_encode_simd(const uint8_t *in, size_t len, uint8_t *out, const char *digits) {
+  if (base64_simd_level == BASE64_AVX2) return hex_encode_avx2(in, len, out, digits);
+  if (base64_simd_level == BASE64_SSSE3) return hex_encode_ssse3(in, len, out, digits);
+  return 0;
+}
+
+static size_t hex_decode_simd(const uint8_t *in, size_t len, uint8_t *out) {
+  if (base64_simd_level) return hex_decode_ssse3(in, len, out);
+  return 0;
+}
+
+#elif defined(BASE64_NEON)
+
+/* 16 bytes in, 32 characters out */
+static size_t hex_encode_simd(const uint8_t *in, size_t len, uint8_t *out, const char *digits) {
+  const uint8x16_t lut = vld1q_u8((const uint8_t *) digits);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const uint8x16_t x = vld1q_u8(in + i);
+    uint8x16x2_t dst;
+    dst.val[0] = vqtbl1q_u8(lut, vshrq_n_u8(x, 4));
+    dst.val[1] = vqtbl1q_u8(lut, vandq_u8(x, vdupq_n_u8(0x0F)));
+    vst2q_u8(out, dst);
+    out += 32;
+  }
+  return i;
+}
+
+/* Convert hex digits of either case to their values, flagging anything else */
+static uint8x16_t hex_digits_neon(uint8x16_t c, uint8x16_t *valid) {
+  const uint8x16_t d = vsubq_u8(c, vdupq_n_u8('0'));
+  const uint8x16_t l = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+  const uint8x16_t is_digit = vcleq_u8(d, vdupq_n_u8(9));
+  const uint8x16_t is_letter = vcleq_u8(l, vdupq_n_u8(5));
+  *valid = vandq_u8(*valid, vorrq_u8(is_digit, is_letter));
+  return vbslq_u8(is_digit, d, vaddq_u8(l, vdupq_n_u8(10)));
+}
+
+/* 32 characters in, 16 bytes out */
+static size_t hex_decode_simd(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    const uint8x16x2_t src = vld2q_u8(in + i);
+    uint8x16_t valid = vdupq_n_u8(0xFF);
+    const uint8x16_t hi = hex_digits_neon(src.val[0], &valid);
+    const uint8x16_t lo = hex_digits_neon(src.val[1], &valid);
+    if (vminvq_u8(valid) == 0) break;
+    vst1q_u8(out, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    out += 16;
+  }
+  return i;
+}
+
+#else
+
+static size_t hex_encode_simd(const uint8_t *in, size_t len, uint8_t *out, const char *digits) {
+  (void) in;
+  (void) len;
+  (void) out;
+  (void) digits;
+  return 0;
+}
+
+static size_t hex_decode_simd(const uint8_t *in, size_t len, uint8_t *out) {
+  (void) in;
+  (void) len;
+  (void) out;
+  return 0;
+}
+
+#endif
+
+static void hex_encode(const uint8_t *in, size_t len, uint8_t *out, int upper) {
+  const char *digits = upper ? hex_upper : hex_lower;
+  size_t i = hex_encode_simd(in, len, out, digits);
+  for (out += 2 * i; i < len; i++) {
+    *out++ = digits[in[i] >> 4];
+    *out++ = digits[in[i] & 0x0F];
+  }
+}
+
+static int hex_value(uint8_t c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static void hex_decode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t i = hex_decode_simd(in, len, out);
+  for (out += i / 2; i < len; i += 2) {
+    int hi = hex_value(in[i]);
+    if (hi < 0) panic_character(in[i]);
+    int lo = hex_value(in[i + 1]);
+    if (lo < 0) panic_character(in[i + 1]);
+    *out++ = (uint8_t)((hi << 4) | lo);
+  }
+}
+
+/* Base32 from RFC 4648. Groups of 5 bytes are encoded as 8 characters. */
+
+static const char base32_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+static uint8_t base32_decode_table[256];
+
+/* Characters needed for a final group of 0 to 4 bytes, and back */
+static const uint8_t base32_tail_chars[5] = {0, 2, 4, 5, 7};
+static const int8_t base32_tail_bytes[8] = {0, -1, 1, -1, 2, 3, -1, 4};
+
+static void base32_init(void) {
+  memset(base32_decode_table, 0xFF, sizeof(base32_decode_table));
+  for (int i = 0; i < 32; i++) {
+    base32_decode_table[(uint8_t) base32_alphabet[i]] = (uint8_t) i;
+  }
+}
+
+static size_t base32_encoded_length(size_t len, int pad) {
+  size_t rem = len % 5;
+  size_t full = (len / 5) * 8;
+  if (rem == 0) return full;
+  return full + (pad ? 8 : base32_tail_chars[rem]);
+}
+
+static void base32_encode(const uint8_t *in, size_t len, uint8_t *out, int pad) {
+  size_t i = 0;
+  for (; i + 5 <= len; i += 5) {
+    uint64_t x = ((uint64_t) in[i] << 32) | ((uint64_t) in[i + 1] << 24) |
+                 ((uint64_t) in[i + 2] << 16) | ((uint64_t) in[i + 3] << 8) | in[i + 4];
+    for (int j = 0; j < 8; j++) {
+      out[j] = base32_alphabet[(x >> (35 - 5 * j)) & 31];
+    }
+    out += 8;
+  }
+  size_t rem = len - i;
+  if (rem == 0) return;
+  uint64_t x = 0;
+  for (size_t j = 0; j < rem; j++) {
+    x |= (uint64_t) in[i + j] << (32 - 8 * j);
+  }
+  size_t chars = base32_tail_chars[rem];
+  for (size_t j = 0; j < chars; j++) {
+    out[j] = base32_alphabet[(x >> (35 - 5 * j)) & 31];
+  }
+  if (pad) memset(out + chars, '=', 8 - chars);
+}
+
+/* Returns the number of characters before any padding, which has been checked */
+static size_t base32_unpadded_length(const uint8_t *in, size_t len) {
+  size_t body = len;
+  while (body > 0 && in[body - 1] == '=') body--;
+  if (base32_tail_bytes[body % 8] < 0 || (body < len && len - body != (8 - body % 8) % 8)) {
+    janet_panicf("Wrong length: %d", (int32_t) len);
+  }
+  return body;
+}
+
+static size_t base32_decoded_length(size_t body) {
+  return (body / 8) * 5 + (size_t) base32_tail_bytes[body % 8];
+}
+
+static void base32_decode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t i = 0;
+  while (i < len) {
+    size_t chars = len - i < 8 ? len - i : 8;
+    uint64_t x = 0;
+    for (size_t j = 0; j < 8; j++) {
+      uint8_t v = 0;
+      if (j < chars) {
+        v = base32_decode_table[in[i + j]];
+        if (v == 0xFF) panic_character(in[i + j]);
+      }
+      x = (x << 5) | v;
+    }
+    size_t bytes = chars == 8 ? 5 : (size_t) base32_tail_bytes[chars];
+    for (size_t j = 0; j < bytes; j++) {
+      out[j] = (uint8_t)(x >> (32 - 8 * j));
+    }
+    out += bytes;
+    i += chars;
+  }
+}
+
+/* Base85. Groups of 4 bytes are encoded big endian as 5 base 85 digits.
+ * Z85 (ZeroMQ RFC 32) has its own alphabet and only takes whole groups.
+ * Ascii85 uses the characters '!' to 'u', writes an all zero group as 'z',
+ * ends with a partial group and skips whitespace when decoding. */
+
+static const char z85_alphabet[] =
+  "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ.-:+=^!/*?&<>()[]{}@%$#";
+static uint8_t z85_decode_table[256];
+
+static void z85_init(void) {
+  memset(z85_decode_table, 0xFF, sizeof(z85_decode_table));
+  for (int i = 0; i < 85; i++) {
+    z85_decode_table[(uint8_t) z85_alphabet[i]] = (uint8_t) i;
+  }
+}
+
+static int optascii85(const Janet *argv, int32_t argc, int32_t n) {
+  if (argc <= n || janet_checktype(argv[n], JANET_NIL)) return 1;
+  JanetKeyword kw = janet_getkeyword(argv, n);
+  if (!janet_cstrcmp(kw, "ascii85")) return 1;
+  if (!janet_cstrcmp(kw, "z85")) return 0;
+  janet_panicf("expected alphabet :ascii85 or :z85, got %v", argv[n]);
+}
+
+static uint32_t read_be32(const uint8_t *p) {
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static void base85_digits(uint32_t x, uint8_t *out, size_t n, const char *alphabet) {
+  uint8_t digits[5];
+  for (int j = 4; j >= 0; j--) {
+    digits[j] = (uint8_t)(x % 85);
+    x /= 85;
+  }
+  for (size_t j = 0; j < n; j++) {
+    out[j] = alphabet ? (uint8_t) alphabet[digits[j]] : (uint8_t)('!' + digits[j]);
+  }
+}
+
+static size_t base85_encoded_length(const uint8_t *in, size_t len, int ascii85) {
+  if (!ascii85) {
+    if (len % 4) janet_panicf("Z85 input length must be a multiple of 4, got %d", (int32_t) len);
+    return (len / 4) * 5;
+  }
+  size_t n = 0;
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    n += read_be32(in + i) ? 5 : 1;
+  }
+  return n + ((len - i) ? (len - i) + 1 : 0);
+}
+
+static void base85_encode(const uint8_t *in, size_t len, uint8_t *out, int ascii85) {
+  const char *alphabet = ascii85 ? NULL : z85_alphabet;
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    uint32_t x = read_be32(in + i);
+    if (ascii85 && x == 0) {
+      *out++ = 'z';
+      continue;
+    }
+    base85_digits(x, out, 5, alphabet);
+    out += 5;
+  }
+  if (i < len) {
+    uint8_t last[4] = {0, 0, 0, 0};
+    memcpy(last, in + i, len - i);
+    base85_digits(read_be32(last), out, len - i + 1, alphabet);
+  }
+}
+
+static int ascii85_skip(uint8_t c) {
+  return is_whitespace(c) || c == '\v' || c == '\f';
+}
+
+static size_t base85_decoded_length(const uint8_t *in, size_t len, int ascii85) {
+  size_t chars = len;
+  size_t zeros = 0;
+  if (ascii85) {
+    chars = 0;
+    for (size_t i = 0; i < len; i++) {
+      if (in[i] == 'z') {
+        zeros++;
+      } else if (!ascii85_skip(in[i])) {
+        chars++;
+      }
+    }
+  }
+  if ((chars % 5) == 1 || (!ascii85 && (chars % 5))) {
+    janet_panicf("Wrong length: %d", (int32_t) len);
+  }
+  return zeros * 4 + (chars / 5) * 4 + ((chars % 5) ? (chars % 5) - 1 : 0);
+}
+
+/* Decode a group of n digits, padded with the highest digit as in Ascii85 */
+static void base85_group(const uint8_t *digits, size_t n, uint8_t *out) {
+  uint64_t x = 0;
+  for (size_t j = 0; j < 5; j++) {
+    x = x * 85 + (j < n ? digits[j] : 84);
+  }
+  if (x > UINT32_MAX) janet_panic("base85 group out of range");
+  for (size_t j = 0; j + 1 < n; j++) {
+    out[j] = (uint8_t)(x >> (24 - 8 * j));
+  }
+}
+
+static void base85_decode(const uint8_t *in, size_t len, uint8_t *out, int ascii85) {
+  uint8_t digits[5];
+  size_t pending = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = in[i];
+    uint8_t v;
+    if (ascii85) {
+      if (ascii85_skip(c)) continue;
+      if (c == 'z' && pending == 0) {
+        memset(out, 0, 4);
+        out += 4;
+        continue;
+      }
+      if (c < '!' || c > 'u') panic_character(c);
+      v = (uint8_t)(c - '!');
+    } else {
+      v = z85_decode_table[c];
+      if (v == 0xFF) panic_character(c);
+    }
+    digits[pending++] = v;
+    if (pending == 5) {
+      base85_group(digits, 5, out);
+      out += 4;
+      pending = 0;
+    }
+  }
+  if (pending) base85_group(digits, pending, out);
+}
+
+/* C Functions */
+
+/* Input from files, output into caller buffers and MIME line breaks all go
+ * through the streaming code. */
+static Janet convert_streaming(int32_t argc, Janet *argv, int decode,
+                               const Base64Alphabet *alphabet, int pad, int32_t into_arg) {
+  int has_into = argc > into_arg && !janet_checktype(argv[into_arg], JANET_NIL);
+  JanetBuffer *buffer = janet_optbuffer(argv, argc, into_arg, 0);
+  Base64Stream stream;
+  stream_init(&stream, alphabet, pad);
+  FILE *file = checkfile(argv, 0);
+  if (file != NULL) {
+    stream_file(&stream, decode, file, buffer);
+  } else {
+    uint8_t *copy;
+    JanetByteView in = stream_input(argv, 0, buffer, &copy);
+    if (decode) {
+      decoder_write(&stream, in.bytes, (size_t) in.len, buffer);
+      decoder_finish(&stream, buffer);
+    } else {
+      encoder_write(&stream, in.bytes, (size_t) in.len, buffer);
+      encoder_finish(&stream, buffer);
+    }
+    if (copy != NULL) janet_sfree(copy);
+  }
+  if (has_into) return janet_wrap_buffer(buffer);
+  return janet_stringv(buffer->data, buffer->count);
+}
+
+static Janet base64_encode(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 4);
+  const Base64Alphabet *alphabet = optalphabet(argv, argc, 1);
+  int pad = janet_optboolean(argv, argc, 2, 1);
+  if (argc > 3 || alphabet->mime || checkfile(argv, 0)) {
+    return convert_streaming(argc, argv, 0, alphabet, pad, 3);
+  }
+  JanetByteView in = janet_gettarray_bytes(argv, 0);
+  size_t outlen = encoded_length((size_t) in.len, pad);
+  if (outlen > INT32_MAX) janet_panic("input too large to encode");
+  uint8_t *out = janet_string_begin((int32_t) outlen);
+  encode_all(alphabet, in.bytes, (size_t) in.len, out, pad);
+  return janet_wrap_string(janet_string_end(out));
 }
 
 static Janet base64_decode(int32_t argc, Janet *argv) {
-  janet_fixarity(argc, 1);
-  int32_t inlen = janet_length(argv[0]);
-  if (inlen % 4 != 0) {
-    janet_panicf("Wrong length: %d", inlen);
-  }
-  const uint8_t *in = janet_getstring(argv, 0);
-  int padding = 0;
-  int end = inlen;
-  if (in[inlen - 2] == '=') {
-    end -= 4;
-    padding = 2;
-  } else if (in[inlen - 1] == '=') {
-    end -= 4;
-    padding = 1;
-  }
-  JanetBuffer *outbuf = janet_buffer((inlen / 4) * 3);
-  int cursor = 0;
-  uint8_t sextet1, sextet2, sextet3, sextet4;
-  for (; cursor < end; cursor += 4) {
-    sextet1 = decode_character(in[cursor]);
-    sextet2 = decode_character(in[cursor + 1]);
-    sextet3 = decode_character(in[cursor + 2]);
-    sextet4 = decode_character(in[cursor + 3]);
-    janet_buffer_push_u8(outbuf, decode_byte_1(sextet1, sextet2));
-    janet_buffer_push_u8(outbuf, decode_byte_2(sextet2, sextet3));
-    janet_buffer_push_u8(outbuf, decode_byte_3(sextet3, sextet4));
-  }
-  if (padding == 2) {
-    sextet1 = decode_character(in[cursor]);
-    sextet2 = decode_character(in[cursor + 1]);
-    janet_buffer_push_u8(outbuf, decode_byte_1(sextet1, sextet2));
-  } else if (padding == 1) {
-    sextet1 = decode_character(in[cursor]);
-    sextet2 = decode_character(in[cursor + 1]);
-    sextet3 = decode_character(in[cursor + 2]);
-    janet_buffer_push_u8(outbuf, decode_byte_1(sextet1, sextet2));
-    janet_buffer_push_u8(outbuf, decode_byte_2(sextet2, sextet3));
-  }
-  return janet_stringv(outbuf->data, outbuf->count);
+  janet_arity(argc, 1, 3);
+  const Base64Alphabet *alphabet = optalphabet(argv, argc, 1);
+  if (argc > 2 || alphabet->mime || checkfile(argv, 0)) {
+    return convert_streaming(argc, argv, 1, alphabet, 1, 2);
+  }
+  JanetByteView in = janet_gettarray_bytes(argv, 0);
+  size_t len = (size_t) in.len;
+  size_t padding = 0;
+  while (padding < 2 && len > 0 && in.bytes[len - 1] == '=') {
+    len--;
+    padding++;
+  }
+  if ((padding && (in.len % 4) != 0) || (len % 4) == 1) {
+    janet_panicf("Wrong length: %d", in.len);
+  }
+  size_t outlen = (len / 4) * 3 + ((len % 4) ? (len % 4) - 1 : 0);
+  uint8_t *out = janet_string_begin((int32_t) outlen);
+  size_t groups = len - (len % 4);
+  size_t used = decode_groups(alphabet, in.bytes, groups, out);
+  if (used < groups) {
+    panic_character(in.bytes[used + find_invalid(alphabet, in.bytes + used, groups - used)]);
+  }
+  decode_tail(alphabet, in.bytes + groups, len - groups, out + (groups / 4) * 3);
+  return janet_wrap_string(janet_string_end(out));
+}
+
+static Janet base64_encoder(int32_t argc, Janet *argv) {
+  janet_arity(argc, 0, 2);
+  Base64Stream *stream = janet_abstract(&encoder_type, sizeof(Base64Stream));
+  stream_init(stream, optalphabet(argv, argc, 0), janet_optboolean(argv, argc, 1, 1));
+  return janet_wrap_abstract(stream);
+}
+
+static Janet base64_decoder(int32_t argc, Janet *argv) {
+  janet_arity(argc, 0, 1);
+  Base64Stream *stream = janet_abstract(&decoder_type, sizeof(Base64Stream));
+  stream_init(stream, optalphabet(argv, argc, 0), 1);
+  return janet_wrap_abstract(stream);
+}
+
+static Janet base64_encode_hex(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 3);
+  int upper = janet_optboolean(argv, argc, 1, 0);
+  size_t len = (size_t) janet_gettarray_bytes(argv, 0).len;
+  JanetBuffer *into;
+  uint8_t *out = output_begin(argv, argc, 2, len * 2, &into);
+  /* Look the input up again in case `into` is the input buffer and moved */
+  hex_encode(janet_gettarray_bytes(argv, 0).bytes, len, out, upper);
+  return output_end(out, into, len * 2);
+}
+
+static Janet base64_decode_hex(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 2);
+  size_t len = (size_t) janet_gettarray_bytes(argv, 0).len;
+  if (len % 2) janet_panicf("Wrong length: %d", (int32_t) len);
+  JanetBuffer *into;
+  uint8_t *out = output_begin(argv, argc, 1, len / 2, &into);
+  hex_decode(janet_gettarray_bytes(argv, 0).bytes, len, out);
+  return output_end(out, into, len / 2);
+}
+
+static Janet base64_encode_base32(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 3);
+  int pad = janet_optboolean(argv, argc, 1, 1);
+  size_t len = (size_t) janet_gettarray_bytes(argv, 0).len;
+  size_t outlen = base32_encoded_length(len, pad);
+  JanetBuffer *into;
+  uint8_t *out = output_begin(argv, argc, 2, outlen, &into);
+  base32_encode(janet_gettarray_bytes(argv, 0).bytes, len, out, pad);
+  return output_end(out, into, outlen);
+}
+
+static Janet base64_decode_base32(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 2);
+  JanetByteView in = janet_gettarray_bytes(argv, 0);
+  size_t body = base32_unpadded_length(in.bytes, (size_t) in.len);
+  size_t outlen = base32_decoded_length(body);
+  JanetBuffer *into;
+  uint8_t *out = output_begin(argv, argc, 1, outlen, &into);
+  base32_decode(janet_gettarray_bytes(argv, 0).bytes, body, out);
+  return output_end(out, into, outlen);
+}
+
+static Janet base64_encode_base85(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 3);
+  int ascii85 = optascii85(argv, argc, 1);
+  JanetByteView in = janet_gettarray_bytes(argv, 0);
+  size_t outlen = base85_encoded_length(in.bytes, (size_t) in.len, ascii85);
+  JanetBuffer *into;
+  uint8_t *out = output_begin(argv, argc, 2, outlen, &into);
+  base85_encode(janet_gettarray_bytes(argv, 0).bytes, (size_t) in.len, out, ascii85);
+  return output_end(out, into, outlen);
+}
+
+static Janet base64_decode_base85(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 3);
+  int ascii85 = optascii85(argv, argc, 1);
+  JanetByteView in = janet_gettarray_bytes(argv, 0);
+  size_t outlen = base85_decoded_length(in.bytes, (size_t) in.len, ascii85);
+  JanetBuffer *into;
+  uint8_t *out = output_begin(argv, argc, 2, outlen, &into);
+  base85_decode(janet_gettarray_bytes(argv, 0).bytes, (size_t) in.len, out, ascii85);
+  return output_end(out, into, outlen);
 }
 
 static const JanetReg cfuns[] = {
   {
     "encode",
     base64_encode,
-    "(base64/encode x)\n\nEncodes a string in Base64. Returns encoded string."
+    "(base64/encode x &opt alphabet pad into)\n\nEncodes a string in Base64. Returns encoded string. "
+    "`alphabet` is :standard (the default), :url for the URL and filename safe "
+    "alphabet from RFC 4648, or :mime to break lines every 76 characters as in RFC 2045. "
+    "Set `pad` to false to leave off trailing `=` padding. "
+    "`x` can also be a readable file, which is encoded in chunks. "
+    "If a buffer `into` is given, the output is appended to it and `into` is returned instead."
   },
   {
     "decode",
     base64_decode,
-    "(base64/decode x)\n\nDecodes a string from Base64. Returns decoded string."
+    "(base64/decode x &opt alphabet into)\n\nDecodes a string from Base64. Returns decoded string. "
+    "`alphabet` is :standard (the default), :url, or :mime, which also skips whitespace and "
+    "line breaks. Both padded and unpadded input is accepted. "
+    "`x` can also be a readable file, which is decoded in chunks. "
+    "If a buffer `into` is given, the output is appended to it and `into` is returned instead, "
+    "avoiding an extra copy into a new string."
+  },
+  {
+    "encoder",
+    base64_encoder,
+    "(base64/encoder &opt alphabet pad)\n\nCreate a streaming Base64 encoder. "
+    "Use `(:write encoder bytes &opt into)` to encode a chunk and `(:finish encoder &opt into)` "
+    "to flush the last partial group. Both append to and return `into`, a new buffer if not given. "
+    "Arguments are the same as for `base64/encode`."
+  },
+  {
+    "decoder",
+    base64_decoder,
+    "(base64/decoder &opt alphabet)\n\nCreate a streaming Base64 decoder. "
+    "Use `(:write decoder chunk &opt into)` to decode a chunk and `(:finish decoder &opt into)` "
+    "to decode the last partial group. Both append to and return `into`, a new buffer if not given. "
+    "Chunks may split the input anywhere, so data read from a `core/stream` with `ev/read` can "
+    "be fed in directly."
+  },
+  {
+    "encode-hex",
+    base64_encode_hex,
+    "(base64/encode-hex x &opt upper into)\n\nEncodes bytes as hexadecimal, two digits per byte. "
+    "Digits are lowercase unless `upper` is true. "
+    "`x` can be a string, buffer or typed array. "
+    "If a buffer `into` is given, the output is appended to it and `into` is returned instead."
+  },
+  {
+    "decode-hex",
+    base64_decode_hex,
+    "(base64/decode-hex x &opt into)\n\nDecodes hexadecimal digits of either case. Returns decoded string. "
+    "`x` can be a string, buffer or typed array. "
+    "If a buffer `into` is given, the output is appended to it and `into` is returned instead."
+  },
+  {
+    "encode-base32",
+    base64_encode_base32,
+    "(base64/encode-base32 x &opt pad into)\n\nEncodes bytes in Base32 as in RFC 4648. "
+    "Set `pad` to false to leave off trailing `=` padding. "
+    "`x` can be a string, buffer or typed array. "
+    "If a buffer `into` is given, the output is appended to it and `into` is returned instead."
+  },
+  {
+    "decode-base32",
+    base64_decode_base32,
+    "(base64/decode-base32 x &opt into)\n\nDecodes Base32 as in RFC 4648. Returns decoded string. "
+    "Both padded and unpadded input is accepted. "
+    "`x` can be a string, buffer or typed array. "
+    "If a buffer `into` is given, the output is appended to it and `into` is returned instead."
+  },
+  {
+    "encode-base85",
+    base64_encode_base85,
+    "(base64/encode-base85 x &opt alphabet into)\n\nEncodes bytes in Base85. `alphabet` is "
+    ":ascii85 (the default), which writes groups of zeros as `z`, or :z85 for ZeroMQ's Z85, "
+    "which requires the input length to be a multiple of 4. "
+    "`x` can be a string, buffer or typed array. "
+    "If a buffer `into` is given, the output is appended to it and `into` is returned instead."
+  },
+  {
+    "decode-base85",
+    base64_decode_base85,
+    "(base64/decode-base85 x &opt alphabet into)\n\nDecodes Base85. Returns decoded string. "
+    "`alphabet` is :ascii85 (the default), which skips whitespace, or :z85. "
+    "`x` can be a string, buffer or typed array. "
+    "If a buffer `into` is given, the output is appended to it and `into` is returned instead."
   },
   {NULL, NULL, NULL}
 };
 
 JANET_MODULE_ENTRY(JanetTable *env) {
+  alphabet_init(&alphabet_standard);
+  alphabet_init(&alphabet_url);
+  alphabet_init(&alphabet_mime);
+  base32_init();
+  z85_init();
+  simd_init();
   janet_cfuns(env, "base64", cfuns);
 }
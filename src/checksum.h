@@ -0,0 +1,104 @@
+/*
+* Copyright (c) 2026 Calvin Rose and contributors
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+ * Combining checksums of adjacent blocks, shared by spork/crc and spork/zip.
+ * Header only so that each module stays a single shared object.
+ *
+ * Feeding a zero byte through a CRC register is a linear map over GF(2), so
+ * the effect of appending n bytes can be computed in O(log n) matrix squarings.
+ * This lets blocks be checksummed independently and the results stitched
+ * together, like zlib's crc32_combine but for any CRC of up to 32 bits.
+ */
+
+#ifndef SPORK_CHECKSUM_H_defined
+#define SPORK_CHECKSUM_H_defined
+
+#include <stdint.h>
+#include <string.h>
+
+/* Advance a CRC register by one zero byte. */
+typedef uint32_t (*SporkCRCZeroFn)(void *variant, uint32_t sum);
+
+static inline uint32_t spork_gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static inline void spork_gf2_matrix_square(int width, uint32_t *square, const uint32_t *mat) {
+    for (int n = 0; n < width; n++) {
+        square[n] = spork_gf2_matrix_times(mat, mat[n]);
+    }
+}
+
+/* Advance a `width` bit CRC register as if len zero bytes were fed through it. */
+static inline uint32_t spork_crc_shift_zeros(int width, SporkCRCZeroFn zero, void *variant,
+                                             uint32_t sum, uint64_t len) {
+    uint32_t mat[32], square[32];
+    for (int i = 0; i < width; i++) {
+        mat[i] = zero(variant, (uint32_t) 1 << i);
+    }
+    while (len) {
+        if (len & 1) sum = spork_gf2_matrix_times(mat, sum);
+        len >>= 1;
+        if (!len) break;
+        spork_gf2_matrix_square(width, square, mat);
+        memcpy(mat, square, sizeof(uint32_t) * width);
+    }
+    return sum;
+}
+
+static inline uint32_t spork_crc32_zero(void *variant, uint32_t sum) {
+    (void) variant;
+    for (int b = 0; b < 8; b++) {
+        sum = (sum & 1) ? (sum >> 1) ^ 0xEDB88320u : sum >> 1;
+    }
+    return sum;
+}
+
+/* Checksum of A followed by B for the crc-32 of zip, gzip and zlib, given
+ * crc(A), crc(B) and the length of B. */
+static inline uint32_t spork_crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+    return spork_crc_shift_zeros(32, spork_crc32_zero, NULL, crc1, len2) ^ crc2;
+}
+
+/* Adler-32 of A followed by B, given adler(A), adler(B) and the length of B. */
+static inline uint32_t spork_adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t len2) {
+    const uint32_t base = 65521;
+    uint32_t rem = (uint32_t)(len2 % base);
+    uint32_t sum1 = adler1 & 0xFFFF;
+    uint32_t sum2 = (uint32_t)(((uint64_t) rem * sum1) % base);
+    sum1 += (adler2 & 0xFFFF) + base - 1;
+    sum2 += ((adler1 >> 16) & 0xFFFF) + ((adler2 >> 16) & 0xFFFF) + base - rem;
+    if (sum1 >= base) sum1 -= base;
+    if (sum1 >= base) sum1 -= base;
+    if (sum2 >= 2 * base) sum2 -= 2 * base;
+    if (sum2 >= base) sum2 -= base;
+    return sum1 | (sum2 << 16);
+}
+
+#endif /* SPORK_CHECKSUM_H_defined */
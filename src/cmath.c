@@ -21,6 +21,16 @@
 */
 
 #include <janet.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include "tarray.h"
+#include "workers.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CMATH_X86
+#include <immintrin.h>
+#endif
 
 int64_t _mod_impl(int64_t a, int64_t m) {
     if (m == 0) return a;
@@ -113,6 +123,499 @@ int64_t _mulmod_impl(int64_t a, int64_t b, int64_t m) {
 
 #endif
 
+/* Montgomery arithmetic */
+
+/* Full product of a and b. Returns the low 64 bits and stores the high 64
+ * bits in hi. */
+static uint64_t mul_wide(uint64_t a, uint64_t b, uint64_t *hi) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 t = (unsigned __int128) a * b;
+    *hi = (uint64_t)(t >> 64);
+    return (uint64_t) t;
+#elif defined(_WIN64) && defined(_MSC_VER) && !defined(_M_ARM64)
+    return _umul128(a, b, hi);
+#else
+    uint64_t a0 = a & 0xFFFFFFFF, a1 = a >> 32;
+    uint64_t b0 = b & 0xFFFFFFFF, b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t mid = (p00 >> 32) + (p01 & 0xFFFFFFFF) + (p10 & 0xFFFFFFFF);
+    *hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+    return (mid << 32) | (p00 & 0xFFFFFFFF);
+#endif
+}
+
+/* Residues in Montgomery form are stored as aR mod m with R = 2^64. A
+ * modular multiply then needs three multiplies and no division. Only odd
+ * moduli have a Montgomery form. */
+typedef struct {
+    uint64_t m;
+    uint64_t inv; /* 1/m mod R */
+    uint64_t one; /* R mod m */
+    uint64_t r2; /* R^2 mod m */
+} MontCtx;
+
+static void mont_init(MontCtx *ctx, uint64_t m) {
+    /* Newton's iteration doubles the correct low bits of 1/m, starting from
+     * m itself, which is its own inverse mod 8. */
+    uint64_t inv = m;
+    for (int i = 0; i < 5; i++) inv *= 2 - m * inv;
+    ctx->m = m;
+    ctx->inv = inv;
+    ctx->one = (0 - m) % m;
+    uint64_t r2 = ctx->one;
+    for (int i = 0; i < 64; i++) {
+        r2 = (r2 >= m - r2) ? r2 - (m - r2) : r2 + r2;
+    }
+    ctx->r2 = r2;
+}
+
+/* Get (hi:lo) / R mod m, for any (hi:lo) < mR. */
+static uint64_t mont_redc(const MontCtx *ctx, uint64_t hi, uint64_t lo) {
+    /* (hi:lo) - q * m has a low half of 0, so only the high halves are
+     * subtracted. */
+    uint64_t qhi;
+    (void) mul_wide(lo * ctx->inv, ctx->m, &qhi);
+    return (hi < qhi) ? hi - qhi + ctx->m : hi - qhi;
+}
+
+/* Product of a and b in Montgomery form, both less than m. */
+static uint64_t mont_mul(const MontCtx *ctx, uint64_t a, uint64_t b) {
+    uint64_t hi;
+    uint64_t lo = mul_wide(a, b, &hi);
+    return mont_redc(ctx, hi, lo);
+}
+
+static uint64_t mont_to(const MontCtx *ctx, uint64_t a) {
+    return mont_mul(ctx, a, ctx->r2);
+}
+
+static uint64_t mont_from(const MontCtx *ctx, uint64_t x) {
+    return mont_redc(ctx, 0, x);
+}
+
+/* x^e with x and the result in Montgomery form. */
+static uint64_t mont_pow(const MontCtx *ctx, uint64_t x, uint64_t e) {
+    uint64_t res = ctx->one;
+    while (e > 0) {
+        if (e & 1) res = mont_mul(ctx, res, x);
+        x = mont_mul(ctx, x, x);
+        e >>= 1;
+    }
+    return res;
+}
+
+/* a * b mod m for plain residues a and b, both less than m. */
+static uint64_t mont_mulmod(const MontCtx *ctx, uint64_t a, uint64_t b) {
+    return mont_mul(ctx, mont_mul(ctx, a, b), ctx->r2);
+}
+
+/* a^e mod m for a plain residue a less than m. */
+static uint64_t mont_powmod(const MontCtx *ctx, uint64_t a, uint64_t e) {
+    return mont_from(ctx, mont_pow(ctx, mont_to(ctx, a), e));
+}
+
+/* a^b mod m, using Montgomery form for odd m > 1. */
+int64_t _powmod_impl(int64_t a, uint64_t b, int64_t m) {
+    if (m > 1 && (m & 1)) {
+        MontCtx ctx;
+        mont_init(&ctx, (uint64_t) m);
+        return (int64_t) mont_powmod(&ctx, (uint64_t) _mod_impl(a, m), b);
+    }
+    int64_t res = 1;
+    while (b > 0) {
+        if ((b & 1) == 1)
+            res = _mulmod_impl(res, a, m);
+        a = _mulmod_impl(a, a, m);
+        b >>= 1;
+    }
+    return res;
+}
+
+/* Big integers */
+
+/* Sign and magnitude, with the magnitude in little endian 32 bit limbs and
+ * no leading zero limbs, so zero has no limbs at all. Like other numbers
+ * they are never modified once created. */
+typedef struct {
+    int32_t sign;
+    int32_t len;
+    uint32_t limbs[];
+} BigInt;
+
+/* Read only view of any integer argument. Numbers and 64 bit integers are
+ * unpacked into buf. */
+typedef struct {
+    int32_t sign;
+    int32_t len;
+    const uint32_t *limbs;
+    uint32_t buf[34];
+} BigView;
+
+static int bigint_get(void *p, Janet key, Janet *out);
+static int bigint_compare(void *lhs, void *rhs);
+static int32_t bigint_hash(void *p, size_t size);
+static void bigint_tostring(void *p, JanetBuffer *buffer);
+static void bigint_marshal(void *p, JanetMarshalContext *ctx);
+static void *bigint_unmarshal(JanetMarshalContext *ctx);
+
+static const JanetAbstractType bigint_type = {
+    .name = "math/bigint",
+    .get = bigint_get,
+    .marshal = bigint_marshal,
+    .unmarshal = bigint_unmarshal,
+    .tostring = bigint_tostring,
+    .compare = bigint_compare,
+    .hash = bigint_hash
+};
+
+static int clz32(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clz(x);
+#else
+    int n = 0;
+    while (!(x & 0x80000000u)) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static int32_t mag_norm(const uint32_t *a, int32_t n) {
+    while (n > 0 && a[n - 1] == 0) n--;
+    return n;
+}
+
+static int mag_cmp(const uint32_t *a, int32_t an, const uint32_t *b, int32_t bn) {
+    an = mag_norm(a, an);
+    bn = mag_norm(b, bn);
+    if (an != bn) return an < bn ? -1 : 1;
+    for (int32_t i = an - 1; i >= 0; i--) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* r = a + b, with room for max(an, bn) + 1 limbs. r may be a or b. Returns
+ * the length of r. */
+static int32_t mag_add(uint32_t *r, const uint32_t *a, int32_t an, const uint32_t *b, int32_t bn) {
+    if (an < bn) {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        int32_t tn = an;
+        an = bn;
+        bn = tn;
+    }
+    uint64_t carry = 0;
+    int32_t i;
+    for (i = 0; i < bn; i++) {
+        carry += (uint64_t) a[i] + b[i];
+        r[i] = (uint32_t) carry;
+        carry >>= 32;
+    }
+    for (; i < an; i++) {
+        carry += a[i];
+        r[i] = (uint32_t) carry;
+        carry >>= 32;
+    }
+    r[an] = (uint32_t) carry;
+    return mag_norm(r, an + 1);
+}
+
+/* r = a - b for a >= b, with room for an limbs. r may be a or b. Returns the
+ * length of r. */
+static int32_t mag_sub(uint32_t *r, const uint32_t *a, int32_t an, const uint32_t *b, int32_t bn) {
+    int64_t borrow = 0;
+    int32_t i;
+    for (i = 0; i < bn; i++) {
+        int64_t t = (int64_t) a[i] - b[i] - borrow;
+        r[i] = (uint32_t) t;
+        borrow = t < 0;
+    }
+    for (; i < an; i++) {
+        int64_t t = (int64_t) a[i] - borrow;
+        r[i] = (uint32_t) t;
+        borrow = t < 0;
+    }
+    return mag_norm(r, an);
+}
+
+/* r += b shifted up by off limbs. The sum must fit in the rn limbs of r. */
+static void mag_add_at(uint32_t *r, int32_t rn, const uint32_t *b, int32_t bn, int32_t off) {
+    uint64_t carry = 0;
+    int32_t i;
+    for (i = 0; i < bn; i++) {
+        carry += (uint64_t) r[off + i] + b[i];
+        r[off + i] = (uint32_t) carry;
+        carry >>= 32;
+    }
+    for (i += off; carry && i < rn; i++) {
+        carry += r[i];
+        r[i] = (uint32_t) carry;
+        carry >>= 32;
+    }
+}
+
+/* Operands shorter than this many limbs are multiplied directly. */
+#define KARATSUBA_CUTOFF 32
+
+static void mag_mul_school(uint32_t *r, const uint32_t *a, int32_t an, const uint32_t *b, int32_t bn) {
+    memset(r, 0, sizeof(uint32_t) * (size_t)(an + bn));
+    for (int32_t i = 0; i < an; i++) {
+        uint64_t carry = 0;
+        uint64_t ai = a[i];
+        if (ai == 0) continue;
+        for (int32_t j = 0; j < bn; j++) {
+            carry += ai * b[j] + r[i + j];
+            r[i + j] = (uint32_t) carry;
+            carry >>= 32;
+        }
+        r[i + bn] = (uint32_t) carry;
+    }
+}
+
+/* r = a * b, with room for an + bn limbs. r must not overlap a or b. */
+static void mag_mul(uint32_t *r, const uint32_t *a, int32_t an, const uint32_t *b, int32_t bn) {
+    if (an < bn) {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        int32_t tn = an;
+        an = bn;
+        bn = tn;
+    }
+    if (bn < KARATSUBA_CUTOFF) {
+        mag_mul_school(r, a, an, b, bn);
+        return;
+    }
+    int32_t h = (an + 1) / 2;
+    if (bn <= h) {
+        /* Too lopsided to split both, so multiply b by each half of a. */
+        uint32_t *t = janet_smalloc(sizeof(uint32_t) * (size_t)(an - h + bn));
+        mag_mul(r, a, h, b, bn);
+        memset(r + h + bn, 0, sizeof(uint32_t) * (size_t)(an - h));
+        mag_mul(t, a + h, an - h, b, bn);
+        mag_add_at(r, an + bn, t, an - h + bn, h);
+        janet_sfree(t);
+        return;
+    }
+    /* With a = a1 B^h + a0 and b = b1 B^h + b0, a * b = z2 B^2h + z1 B^h + z0
+     * where z1 = (a0 + a1)(b0 + b1) - z0 - z2. */
+    uint32_t *sa = janet_smalloc(sizeof(uint32_t) * (size_t)(4 * h + 4));
+    uint32_t *sb = sa + h + 1;
+    uint32_t *z1 = sb + h + 1;
+    int32_t san = mag_add(sa, a, h, a + h, an - h);
+    int32_t sbn = mag_add(sb, b, h, b + h, bn - h);
+    memset(z1, 0, sizeof(uint32_t) * (size_t)(2 * h + 2));
+    mag_mul(z1, sa, san, sb, sbn);
+    mag_mul(r, a, h, b, h);
+    mag_mul(r + 2 * h, a + h, an - h, b + h, bn - h);
+    mag_sub(z1, z1, 2 * h + 2, r, 2 * h);
+    mag_sub(z1, z1, 2 * h + 2, r + 2 * h, an + bn - 2 * h);
+    mag_add_at(r, an + bn, z1, mag_norm(z1, 2 * h + 2), h);
+    janet_sfree(sa);
+}
+
+/* q = a / b and r = a % b for normalized b with bn > 0, using Knuth's
+ * algorithm D. q has room for an - bn + 1 limbs and r for bn limbs, and
+ * either can be NULL. */
+static void mag_divmod(uint32_t *q, uint32_t *r, const uint32_t *a, int32_t an,
+                       const uint32_t *b, int32_t bn) {
+    if (an < bn) {
+        if (r) {
+            if (an) memcpy(r, a, sizeof(uint32_t) * (size_t) an);
+            memset(r + an, 0, sizeof(uint32_t) * (size_t)(bn - an));
+        }
+        return;
+    }
+    if (bn == 1) {
+        uint64_t rem = 0;
+        for (int32_t i = an - 1; i >= 0; i--) {
+            uint64_t cur = (rem << 32) | a[i];
+            if (q) q[i] = (uint32_t)(cur / b[0]);
+            rem = cur % b[0];
+        }
+        if (r) r[0] = (uint32_t) rem;
+        return;
+    }
+    /* Shift so the top limb of the divisor has its high bit set, which keeps
+     * each estimated quotient limb at most 2 too large. */
+    int s = clz32(b[bn - 1]);
+    uint32_t *vn = janet_smalloc(sizeof(uint32_t) * (size_t)(bn + an + 1));
+    uint32_t *un = vn + bn;
+    for (int32_t i = bn - 1; i > 0; i--) {
+        vn[i] = (b[i] << s) | (s ? b[i - 1] >> (32 - s) : 0);
+    }
+    vn[0] = b[0] << s;
+    un[an] = s ? a[an - 1] >> (32 - s) : 0;
+    for (int32_t i = an - 1; i > 0; i--) {
+        un[i] = (a[i] << s) | (s ? a[i - 1] >> (32 - s) : 0);
+    }
+    un[0] = a[0] << s;
+    for (int32_t j = an - bn; j >= 0; j--) {
+        uint64_t num = ((uint64_t) un[j + bn] << 32) | un[j + bn - 1];
+        uint64_t qhat = num / vn[bn - 1];
+        uint64_t rhat = num % vn[bn - 1];
+        while (qhat > UINT32_MAX || qhat * vn[bn - 2] > ((rhat << 32) | un[j + bn - 2])) {
+            qhat--;
+            rhat += vn[bn - 1];
+            if (rhat > UINT32_MAX) break;
+        }
+        int64_t borrow = 0;
+        int64_t t;
+        for (int32_t i = 0; i < bn; i++) {
+            uint64_t p = qhat * vn[i];
+            t = (int64_t) un[i + j] - borrow - (int64_t)(p & 0xFFFFFFFF);
+            un[i + j] = (uint32_t) t;
+            borrow = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t) un[j + bn] - borrow;
+        un[j + bn] = (uint32_t) t;
+        if (t < 0) {
+            /* Estimate was one too large, add the divisor back. */
+            qhat--;
+            uint64_t carry = 0;
+            for (int32_t i = 0; i < bn; i++) {
+                carry += (uint64_t) un[i + j] + vn[i];
+                un[i + j] = (uint32_t) carry;
+                carry >>= 32;
+            }
+            un[j + bn] += (uint32_t) carry;
+        }
+        if (q) q[j] = (uint32_t) qhat;
+    }
+    if (r) {
+        for (int32_t i = 0; i < bn - 1; i++) {
+            r[i] = (un[i] >> s) | (s ? un[i + 1] << (32 - s) : 0);
+        }
+        r[bn - 1] = un[bn - 1] >> s;
+    }
+    janet_sfree(vn);
+}
+
+static void bigview_set_u64(BigView *v, int32_t sign, uint64_t x) {
+    v->buf[0] = (uint32_t) x;
+    v->buf[1] = (uint32_t)(x >> 32);
+    v->limbs = v->buf;
+    v->len = mag_norm(v->buf, 2);
+    v->sign = v->len ? sign : 0;
+}
+
+static void bigview_set_s64(BigView *v, int64_t x) {
+    bigview_set_u64(v, x < 0 ? -1 : 1, x < 0 ? (uint64_t) 0 - (uint64_t) x : (uint64_t) x);
+}
+
+/* View any integer: a bigint, an integral number, or an int/s64 or int/u64.
+ * Returns 0 for anything else. */
+static int bigview_check(Janet x, BigView *v) {
+    if (janet_checktype(x, JANET_NUMBER)) {
+        double d = janet_unwrap_number(x);
+        if (!isfinite(d) || d != floor(d)) return 0;
+        double m = fabs(d);
+        int32_t sign = d < 0 ? -1 : 1;
+        if (m < 18446744073709551616.0) {
+            bigview_set_u64(v, sign, (uint64_t) m);
+            return 1;
+        }
+        /* Larger doubles are a 53 bit mantissa shifted up. */
+        int e;
+        uint64_t mant = (uint64_t) ldexp(frexp(m, &e), 53);
+        int32_t limb = (e - 53) / 32;
+        int bit = (e - 53) % 32;
+        memset(v->buf, 0, sizeof(v->buf));
+        v->buf[limb] = (uint32_t)(mant << bit);
+        v->buf[limb + 1] = (uint32_t)((mant << bit) >> 32);
+        if (bit) v->buf[limb + 2] = (uint32_t)(mant >> (64 - bit));
+        v->limbs = v->buf;
+        v->len = mag_norm(v->buf, 34);
+        v->sign = sign;
+        return 1;
+    }
+    if (!janet_checktype(x, JANET_ABSTRACT)) return 0;
+    BigInt *b = janet_checkabstract(x, &bigint_type);
+    if (b != NULL) {
+        v->sign = b->sign;
+        v->len = b->len;
+        v->limbs = b->limbs;
+        return 1;
+    }
+#ifdef JANET_INT_TYPES
+    switch (janet_is_int(x)) {
+        case JANET_INT_S64:
+            bigview_set_s64(v, janet_unwrap_s64(x));
+            return 1;
+        case JANET_INT_U64:
+            bigview_set_u64(v, 1, janet_unwrap_u64(x));
+            return 1;
+        default:
+            break;
+    }
+#endif
+    return 0;
+}
+
+static void bigview_get(const Janet *argv, int32_t n, BigView *v) {
+    if (!bigview_check(argv[n], v)) {
+        janet_panicf("bad slot #%d, expected integer, got %v", n, argv[n]);
+    }
+}
+
+static int bigview_to_int64(const BigView *v, int64_t *out) {
+    if (v->len > 2) return 0;
+    uint64_t m = 0;
+    if (v->len > 0) m = v->limbs[0];
+    if (v->len > 1) m |= (uint64_t) v->limbs[1] << 32;
+    if (v->sign < 0) {
+        if (m > (uint64_t) INT64_MAX + 1) return 0;
+        *out = (m == (uint64_t) INT64_MAX + 1) ? INT64_MIN : -(int64_t) m;
+    } else {
+        if (m > INT64_MAX) return 0;
+        *out = (int64_t) m;
+    }
+    return 1;
+}
+
+static int is_bigint(Janet x) {
+    return janet_checkabstract(x, &bigint_type) != NULL;
+}
+
+static int bigint_any(const Janet *argv, int32_t argc) {
+    for (int32_t i = 0; i < argc; i++) {
+        if (is_bigint(argv[i])) return 1;
+    }
+    return 0;
+}
+
+static BigInt *bigint_alloc(int32_t len) {
+    BigInt *b = janet_abstract(&bigint_type, sizeof(BigInt) + sizeof(uint32_t) * (size_t) len);
+    b->sign = 0;
+    b->len = len;
+    return b;
+}
+
+/* Trim leading zero limbs of a bigint filled in after bigint_alloc. */
+static Janet bigint_finish(BigInt *b, int32_t sign) {
+    b->len = mag_norm(b->limbs, b->len);
+    b->sign = b->len ? sign : 0;
+    return janet_wrap_abstract(b);
+}
+
+static Janet bigint_make(int32_t sign, const uint32_t *mag, int32_t len) {
+    len = mag_norm(mag, len);
+    if (len < 0) len = 0;
+    size_t n = (size_t) len;
+    BigInt *b = bigint_alloc(len);
+    if (n) memcpy(b->limbs, mag, sizeof(uint32_t) * n);
+    return bigint_finish(b, sign);
+}
+
+static Janet bigint_from_int64(int64_t x) {
+    BigView v;
+    bigview_set_s64(&v, x);
+    return bigint_make(v.sign, v.limbs, v.len);
+}
+
 Janet wrap_nan() {
 #ifdef NAN
     return janet_wrap_number(NAN);
@@ -126,6 +629,8 @@ Janet wrap_nan() {
 Janet wrap_result(int64_t a, Janet m) {
     if (!janet_checktype(m, JANET_ABSTRACT))
         return janet_wrap_number(a);
+    if (is_bigint(m))
+        return bigint_from_int64(a);
 
     const JanetAbstractType *at = janet_abstract_type(janet_unwrap_abstract(m));
     int64_t *box = janet_abstract(at, sizeof(int64_t));
@@ -133,10 +638,647 @@ Janet wrap_result(int64_t a, Janet m) {
     return janet_wrap_abstract(box);
 }
 
+/* Big integer arithmetic */
+
+static Janet bigint_addsub(const BigView *a, const BigView *b, int32_t bsign) {
+    int32_t bs = b->sign * bsign;
+    if (!a->len) return bigint_make(bs, b->limbs, b->len);
+    if (!b->len) return bigint_make(a->sign, a->limbs, a->len);
+    BigInt *r = bigint_alloc((a->len > b->len ? a->len : b->len) + 1);
+    if (a->sign == bs) {
+        mag_add(r->limbs, a->limbs, a->len, b->limbs, b->len);
+        return bigint_finish(r, a->sign);
+    }
+    if (mag_cmp(a->limbs, a->len, b->limbs, b->len) >= 0) {
+        mag_sub(r->limbs, a->limbs, a->len, b->limbs, b->len);
+        r->limbs[r->len - 1] = 0;
+        return bigint_finish(r, a->sign);
+    }
+    mag_sub(r->limbs, b->limbs, b->len, a->limbs, a->len);
+    r->limbs[r->len - 1] = 0;
+    return bigint_finish(r, bs);
+}
+
+static Janet bigint_mul(const BigView *a, const BigView *b) {
+    if (!a->len || !b->len) return bigint_make(0, NULL, 0);
+    BigInt *r = bigint_alloc(a->len + b->len);
+    mag_mul(r->limbs, a->limbs, a->len, b->limbs, b->len);
+    return bigint_finish(r, a->sign * b->sign);
+}
+
+/* Quotient or remainder of a by b. Rounds toward zero, or toward negative
+ * infinity if floor_round is set, in which case the remainder takes the
+ * sign of b. */
+static Janet bigint_divide(const BigView *a, const BigView *b, int floor_round, int want_rem) {
+    static const uint32_t one = 1;
+    if (!b->len) janet_panic("division by zero");
+    int32_t qn = a->len - b->len + 1;
+    if (qn < 1) qn = 1;
+    uint32_t *q = janet_smalloc(sizeof(uint32_t) * (size_t)(qn + 1 + b->len));
+    uint32_t *r = q + qn + 1;
+    memset(q, 0, sizeof(uint32_t) * (size_t)(qn + 1));
+    mag_divmod(q, r, a->limbs, a->len, b->limbs, b->len);
+    int32_t qlen = mag_norm(q, qn);
+    int32_t rlen = mag_norm(r, b->len);
+    int32_t qsign = a->sign * b->sign;
+    int32_t rsign = a->sign;
+    if (floor_round && rlen && a->sign != b->sign) {
+        qlen = mag_add(q, q, qlen, &one, 1);
+        rlen = mag_sub(r, b->limbs, b->len, r, rlen);
+        rsign = b->sign;
+    }
+    Janet out = want_rem ? bigint_make(rsign, r, rlen) : bigint_make(qsign, q, qlen);
+    janet_sfree(q);
+    return out;
+}
+
+typedef enum {
+    BIGOP_ADD,
+    BIGOP_SUB,
+    BIGOP_MUL,
+    BIGOP_DIV,
+    BIGOP_FLOORDIV,
+    BIGOP_REM,
+    BIGOP_MOD
+} BigOp;
+
+static Janet bigint_binop(BigOp op, Janet x, Janet y) {
+    BigView a, b;
+    if (!bigview_check(x, &a)) janet_panicf("expected integer, got %v", x);
+    if (!bigview_check(y, &b)) janet_panicf("expected integer, got %v", y);
+    switch (op) {
+        case BIGOP_ADD:
+            return bigint_addsub(&a, &b, 1);
+        case BIGOP_SUB:
+            return bigint_addsub(&a, &b, -1);
+        case BIGOP_MUL:
+            return bigint_mul(&a, &b);
+        case BIGOP_DIV:
+            return bigint_divide(&a, &b, 0, 0);
+        case BIGOP_FLOORDIV:
+            return bigint_divide(&a, &b, 1, 0);
+        case BIGOP_REM:
+            return bigint_divide(&a, &b, 0, 1);
+        default:
+            return bigint_divide(&a, &b, 1, 1);
+    }
+}
+
+/* Methods for the arithmetic operators, and their reversed forms for when
+ * the bigint is on the right. */
+#define BIGINT_OPMETHOD(name, op) \
+static Janet bigint_op_##name(int32_t argc, Janet *argv) { \
+    janet_fixarity(argc, 2); \
+    return bigint_binop(op, argv[0], argv[1]); \
+} \
+static Janet bigint_op_r##name(int32_t argc, Janet *argv) { \
+    janet_fixarity(argc, 2); \
+    return bigint_binop(op, argv[1], argv[0]); \
+}
+
+BIGINT_OPMETHOD(add, BIGOP_ADD)
+BIGINT_OPMETHOD(sub, BIGOP_SUB)
+BIGINT_OPMETHOD(mul, BIGOP_MUL)
+BIGINT_OPMETHOD(div, BIGOP_DIV)
+BIGINT_OPMETHOD(floordiv, BIGOP_FLOORDIV)
+BIGINT_OPMETHOD(rem, BIGOP_REM)
+BIGINT_OPMETHOD(mod, BIGOP_MOD)
+
+static int bigview_cmp(const BigView *a, const BigView *b) {
+    if (a->sign != b->sign) return a->sign < b->sign ? -1 : 1;
+    int c = mag_cmp(a->limbs, a->len, b->limbs, b->len);
+    return a->sign < 0 ? -c : c;
+}
+
+static Janet bigint_compare_method(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    BigView a, b;
+    bigview_get(argv, 0, &a);
+    if (janet_checktype(argv[1], JANET_NUMBER)) {
+        /* Fractions compare against their floor, breaking ties upward. */
+        double d = janet_unwrap_number(argv[1]);
+        if (isnan(d)) janet_panic("cannot compare with nan");
+        if (isinf(d)) return janet_wrap_number(d > 0 ? -1 : 1);
+        Janet fl = janet_wrap_number(floor(d));
+        bigview_get(&fl, 0, &b);
+        int c = bigview_cmp(&a, &b);
+        if (c == 0 && d != floor(d)) c = -1;
+        return janet_wrap_number(c);
+    }
+    bigview_get(argv, 1, &b);
+    return janet_wrap_number(bigview_cmp(&a, &b));
+}
+
+static const JanetMethod bigint_methods[] = {
+    {"+", bigint_op_add},
+    {"-", bigint_op_sub},
+    {"*", bigint_op_mul},
+    {"/", bigint_op_div},
+    {"div", bigint_op_floordiv},
+    {"%", bigint_op_rem},
+    {"mod", bigint_op_mod},
+    {"r+", bigint_op_radd},
+    {"r-", bigint_op_rsub},
+    {"r*", bigint_op_rmul},
+    {"r/", bigint_op_rdiv},
+    {"rdiv", bigint_op_rfloordiv},
+    {"r%", bigint_op_rrem},
+    {"rmod", bigint_op_rmod},
+    {"compare", bigint_compare_method},
+    {NULL, NULL}
+};
+
+static int bigint_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD)) return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), bigint_methods, out);
+}
+
+static int bigint_compare(void *lhs, void *rhs) {
+    BigInt *a = (BigInt *) lhs;
+    BigInt *b = (BigInt *) rhs;
+    if (a->sign != b->sign) return a->sign < b->sign ? -1 : 1;
+    int c = mag_cmp(a->limbs, a->len, b->limbs, b->len);
+    return a->sign < 0 ? -c : c;
+}
+
+static int32_t bigint_hash(void *p, size_t size) {
+    (void) size;
+    BigInt *b = (BigInt *) p;
+    uint32_t h = 2166136261u ^ (uint32_t) b->sign;
+    for (int32_t i = 0; i < b->len; i++) {
+        h = (h ^ b->limbs[i]) * 16777619u;
+    }
+    return (int32_t) h;
+}
+
+static void push_digits(JanetBuffer *buffer, uint32_t x, int width) {
+    uint8_t digits[10];
+    int n = 0;
+    do {
+        digits[n++] = (uint8_t)('0' + x % 10);
+        x /= 10;
+    } while (x || n < width);
+    while (n) janet_buffer_push_u8(buffer, digits[--n]);
+}
+
+static void bigint_tostring(void *p, JanetBuffer *buffer) {
+    BigInt *b = (BigInt *) p;
+    if (!b->len) {
+        janet_buffer_push_u8(buffer, '0');
+        return;
+    }
+    /* Peel off 9 decimal digits at a time, least significant first. */
+    int32_t n = b->len;
+    uint32_t *t = janet_smalloc(sizeof(uint32_t) * (size_t)(3 * n + 1));
+    uint32_t *chunks = t + n;
+    int32_t count = 0;
+    memcpy(t, b->limbs, sizeof(uint32_t) * (size_t) n);
+    while (n > 0) {
+        uint64_t rem = 0;
+        for (int32_t i = n - 1; i >= 0; i--) {
+            uint64_t cur = (rem << 32) | t[i];
+            t[i] = (uint32_t)(cur / 1000000000u);
+            rem = cur % 1000000000u;
+        }
+        chunks[count++] = (uint32_t) rem;
+        n = mag_norm(t, n);
+    }
+    if (b->sign < 0) janet_buffer_push_u8(buffer, '-');
+    push_digits(buffer, chunks[count - 1], 0);
+    for (int32_t i = count - 2; i >= 0; i--) push_digits(buffer, chunks[i], 9);
+    janet_sfree(t);
+}
+
+static void bigint_marshal(void *p, JanetMarshalContext *ctx) {
+    BigInt *b = (BigInt *) p;
+    janet_marshal_abstract(ctx, p);
+    janet_marshal_int(ctx, b->sign);
+    janet_marshal_int(ctx, b->len);
+    for (int32_t i = 0; i < b->len; i++) {
+        janet_marshal_int(ctx, (int32_t) b->limbs[i]);
+    }
+}
+
+static void *bigint_unmarshal(JanetMarshalContext *ctx) {
+    int32_t sign = janet_unmarshal_int(ctx);
+    int32_t len = janet_unmarshal_int(ctx);
+    if (len < 0 || sign < -1 || sign > 1 || (len == 0) != (sign == 0)) {
+        janet_panic("invalid bigint");
+    }
+    BigInt *b = janet_unmarshal_abstract(ctx, sizeof(BigInt) + sizeof(uint32_t) * (size_t) len);
+    b->sign = sign;
+    b->len = len;
+    for (int32_t i = 0; i < len; i++) {
+        b->limbs[i] = (uint32_t) janet_unmarshal_int(ctx);
+    }
+    if (len && b->limbs[len - 1] == 0) janet_panic("invalid bigint");
+    return b;
+}
+
+static Janet bigint_parse(Janet str) {
+    JanetByteView bytes = janet_getbytes(&str, 0);
+    const uint8_t *s = bytes.bytes;
+    int32_t n = bytes.len;
+    int32_t i = 0;
+    int32_t sign = 1;
+    uint32_t base = 10;
+    if (i < n && (s[i] == '-' || s[i] == '+')) {
+        if (s[i] == '-') sign = -1;
+        i++;
+    }
+    if (n - i > 2 && s[i] == '0' && (s[i + 1] == 'x' || s[i + 1] == 'X')) {
+        base = 16;
+        i += 2;
+    }
+    /* Every limb holds at least 8 digits in either base. */
+    uint32_t *mag = janet_smalloc(sizeof(uint32_t) * (size_t)((n - i) / 8 + 2));
+    int32_t len = 0;
+    int32_t digits = 0;
+    for (; i < n; i++) {
+        uint32_t c = s[i];
+        uint32_t d;
+        if (c == '_') continue;
+        if (c >= '0' && c <= '9') {
+            d = c - '0';
+        } else if (base == 16 && (c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            d = (c | 0x20) - 'a' + 10;
+        } else {
+            janet_sfree(mag);
+            janet_panicf("invalid bigint literal %v", str);
+        }
+        uint64_t carry = d;
+        for (int32_t k = 0; k < len; k++) {
+            carry += (uint64_t) mag[k] * base;
+            mag[k] = (uint32_t) carry;
+            carry >>= 32;
+        }
+        if (carry) mag[len++] = (uint32_t) carry;
+        digits++;
+    }
+    if (!digits) {
+        janet_sfree(mag);
+        janet_panicf("invalid bigint literal %v", str);
+    }
+    Janet out = bigint_make(sign, mag, len);
+    janet_sfree(mag);
+    return out;
+}
+
+JANET_FN(cfun_cmath_bigint,
+        "(math/bigint x)",
+        "Create an arbitrary precision integer from `x`, which can be an integer, an "
+        "int/s64 or int/u64, or a string of decimal digits, or hexadecimal digits after "
+        "`0x`, with an optional sign. Bigints work with `+`, `-`, `*`, `/`, `div`, `%`, `mod` "
+        "and `compare`, where `/` rounds toward zero like it does for int/s64. "
+        "`math/powmod`, `math/mulmod`, `math/invmod`, `math/jacobi`, `math/gcd`, "
+        "`math/modulus` and `math/pollard-rho` accept them too.") {
+    janet_fixarity(argc, 1);
+    if (janet_checktypes(argv[0], JANET_TFLAG_BYTES)) return bigint_parse(argv[0]);
+    BigView v;
+    bigview_get(argv, 0, &v);
+    if (is_bigint(argv[0])) return argv[0];
+    return bigint_make(v.sign, v.limbs, v.len);
+}
+
+JANET_FN(cfun_cmath_bigintp,
+        "(math/bigint? x)",
+        "Check if `x` is a bigint.") {
+    janet_fixarity(argc, 1);
+    return janet_wrap_boolean(is_bigint(argv[0]));
+}
+
+/* Number theory in arbitrary precision. Residues are magnitudes of mn limbs
+ * in [0, m). */
+
+/* r = a mod m, for m > 0 with mn limbs. */
+static void big_residue(uint32_t *r, const BigView *a, const uint32_t *m, int32_t mn) {
+    mag_divmod(NULL, r, a->limbs, a->len, m, mn);
+    if (a->sign < 0 && mag_norm(r, mn)) mag_sub(r, m, mn, r, mn);
+}
+
+/* r = a * b mod m for residues a and b. t has room for 2 * mn limbs. */
+static void big_mulmod(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                       const uint32_t *m, int32_t mn, uint32_t *t) {
+    mag_mul(t, a, mn, b, mn);
+    mag_divmod(NULL, r, t, 2 * mn, m, mn);
+}
+
+/* r = a^e mod m for a residue a and e >= 0. */
+static void big_powmod(uint32_t *r, const uint32_t *a, const uint32_t *e, int32_t en,
+                       const uint32_t *m, int32_t mn) {
+    uint32_t *t = janet_smalloc(sizeof(uint32_t) * (size_t)(2 * mn));
+    memset(r, 0, sizeof(uint32_t) * (size_t) mn);
+    r[0] = (mn > 1 || m[0] > 1) ? 1 : 0;
+    int started = 0;
+    for (int32_t i = en - 1; i >= 0; i--) {
+        for (int bit = 31; bit >= 0; bit--) {
+            if (started) big_mulmod(r, r, r, m, mn, t);
+            if ((e[i] >> bit) & 1) {
+                big_mulmod(r, r, a, m, mn, t);
+                started = 1;
+            }
+        }
+    }
+    janet_sfree(t);
+}
+
+/* g = gcd(a, b), with room in g for max(an, bn) limbs. Returns the length. */
+static int32_t mag_gcd(uint32_t *g, const uint32_t *a, int32_t an, const uint32_t *b, int32_t bn) {
+    an = mag_norm(a, an);
+    bn = mag_norm(b, bn);
+    int32_t n = (an > bn ? an : bn) + 1;
+    uint32_t *x = janet_smalloc(sizeof(uint32_t) * (size_t)(3 * n));
+    uint32_t *y = x + n;
+    uint32_t *r = y + n;
+    if (an) memcpy(x, a, sizeof(uint32_t) * (size_t) an);
+    if (bn) memcpy(y, b, sizeof(uint32_t) * (size_t) bn);
+    int32_t xn = an, yn = bn;
+    while (yn) {
+        mag_divmod(NULL, r, x, xn, y, yn);
+        uint32_t *t = x;
+        x = y;
+        xn = yn;
+        y = r;
+        yn = mag_norm(r, yn);
+        r = t;
+    }
+    if (xn) memcpy(g, x, sizeof(uint32_t) * (size_t) xn);
+    uint32_t *base = x < y ? (x < r ? x : r) : (y < r ? y : r);
+    janet_sfree(base);
+    return xn;
+}
+
+/* r = 1/a mod m for a residue a, by the extended Euclidean algorithm with
+ * the coefficients kept as residues. Returns 0 if there is no inverse. */
+static int big_invmod(uint32_t *r, const uint32_t *a, const uint32_t *m, int32_t mn) {
+    uint32_t *buf = janet_smalloc(sizeof(uint32_t) * (size_t)(10 * mn + 2));
+    uint32_t *r0 = buf, *r1 = r0 + mn, *rem = r1 + mn;
+    uint32_t *t0 = rem + mn, *t1 = t0 + mn, *tn = t1 + mn;
+    uint32_t *q = tn + mn, *prod = q + mn + 1;
+    memcpy(r0, m, sizeof(uint32_t) * (size_t) mn);
+    memcpy(r1, a, sizeof(uint32_t) * (size_t) mn);
+    memset(t0, 0, sizeof(uint32_t) * (size_t)(2 * mn));
+    t1[0] = 1;
+    int32_t n0 = mn, n1 = mag_norm(r1, mn);
+    while (n1) {
+        memset(q, 0, sizeof(uint32_t) * (size_t)(mn + 1));
+        mag_divmod(q, rem, r0, n0, r1, n1);
+        /* tn = t0 - q * t1 mod m */
+        mag_mul(prod, q, mn, t1, mn);
+        mag_divmod(NULL, tn, prod, 2 * mn, m, mn);
+        if (mag_cmp(t0, mn, tn, mn) >= 0) {
+            mag_sub(tn, t0, mn, tn, mn);
+        } else {
+            mag_sub(tn, tn, mn, t0, mn);
+            mag_sub(tn, m, mn, tn, mn);
+        }
+        uint32_t *t = r0;
+        r0 = r1;
+        n0 = n1;
+        r1 = rem;
+        n1 = mag_norm(rem, n1);
+        rem = t;
+        t = t0;
+        t0 = t1;
+        t1 = tn;
+        tn = t;
+    }
+    int ok = (n0 == 1 && r0[0] == 1);
+    if (ok) memcpy(r, t0, sizeof(uint32_t) * (size_t) mn);
+    janet_sfree(buf);
+    return ok;
+}
+
+/* Shift a right by any number of bits in place. Returns the new length. */
+static int32_t mag_shr(uint32_t *a, int32_t an, int32_t bits) {
+    int32_t limbs = bits / 32;
+    int b = bits % 32;
+    if (limbs >= an) return 0;
+    if (limbs) {
+        memmove(a, a + limbs, sizeof(uint32_t) * (size_t)(an - limbs));
+        memset(a + an - limbs, 0, sizeof(uint32_t) * (size_t) limbs);
+        an -= limbs;
+    }
+    if (b) {
+        for (int32_t i = 0; i < an - 1; i++) a[i] = (a[i] >> b) | (a[i + 1] << (32 - b));
+        a[an - 1] >>= b;
+    }
+    return mag_norm(a, an);
+}
+
+/* Jacobi symbol (a|n) for odd n > 0. */
+static int big_jacobi(const BigView *a, const uint32_t *n, int32_t nn) {
+    uint32_t *buf = janet_smalloc(sizeof(uint32_t) * (size_t)(3 * nn));
+    uint32_t *x = buf, *y = x + nn, *r = y + nn;
+    big_residue(x, a, n, nn);
+    memcpy(y, n, sizeof(uint32_t) * (size_t) nn);
+    int32_t xn = mag_norm(x, nn), yn = nn;
+    int res = 1;
+    while (xn) {
+        /* (2|y) is -1 when y is 3 or 5 mod 8. */
+        int32_t tz = 0;
+        while (x[tz / 32] == 0) tz += 32;
+        for (uint32_t low = x[tz / 32]; !(low & 1); low >>= 1) tz++;
+        xn = mag_shr(x, xn, tz);
+        if ((tz & 1) && ((y[0] & 7) == 3 || (y[0] & 7) == 5)) res = -res;
+        /* Quadratic reciprocity, then reduce. */
+        if ((x[0] & 3) == 3 && (y[0] & 3) == 3) res = -res;
+        mag_divmod(NULL, r, y, yn, x, xn);
+        uint32_t *t = y;
+        y = x;
+        yn = xn;
+        x = r;
+        xn = mag_norm(r, yn);
+        r = t;
+    }
+    int out = (yn == 1 && y[0] == 1) ? res : 0;
+    janet_sfree(buf);
+    return out;
+}
+
+/* Strong probable prime test of odd n > 3 against each base. */
+static int big_sprp(const uint32_t *n, int32_t nn, const uint32_t *bases, int count) {
+    uint32_t *buf = janet_smalloc(sizeof(uint32_t) * (size_t)(6 * nn));
+    uint32_t *d = buf, *nm1 = d + nn, *a = nm1 + nn, *x = a + nn, *t = x + nn;
+    memcpy(nm1, n, sizeof(uint32_t) * (size_t) nn);
+    nm1[0] -= 1;
+    memcpy(d, nm1, sizeof(uint32_t) * (size_t) nn);
+    int32_t s = 0;
+    while (d[s / 32] == 0) s += 32;
+    for (uint32_t low = d[s / 32]; !(low & 1); low >>= 1) s++;
+    int32_t dn = mag_shr(d, nn, s);
+    int prime = 1;
+    for (int i = 0; i < count && prime; i++) {
+        memset(a, 0, sizeof(uint32_t) * (size_t) nn);
+        a[0] = bases[i];
+        big_powmod(x, a, d, dn, n, nn);
+        if ((mag_norm(x, nn) == 1 && x[0] == 1) || !mag_cmp(x, nn, nm1, nn)) continue;
+        int32_t r;
+        for (r = 1; r < s; r++) {
+            big_mulmod(x, x, x, n, nn, t);
+            if (!mag_cmp(x, nn, nm1, nn)) break;
+        }
+        if (r >= s) prime = 0;
+    }
+    janet_sfree(buf);
+    return prime;
+}
+
+static uint64_t gcd_u64(uint64_t a, uint64_t b) {
+    while (b) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static void bigview_from(Janet x, BigView *v) {
+    if (!bigview_check(x, v)) janet_panicf("expected integer, got %v", x);
+}
+
+/* Return a residue r of |m| in the type of m, negated into (m, 0] like
+ * math/mod does when m is negative. */
+static Janet big_result(const uint32_t *r, int32_t rn, const BigView *m, Janet like) {
+    rn = mag_norm(r, rn);
+    int32_t sign = 1;
+    uint32_t *adj = NULL;
+    if (m->sign < 0 && rn) {
+        adj = janet_smalloc(sizeof(uint32_t) * (size_t) m->len);
+        rn = mag_sub(adj, m->limbs, m->len, r, rn);
+        r = adj;
+        sign = -1;
+    }
+    Janet out;
+    if (is_bigint(like)) {
+        out = bigint_make(sign, r, rn);
+    } else {
+        /* m fits in 64 bits, and so does the result. */
+        uint64_t x = rn ? r[0] : 0;
+        if (rn > 1) x |= (uint64_t) r[1] << 32;
+        out = wrap_result(sign < 0 ? (int64_t)(0 - x) : (int64_t) x, like);
+    }
+    if (adj) janet_sfree(adj);
+    return out;
+}
+
+static Janet bigint_mulmod_janet(Janet ja, Janet jb, Janet jm) {
+    BigView a, b, m;
+    int64_t ia, ib, im;
+    bigview_from(ja, &a);
+    bigview_from(jb, &b);
+    bigview_from(jm, &m);
+    if (bigview_to_int64(&a, &ia) && bigview_to_int64(&b, &ib) && bigview_to_int64(&m, &im)) {
+        return wrap_result(_mulmod_impl(ia, ib, im), jm);
+    }
+    if (!m.len) return bigint_mul(&a, &b);
+    int32_t mn = m.len;
+    uint32_t *buf = janet_smalloc(sizeof(uint32_t) * (size_t)(5 * mn));
+    uint32_t *ra = buf, *rb = ra + mn, *r = rb + mn, *t = r + mn;
+    big_residue(ra, &a, m.limbs, mn);
+    big_residue(rb, &b, m.limbs, mn);
+    big_mulmod(r, ra, rb, m.limbs, mn, t);
+    Janet out = big_result(r, mn, &m, jm);
+    janet_sfree(buf);
+    return out;
+}
+
+static Janet bigint_powmod_janet(Janet ja, Janet je, Janet jm) {
+    BigView a, e, m;
+    int64_t ia, ie, im;
+    bigview_from(ja, &a);
+    bigview_from(je, &e);
+    bigview_from(jm, &m);
+    if (bigview_to_int64(&a, &ia) && bigview_to_int64(&e, &ie) && bigview_to_int64(&m, &im)) {
+        if (ie < 0) {
+            ia = _invmod_impl(ia, im);
+            if (ia == 0)
+                return wrap_nan();
+            ie = -ie;
+        }
+        return wrap_result(_powmod_impl(ia, ie, im), jm);
+    }
+    if (!m.len) janet_panic("expected nonzero modulus");
+    int32_t mn = m.len;
+    uint32_t *buf = janet_smalloc(sizeof(uint32_t) * (size_t)(2 * mn));
+    uint32_t *ra = buf, *r = ra + mn;
+    big_residue(ra, &a, m.limbs, mn);
+    if (e.sign < 0 && !big_invmod(ra, ra, m.limbs, mn)) {
+        janet_sfree(buf);
+        return wrap_nan();
+    }
+    big_powmod(r, ra, e.limbs, e.len, m.limbs, mn);
+    Janet out = big_result(r, mn, &m, jm);
+    janet_sfree(buf);
+    return out;
+}
+
+static Janet bigint_invmod_janet(Janet ja, Janet jm) {
+    BigView a, m;
+    int64_t ia, im;
+    bigview_from(ja, &a);
+    bigview_from(jm, &m);
+    if (bigview_to_int64(&a, &ia) && bigview_to_int64(&m, &im)) {
+        int64_t res = _invmod_impl(ia, im);
+        if (res == 0)
+            return wrap_nan();
+        return wrap_result(res, jm);
+    }
+    if (!m.len) janet_panic("expected nonzero modulus");
+    int32_t mn = m.len;
+    uint32_t *buf = janet_smalloc(sizeof(uint32_t) * (size_t)(2 * mn));
+    uint32_t *ra = buf, *r = ra + mn;
+    big_residue(ra, &a, m.limbs, mn);
+    Janet out = big_invmod(r, ra, m.limbs, mn) ? big_result(r, mn, &m, jm) : wrap_nan();
+    janet_sfree(buf);
+    return out;
+}
+
+static Janet bigint_jacobi_janet(Janet ja, Janet jn) {
+    BigView a, n;
+    int64_t ia, in;
+    bigview_from(ja, &a);
+    bigview_from(jn, &n);
+    if (bigview_to_int64(&a, &ia) && bigview_to_int64(&n, &in)) {
+        return janet_wrap_number(_jacobi_impl(ia, in));
+    }
+    if (n.sign <= 0 || !(n.limbs[0] & 1)) {
+        janet_panicf("expected odd positive modulus, got %v", jn);
+    }
+    return janet_wrap_number(big_jacobi(&a, n.limbs, n.len));
+}
+
+JANET_FN(cfun_cmath_gcd,
+        "(math/gcd a b)",
+        "Greatest common divisor of the integers `a` and `b`, which is never negative. "
+        "The result is a bigint if either argument is one, and otherwise has the type of `b`.") {
+    janet_fixarity(argc, 2);
+    BigView a, b;
+    int64_t ia, ib;
+    bigview_get(argv, 0, &a);
+    bigview_get(argv, 1, &b);
+    if (!bigint_any(argv, 2) && bigview_to_int64(&a, &ia) && bigview_to_int64(&b, &ib)) {
+        uint64_t ua = ia < 0 ? (uint64_t) 0 - (uint64_t) ia : (uint64_t) ia;
+        uint64_t ub = ib < 0 ? (uint64_t) 0 - (uint64_t) ib : (uint64_t) ib;
+        uint64_t g = gcd_u64(ua, ub);
+        /* gcd(INT64_MIN, 0) is 2^63, which only a bigint can hold */
+        if (g <= INT64_MAX) return wrap_result((int64_t) g, argv[1]);
+    }
+    int32_t n = a.len > b.len ? a.len : b.len;
+    uint32_t *g = janet_smalloc(sizeof(uint32_t) * (size_t)(n ? n : 1));
+    int32_t len = mag_gcd(g, a.limbs, a.len, b.limbs, b.len);
+    Janet out = bigint_make(1, g, len);
+    janet_sfree(g);
+    return out;
+}
+
 JANET_FN(cfun_cmath_jacobi,
         "(math/jacobi a m)",
-        "Computes the Jacobi Symbol (a|m).") {
+        "Computes the Jacobi Symbol (a|m). Either argument may be a bigint, in which "
+        "case `m` must be odd and positive.") {
     janet_fixarity(argc, 2);
+    if (bigint_any(argv, argc)) return bigint_jacobi_janet(argv[0], argv[1]);
     int64_t a = janet_getinteger64(argv, 0);
     int64_t m = janet_getinteger64(argv, 1);
 
@@ -146,9 +1288,11 @@ JANET_FN(cfun_cmath_jacobi,
 JANET_FN(cfun_cmath_invmod,
         "(math/invmod a m)",
         "Modular multiplicative inverse of `a` mod `m`. "
-        "Both arguments must be integer. The return value has the same type as `m`. "
+        "Both arguments must be integer, and either may be a bigint. "
+        "The return value has the same type as `m`. "
         "If no inverse exists, returns `math/nan` instead.") {
     janet_fixarity(argc, 2);
+    if (bigint_any(argv, argc)) return bigint_invmod_janet(argv[0], argv[1]);
     int64_t a = janet_getinteger64(argv, 0);
     int64_t m = janet_getinteger64(argv, 1);
 
@@ -162,8 +1306,10 @@ JANET_FN(cfun_cmath_invmod,
 JANET_FN(cfun_cmath_mulmod,
         "(math/mulmod a b m)",
         "Modular multiplication of `a` and `b` mod `m`. "
-        "All arguments must be integer. The return value has the same type as `m`.") {
+        "All arguments must be integer, and any of them may be a bigint. "
+        "The return value has the same type as `m`.") {
     janet_fixarity(argc, 3);
+    if (bigint_any(argv, argc)) return bigint_mulmod_janet(argv[0], argv[1], argv[2]);
     int64_t a = janet_getinteger64(argv, 0);
     int64_t b = janet_getinteger64(argv, 1);
     int64_t m = janet_getinteger64(argv, 2);
@@ -174,36 +1320,3331 @@ JANET_FN(cfun_cmath_mulmod,
 JANET_FN(cfun_cmath_powmod,
         "(math/powmod a b m)",
         "Modular exponentiation of `a` to the power of `b` mod `m`. "
-        "All arguments must be integer. The return value has the same type as `m`.") {
+        "All arguments must be integer, and any of them may be a bigint. "
+        "The return value has the same type as `m`.") {
     janet_fixarity(argc, 3);
+    if (bigint_any(argv, argc)) return bigint_powmod_janet(argv[0], argv[1], argv[2]);
     int64_t a = janet_getinteger64(argv, 0);
     int64_t b = janet_getinteger64(argv, 1);
     int64_t m = janet_getinteger64(argv, 2);
 
-    int64_t res = 1;
     if (b < 0) {
         a = _invmod_impl(a, m);
         if (a == 0)
             return wrap_nan();
         b = -b;
     }
-    while (b > 0) {
-        if ((b & 1) == 1)
-            res = _mulmod_impl(res, a, m);
-        a = _mulmod_impl(a, a, m);
-        b >>= 1;
+
+    return wrap_result(_powmod_impl(a, b, m), argv[2]);
+}
+
+/* Modular contexts */
+
+/* A fixed modulus, kept with its Montgomery constants so they are computed
+ * once rather than on every call. Even moduli fall back to division, and
+ * moduli that do not fit in an int64 to bigint arithmetic. */
+typedef struct {
+    MontCtx mont;
+    int64_t m;
+    int big;
+    Janet modulus;
+} Modulus;
+
+static int modulus_gcmark(void *p, size_t size) {
+    (void) size;
+    janet_mark(((Modulus *) p)->modulus);
+    return 0;
+}
+
+static int modulus_get(void *p, Janet key, Janet *out);
+
+static void modulus_tostring(void *p, JanetBuffer *buffer) {
+    janet_formatb(buffer, "%v", ((Modulus *) p)->modulus);
+}
+
+static const JanetAbstractType modulus_type = {
+    .name = "math/modulus",
+    .gcmark = modulus_gcmark,
+    .get = modulus_get,
+    .tostring = modulus_tostring
+};
+
+static int modulus_mont(const Modulus *mod) {
+    return !mod->big && (mod->m & 1);
+}
+
+JANET_FN(cfun_cmath_modulus,
+        "(math/modulus m)",
+        "Create a context for arithmetic mod the positive integer `m`. Repeated "
+        "`math/modulus-mulmod` and `math/modulus-powmod` calls with the same context "
+        "skip the division in each step for odd `m` by working in Montgomery form. "
+        "Results have the same type as `m`.") {
+    janet_fixarity(argc, 1);
+    BigView v;
+    int64_t m = 0;
+    bigview_get(argv, 0, &v);
+    if (v.sign <= 0) janet_panicf("expected positive modulus, got %v", argv[0]);
+    Modulus *mod = janet_abstract(&modulus_type, sizeof(Modulus));
+    mod->big = !bigview_to_int64(&v, &m);
+    mod->m = m;
+    mod->modulus = argv[0];
+    if (modulus_mont(mod)) mont_init(&mod->mont, (uint64_t) m);
+    return janet_wrap_abstract(mod);
+}
+
+JANET_FN(cfun_cmath_modulus_mulmod,
+        "(math/modulus-mulmod mod a b)",
+        "Modular multiplication of `a` and `b` with the modulus of the context `mod`. "
+        "Same as `(math/mulmod a b m)`.") {
+    janet_fixarity(argc, 3);
+    Modulus *mod = janet_getabstract(argv, 0, &modulus_type);
+    if (mod->big || bigint_any(argv + 1, 2)) {
+        return bigint_mulmod_janet(argv[1], argv[2], mod->modulus);
+    }
+    int64_t a = _mod_impl(janet_getinteger64(argv, 1), mod->m);
+    int64_t b = _mod_impl(janet_getinteger64(argv, 2), mod->m);
+    int64_t res = modulus_mont(mod)
+                  ? (int64_t) mont_mulmod(&mod->mont, (uint64_t) a, (uint64_t) b)
+                  : _mulmod_impl(a, b, mod->m);
+    return wrap_result(res, mod->modulus);
+}
+
+JANET_FN(cfun_cmath_modulus_powmod,
+        "(math/modulus-powmod mod a b)",
+        "Modular exponentiation of `a` to the power of `b` with the modulus of the context "
+        "`mod`. Same as `(math/powmod a b m)`.") {
+    janet_fixarity(argc, 3);
+    Modulus *mod = janet_getabstract(argv, 0, &modulus_type);
+    if (mod->big || bigint_any(argv + 1, 2)) {
+        return bigint_powmod_janet(argv[1], argv[2], mod->modulus);
     }
+    int64_t a = janet_getinteger64(argv, 1);
+    int64_t b = janet_getinteger64(argv, 2);
+    if (b < 0) {
+        a = _invmod_impl(a, mod->m);
+        if (a == 0)
+            return wrap_nan();
+        b = -b;
+    }
+    int64_t res = (modulus_mont(mod) && mod->m > 1)
+                  ? (int64_t) mont_powmod(&mod->mont, (uint64_t) _mod_impl(a, mod->m), (uint64_t) b)
+                  : _powmod_impl(a, b, mod->m);
+    return wrap_result(res, mod->modulus);
+}
+
+static const JanetMethod modulus_methods[] = {
+    {"mulmod", cfun_cmath_modulus_mulmod},
+    {"powmod", cfun_cmath_modulus_powmod},
+    {NULL, NULL}
+};
+
+static int modulus_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD)) return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), modulus_methods, out);
+}
+
+/* Batched modular arithmetic */
+
+/* A modulus shared by a whole batch. */
+typedef struct {
+    MontCtx mont;
+    int64_t m;
+    uint64_t abs;
+    int use_mont;
+} BatchModulus;
+
+/* An operand that is either a typed array or one integer for every element. */
+typedef struct {
+    JanetTArrayView *view;
+    int64_t value;
+} BatchOperand;
+
+static JanetTArrayView *batch_getview(const Janet *argv, int32_t n) {
+    JanetTArrayView *view = janet_checktarray_view(argv[n]);
+    if (view == NULL ||
+            (view->type != JANET_TARRAY_TYPE_S64 && view->type != JANET_TARRAY_TYPE_U64)) {
+        janet_panicf("bad slot #%d, expected int64 or uint64 typed array, got %v", n, argv[n]);
+    }
+    return view;
+}
+
+static void batch_getoperand(const Janet *argv, int32_t n, size_t size, BatchOperand *op) {
+    op->view = NULL;
+    op->value = 0;
+    if (janet_checktarray_view(argv[n]) == NULL) {
+        op->value = janet_getinteger64(argv, n);
+        return;
+    }
+    op->view = batch_getview(argv, n);
+    if (op->view->size != size) {
+        janet_panicf("bad slot #%d, expected %d elements", n, (int32_t) size);
+    }
+}
+
+/* Accepts an integer or a math/modulus context. */
+static void batch_getmodulus(const Janet *argv, int32_t n, BatchModulus *bm) {
+    Modulus *mod = janet_checkabstract(argv[n], &modulus_type);
+    if (mod != NULL) {
+        if (mod->big) janet_panicf("bad slot #%d, expected modulus to fit in an int64", n);
+        bm->m = mod->m;
+        if (mod->m > 1 && modulus_mont(mod)) bm->mont = mod->mont;
+    } else {
+        bm->m = janet_getinteger64(argv, n);
+        if (bm->m > 1 && (bm->m & 1)) mont_init(&bm->mont, (uint64_t) bm->m);
+    }
+    bm->use_mont = bm->m > 1 && (bm->m & 1);
+    bm->abs = bm->m < 0 ? (uint64_t) 0 - (uint64_t) bm->m : (uint64_t) bm->m;
+}
+
+static JanetTArrayView *batch_getinto(const Janet *argv, int32_t argc, int32_t n, size_t size,
+                                      JanetTArrayType type, JanetTArrayType alt) {
+    if (argc <= n || janet_checktype(argv[n], JANET_NIL)) {
+        return janet_tarray_view_new(type, size);
+    }
+    JanetTArrayView *out = janet_checktarray_view(argv[n]);
+    if (out == NULL || (out->type != type && out->type != alt)) {
+        janet_panicf("bad slot #%d, expected typed array, got %v", n, argv[n]);
+    }
+    if (out->size < size) {
+        janet_panicf("bad slot #%d, expected at least %d elements", n, (int32_t) size);
+    }
+    return out;
+}
+
+/* The residue of x in [0, |m|), or x itself for m = 0. */
+static int64_t batch_reduce(int64_t x, uint64_t abs) {
+    if (!abs) return x;
+    if (x >= 0) return (int64_t)((uint64_t) x % abs);
+    return (int64_t)(abs - 1 - (uint64_t)(-(x + 1)) % abs);
+}
+
+static int64_t batch_residue(const JanetTArrayView *view, size_t i, uint64_t abs) {
+    size_t k = i * view->stride;
+    if (view->type == JANET_TARRAY_TYPE_S64) return batch_reduce(view->as.s64[k], abs);
+    return (int64_t)(abs ? view->as.u64[k] % abs : view->as.u64[k]);
+}
+
+static void batch_put(JanetTArrayView *out, size_t i, int64_t x) {
+    out->as.u64[i * out->stride] = (uint64_t) x;
+}
+
+/* Invert every element with one modular inverse and three multiplications
+ * per element (Montgomery's trick). prefix has room for the whole batch.
+ * Returns 0 if some element has no inverse. */
+static int batch_invert(const BatchModulus *bm, const JanetTArrayView *xs, JanetTArrayView *out,
+                        uint64_t *prefix) {
+    const MontCtx *ctx = &bm->mont;
+    uint64_t acc = ctx->one;
+    for (size_t i = 0; i < xs->size; i++) {
+        prefix[i] = acc;
+        acc = mont_mul(ctx, acc, mont_to(ctx, (uint64_t) batch_residue(xs, i, bm->abs)));
+    }
+    int64_t inv = _invmod_impl((int64_t) mont_from(ctx, acc), bm->m);
+    if (inv == 0) return 0;
+    /* acc is the inverse of the product of the first i + 1 elements. */
+    acc = mont_to(ctx, (uint64_t) inv);
+    for (size_t i = xs->size; i-- > 0;) {
+        uint64_t x = mont_to(ctx, (uint64_t) batch_residue(xs, i, bm->abs));
+        batch_put(out, i, (int64_t) mont_from(ctx, mont_mul(ctx, acc, prefix[i])));
+        acc = mont_mul(ctx, acc, x);
+    }
+    return 1;
+}
+
+JANET_FN(cfun_cmath_mulmod_batch,
+        "(math/mulmod-batch xs ys m &opt into)",
+        "Modular multiplication of each element of the int64 or uint64 typed array `xs` by "
+        "the matching element of `ys` mod `m`, as with `math/mulmod`. `ys` can also be a "
+        "single integer, and `m` an integer or a `math/modulus` context. Returns an int64 "
+        "typed array, or writes the results to the int64 or uint64 typed array `into`.") {
+    janet_arity(argc, 3, 4);
+    JanetTArrayView *xs = batch_getview(argv, 0);
+    BatchOperand ys;
+    BatchModulus bm;
+    batch_getoperand(argv, 1, xs->size, &ys);
+    batch_getmodulus(argv, 2, &bm);
+    JanetTArrayView *out = batch_getinto(argv, argc, 3, xs->size,
+                                         JANET_TARRAY_TYPE_S64, JANET_TARRAY_TYPE_U64);
+    size_t n = xs->size;
+    if (bm.use_mont && ys.view == NULL) {
+        /* With y in Montgomery form, one reduction gives x * y directly. */
+        uint64_t y = mont_to(&bm.mont, (uint64_t) batch_reduce(ys.value, bm.abs));
+        for (size_t i = 0; i < n; i++) {
+            uint64_t x = (uint64_t) batch_residue(xs, i, bm.abs);
+            batch_put(out, i, (int64_t) mont_mul(&bm.mont, x, y));
+        }
+    } else if (bm.use_mont) {
+        for (size_t i = 0; i < n; i++) {
+            uint64_t x = (uint64_t) batch_residue(xs, i, bm.abs);
+            uint64_t y = (uint64_t) batch_residue(ys.view, i, bm.abs);
+            batch_put(out, i, (int64_t) mont_mulmod(&bm.mont, x, y));
+        }
+    } else {
+        int64_t y = batch_reduce(ys.value, bm.abs);
+        for (size_t i = 0; i < n; i++) {
+            if (ys.view != NULL) y = batch_residue(ys.view, i, bm.abs);
+            batch_put(out, i, _mulmod_impl(batch_residue(xs, i, bm.abs), y, bm.m));
+        }
+    }
+    return janet_wrap_abstract(out);
+}
+
+JANET_FN(cfun_cmath_powmod_batch,
+        "(math/powmod-batch xs es m &opt into)",
+        "Modular exponentiation of each element of the int64 or uint64 typed array `xs` to "
+        "the power of the matching element of `es` mod `m`, as with `math/powmod`. `es` can "
+        "also be a single integer, and `m` an integer or a `math/modulus` context. Elements "
+        "with a negative exponent and no inverse give 0. Returns an int64 typed array, or "
+        "writes the results to the int64 or uint64 typed array `into`.") {
+    janet_arity(argc, 3, 4);
+    JanetTArrayView *xs = batch_getview(argv, 0);
+    BatchOperand es;
+    BatchModulus bm;
+    batch_getoperand(argv, 1, xs->size, &es);
+    batch_getmodulus(argv, 2, &bm);
+    JanetTArrayView *out = batch_getinto(argv, argc, 3, xs->size,
+                                         JANET_TARRAY_TYPE_S64, JANET_TARRAY_TYPE_U64);
+    for (size_t i = 0; i < xs->size; i++) {
+        int64_t x = batch_residue(xs, i, bm.abs);
+        uint64_t e = (uint64_t) es.value;
+        int negative = es.value < 0;
+        if (es.view != NULL) {
+            size_t k = i * es.view->stride;
+            e = es.view->as.u64[k];
+            negative = es.view->type == JANET_TARRAY_TYPE_S64 && es.view->as.s64[k] < 0;
+        }
+        if (negative) {
+            x = bm.m ? _invmod_impl(x, bm.m) : 0;
+            e = (uint64_t) 0 - e;
+            if (x == 0) {
+                batch_put(out, i, 0);
+                continue;
+            }
+            x = batch_reduce(x, bm.abs);
+        }
+        batch_put(out, i, bm.use_mont
+                  ? (int64_t) mont_powmod(&bm.mont, (uint64_t) x, e)
+                  : _powmod_impl(x, e, bm.m));
+    }
+    return janet_wrap_abstract(out);
+}
+
+JANET_FN(cfun_cmath_invmod_batch,
+        "(math/invmod-batch xs m &opt into)",
+        "Modular multiplicative inverse of each element of the int64 or uint64 typed array "
+        "`xs` mod `m`, as with `math/invmod`, with 0 for elements that have no inverse. `m` "
+        "can be an integer or a `math/modulus` context. For odd `m`, the whole batch shares "
+        "a single inverse. Returns an int64 typed array, or writes the results to the int64 "
+        "or uint64 typed array `into`.") {
+    janet_arity(argc, 2, 3);
+    JanetTArrayView *xs = batch_getview(argv, 0);
+    BatchModulus bm;
+    batch_getmodulus(argv, 1, &bm);
+    if (bm.m == 0) janet_panic("expected nonzero modulus");
+    JanetTArrayView *out = batch_getinto(argv, argc, 2, xs->size,
+                                         JANET_TARRAY_TYPE_S64, JANET_TARRAY_TYPE_U64);
+    if (bm.use_mont && xs->size > 1) {
+        uint64_t *prefix = janet_smalloc(sizeof(uint64_t) * xs->size);
+        int ok = batch_invert(&bm, xs, out, prefix);
+        janet_sfree(prefix);
+        if (ok) return janet_wrap_abstract(out);
+    }
+    /* Some element is not invertible, so find out which one by one. */
+    for (size_t i = 0; i < xs->size; i++) {
+        batch_put(out, i, _invmod_impl(batch_residue(xs, i, bm.abs), bm.m));
+    }
+    return janet_wrap_abstract(out);
+}
+
+JANET_FN(cfun_cmath_jacobi_batch,
+        "(math/jacobi-batch xs m &opt into)",
+        "Jacobi symbol (x|m) of each element x of the int64 or uint64 typed array `xs`, as "
+        "with `math/jacobi`. `m` can be an integer or a `math/modulus` context. Returns an "
+        "int8 typed array, or writes the results to the int8 typed array `into`.") {
+    janet_arity(argc, 2, 3);
+    JanetTArrayView *xs = batch_getview(argv, 0);
+    BatchModulus bm;
+    batch_getmodulus(argv, 1, &bm);
+    if (bm.m == 0) janet_panic("expected nonzero modulus");
+    JanetTArrayView *out = batch_getinto(argv, argc, 2, xs->size,
+                                         JANET_TARRAY_TYPE_S8, JANET_TARRAY_TYPE_S8);
+    for (size_t i = 0; i < xs->size; i++) {
+        int64_t x = batch_residue(xs, i, bm.abs);
+        out->as.s8[i * out->stride] = (int8_t) _jacobi_impl(x, bm.m);
+    }
+    return janet_wrap_abstract(out);
+}
+
+/* Prime sieve and batched primality */
+
+/* Deterministic for every 64 bit n. Uses the same bases as miller-rabin-prp?
+ * in spork/math. */
+static int is_prime_u64(uint64_t n) {
+    static const uint32_t small[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
+    static const uint64_t bases32[] = {2, 7, 61};
+    static const uint64_t bases64[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+    if (n < 2) return 0;
+    for (size_t i = 0; i < sizeof(small) / sizeof(small[0]); i++) {
+        if (n == small[i]) return 1;
+        if (n % small[i] == 0) return 0;
+    }
+    if (n < 59 * 59) return 1;
+    const uint64_t *bases = bases64;
+    size_t nbases = sizeof(bases64) / sizeof(bases64[0]);
+    if (n <= UINT32_MAX) {
+        bases = bases32;
+        nbases = sizeof(bases32) / sizeof(bases32[0]);
+    }
+    uint64_t d = n - 1;
+    int s = 0;
+    while (!(d & 1)) {
+        d >>= 1;
+        s++;
+    }
+    MontCtx ctx;
+    mont_init(&ctx, n);
+    uint64_t minus_one = n - ctx.one;
+    for (size_t i = 0; i < nbases; i++) {
+        uint64_t a = bases[i] % n;
+        if (a == 0) continue;
+        uint64_t x = mont_pow(&ctx, mont_to(&ctx, a), d);
+        if (x == ctx.one || x == minus_one) continue;
+        int r;
+        for (r = 1; r < s; r++) {
+            x = mont_mul(&ctx, x, x);
+            if (x == minus_one) break;
+        }
+        if (r == s) return 0;
+    }
+    return 1;
+}
+
+/* Bytes per sieve segment. Each byte stands for one odd number, so a segment
+ * stays resident in L1 while every base prime is crossed off. */
+#define SIEVE_SEGMENT 32768
+
+/* Multiples of 3, 5, 7, 11 and 13 are not crossed off one by one but copied
+ * from a repeating pattern, where byte k is set if 2k + 1 has one of them as
+ * a factor. The pattern repeats every 15015 odd numbers. */
+#define SIEVE_WHEEL 15015
+static uint8_t sieve_pattern[SIEVE_WHEEL + SIEVE_SEGMENT];
+
+static void sieve_init(void) {
+    for (size_t k = 0; k < sizeof(sieve_pattern); k++) {
+        uint64_t v = 2 * k + 1;
+        sieve_pattern[k] = (v % 3 == 0) || (v % 5 == 0) || (v % 7 == 0) ||
+                           (v % 11 == 0) || (v % 13 == 0);
+    }
+}
+
+static int ctz_u64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* Largest r with r * r <= n. */
+static uint64_t isqrt_u64(uint64_t n) {
+    uint64_t r = (uint64_t) sqrt((double) n);
+    while (r > 0 && (r > UINT32_MAX || r * r > n)) r--;
+    while (r < UINT32_MAX && (r + 1) * (r + 1) <= n) r++;
+    return r;
+}
+
+/* Odd primes up to and including limit, which must be below 2^32. */
+static uint32_t *sieve_base_primes(uint64_t limit, size_t *count) {
+    size_t half = (size_t)(limit / 2) + 1;
+    uint8_t *composite = janet_smalloc(half);
+    memset(composite, 0, half);
+    size_t n = 0;
+    for (uint64_t i = 3; i * i <= limit; i += 2) {
+        if (composite[i / 2]) continue;
+        for (uint64_t j = i * i; j <= limit; j += 2 * i) composite[j / 2] = 1;
+    }
+    for (uint64_t i = 3; i <= limit; i += 2) {
+        if (!composite[i / 2]) n++;
+    }
+    uint32_t *primes = janet_smalloc(sizeof(uint32_t) * (n ? n : 1));
+    n = 0;
+    for (uint64_t i = 3; i <= limit; i += 2) {
+        if (!composite[i / 2]) primes[n++] = (uint32_t) i;
+    }
+    janet_sfree(composite);
+    *count = n;
+    return primes;
+}
+
+typedef struct {
+    uint64_t *items;
+    size_t count;
+    size_t capacity;
+} PrimeBuffer;
+
+static void prime_buffer_push(PrimeBuffer *buf, uint64_t p) {
+    if (buf->count == buf->capacity) {
+        buf->capacity *= 2;
+        buf->items = janet_srealloc(buf->items, sizeof(uint64_t) * buf->capacity);
+    }
+    buf->items[buf->count++] = p;
+}
+
+/* Segmented sieve of Eratosthenes over the odd numbers of [lo, hi). Index i
+ * of the sieve stands for start + 2i, and next[k] is the index of the next
+ * odd multiple of the k-th base prime still to be crossed off.
+ *
+ * Base primes below the segment size hit every segment and are walked each
+ * time. Larger primes hit a segment at most once, so they wait in a bucket
+ * for the segment holding their next multiple, linked through link[k]. */
+static void sieve_range(uint64_t lo, uint64_t hi, PrimeBuffer *out) {
+    static const uint64_t wheel_primes[] = {3, 5, 7, 11, 13};
+    if (lo < 2) lo = 2;
+    if (lo >= hi) return;
+    if (lo == 2) {
+        prime_buffer_push(out, 2);
+        lo = 3;
+    }
+    uint64_t start = lo | 1;
+    if (start >= hi) return;
+    uint64_t total = (hi - start + 1) / 2;
+    /* A narrow range far from zero would spend most of its time finding base
+     * primes up to the square root of hi. Sieve with fewer of them instead and
+     * let Miller-Rabin settle the survivors that could still be composite. */
+    uint64_t root = isqrt_u64(hi - 1);
+    uint64_t limit = (total < (UINT64_MAX >> 5)) ? total << 5 : UINT64_MAX;
+    if (limit < (1 << 20)) limit = 1 << 20;
+    if (limit > root) limit = root;
+    uint64_t certain = (limit < root) ? (limit + 1) * (limit + 1) : UINT64_MAX;
+    size_t nbase;
+    uint32_t *base = sieve_base_primes(limit, &nbase);
+    uint64_t *next = janet_smalloc(sizeof(uint64_t) * (nbase ? nbase : 1));
+    uint32_t *link = janet_smalloc(sizeof(uint32_t) * (nbase ? nbase : 1));
+    size_t nbuckets = (size_t)(limit / SIEVE_SEGMENT) + 2;
+    uint32_t *buckets = janet_smalloc(sizeof(uint32_t) * nbuckets);
+    for (size_t g = 0; g < nbuckets; g++) buckets[g] = UINT32_MAX;
+    size_t first = 0;
+    while (first < nbase && base[first] <= 13) first++;
+    size_t small = first;
+    size_t pending = nbase;
+    for (size_t k = 0; k < nbase; k++) {
+        uint64_t p = base[k];
+        uint64_t m = p * p;
+        if (m < start) {
+            uint64_t r = start % p;
+            m = start + (r ? p - r : 0);
+            if (!(m & 1)) m += p;
+        }
+        next[k] = (m - start) / 2;
+        if (p < SIEVE_SEGMENT) {
+            small = k + 1;
+        } else if (pending == nbase && next[k] / SIEVE_SEGMENT >= nbuckets - 1) {
+            /* Too far ahead for the buckets. From here on the first multiples
+             * are squares, so they are reached in order. */
+            pending = k;
+        } else if (pending == nbase && next[k] < total) {
+            size_t g = (size_t)((next[k] / SIEVE_SEGMENT) % nbuckets);
+            link[k] = buckets[g];
+            buckets[g] = (uint32_t) k;
+        }
+    }
+    uint8_t *segment = janet_smalloc(SIEVE_SEGMENT + 8);
+    for (uint64_t low = 0; low < total; low += SIEVE_SEGMENT) {
+        uint64_t len = total - low < SIEVE_SEGMENT ? total - low : SIEVE_SEGMENT;
+        uint64_t high = low + len;
+        memcpy(segment, sieve_pattern + ((start / 2) % SIEVE_WHEEL + low) % SIEVE_WHEEL, (size_t) len);
+        if (low == 0) {
+            for (size_t k = 0; k < sizeof(wheel_primes) / sizeof(wheel_primes[0]); k++) {
+                uint64_t q = wheel_primes[k];
+                if (q >= start && q < hi) segment[(q - start) / 2] = 0;
+            }
+        }
+        for (size_t k = first; k < small; k++) {
+            uint64_t p = base[k];
+            uint64_t j = next[k];
+            for (; j < high; j += p) segment[j - low] = 1;
+            next[k] = j;
+        }
+        size_t g = (size_t)((low / SIEVE_SEGMENT) % nbuckets);
+        for (; pending < nbase && next[pending] < high; pending++) {
+            link[pending] = buckets[g];
+            buckets[g] = (uint32_t) pending;
+        }
+        uint32_t k = buckets[g];
+        buckets[g] = UINT32_MAX;
+        while (k != UINT32_MAX) {
+            uint32_t following = link[k];
+            segment[next[k] - low] = 1;
+            next[k] += base[k];
+            if (next[k] < total) {
+                size_t h = (size_t)((next[k] / SIEVE_SEGMENT) % nbuckets);
+                link[k] = buckets[h];
+                buckets[h] = k;
+            }
+            k = following;
+        }
+        /* Pad to whole words so survivors can be picked out 8 at a time. */
+        size_t padded = ((size_t) len + 7) & ~(size_t) 7;
+        memset(segment + len, 1, padded - (size_t) len);
+        for (size_t i = 0; i < padded; i += 8) {
+            uint64_t word;
+            memcpy(&word, segment + i, 8);
+            uint64_t survivors = ~word & UINT64_C(0x0101010101010101);
+            while (survivors) {
+                uint64_t n = start + 2 * (low + i + (size_t)(ctz_u64(survivors) / 8));
+                if (n < certain || is_prime_u64(n)) prime_buffer_push(out, n);
+                survivors &= survivors - 1;
+            }
+        }
+    }
+    janet_sfree(segment);
+    janet_sfree(buckets);
+    janet_sfree(link);
+    janet_sfree(next);
+    janet_sfree(base);
+}
+
+JANET_FN(cfun_cmath_prime_range,
+        "(math/prime-range start &opt end)",
+        "Get all primes `p` with `start <= p < end` as a u64 typed array, using a segmented "
+        "sieve of Eratosthenes. With a single argument, gets the primes below `start`. "
+        "Memory use grows with the square root of `end` rather than the size of the range.") {
+    janet_arity(argc, 1, 2);
+    uint64_t lo = 0;
+    uint64_t hi;
+    if (argc == 1) {
+        hi = janet_getuinteger64(argv, 0);
+    } else {
+        lo = janet_getuinteger64(argv, 0);
+        hi = janet_getuinteger64(argv, 1);
+    }
+    PrimeBuffer buf;
+    buf.count = 0;
+    buf.capacity = 64;
+    if (hi > lo) {
+        /* The prime counting estimate overshoots slightly for most ranges. */
+        double guess = 1.25 * (double)(hi - lo) / log((double) hi) + 64;
+        if (guess < (double)(SIZE_MAX / sizeof(uint64_t))) buf.capacity = (size_t) guess;
+    }
+    buf.items = janet_smalloc(sizeof(uint64_t) * buf.capacity);
+    sieve_range(lo, hi, &buf);
+    JanetTArrayView *view = janet_tarray_view_new(JANET_TARRAY_TYPE_U64, buf.count);
+    if (buf.count) memcpy(view->as.u64, buf.items, sizeof(uint64_t) * buf.count);
+    janet_sfree(buf.items);
+    return janet_wrap_abstract(view);
+}
+
+JANET_FN(cfun_cmath_prime_mask,
+        "(math/prime-mask xs &opt into)",
+        "Test every element of the integer typed array `xs` for primality at once. Returns a "
+        "u8 typed array with 1 for each prime element and 0 otherwise, deterministic over "
+        "the whole u64 range. Results are written to the u8 typed array `into` if given.") {
+    janet_arity(argc, 1, 2);
+    JanetTArrayView *xs = janet_checktarray_view(argv[0]);
+    if (xs == NULL) janet_panicf("bad slot #0, expected typed array, got %v", argv[0]);
+    if (xs->type == JANET_TARRAY_TYPE_F32 || xs->type == JANET_TARRAY_TYPE_F64) {
+        janet_panic("bad slot #0, expected integer typed array");
+    }
+    JanetTArrayView *out;
+    if (argc > 1 && !janet_checktype(argv[1], JANET_NIL)) {
+        out = janet_checktarray_view(argv[1]);
+        if (out == NULL || out->type != JANET_TARRAY_TYPE_U8) {
+            janet_panicf("bad slot #1, expected u8 typed array, got %v", argv[1]);
+        }
+        if (out->size < xs->size) {
+            janet_panicf("bad slot #1, expected at least %d elements", (int32_t) xs->size);
+        }
+    } else {
+        out = janet_tarray_view_new(JANET_TARRAY_TYPE_U8, xs->size);
+    }
+    for (size_t i = 0; i < xs->size; i++) {
+        size_t k = i * xs->stride;
+        uint64_t n;
+        switch (xs->type) {
+            case JANET_TARRAY_TYPE_U8:
+                n = xs->as.u8[k];
+                break;
+            case JANET_TARRAY_TYPE_S8:
+                n = xs->as.s8[k] < 0 ? 0 : (uint64_t) xs->as.s8[k];
+                break;
+            case JANET_TARRAY_TYPE_U16:
+                n = xs->as.u16[k];
+                break;
+            case JANET_TARRAY_TYPE_S16:
+                n = xs->as.s16[k] < 0 ? 0 : (uint64_t) xs->as.s16[k];
+                break;
+            case JANET_TARRAY_TYPE_U32:
+                n = xs->as.u32[k];
+                break;
+            case JANET_TARRAY_TYPE_S32:
+                n = xs->as.s32[k] < 0 ? 0 : (uint64_t) xs->as.s32[k];
+                break;
+            case JANET_TARRAY_TYPE_S64:
+                n = xs->as.s64[k] < 0 ? 0 : (uint64_t) xs->as.s64[k];
+                break;
+            default:
+                n = xs->as.u64[k];
+                break;
+        }
+        out->as.u8[i * out->stride] = (uint8_t) is_prime_u64(n);
+    }
+    return janet_wrap_abstract(out);
+}
+
+/* Factoring */
+
+/* Differences multiplied together between gcds in Pollard's rho. */
+#define RHO_BATCH 128
+
+static uint64_t rho_step_u64(const MontCtx *ctx, uint64_t y, uint64_t c) {
+    y = mont_mul(ctx, y, y);
+    return y >= ctx->m - c ? y - (ctx->m - c) : y + c;
+}
+
+/* Brent's cycle detection on x -> x^2 + c mod the odd composite n. Returns a
+ * divisor of n, which is n itself if the cycle closed before a factor was
+ * found. */
+static uint64_t rho_u64(const MontCtx *ctx, uint64_t c) {
+    uint64_t n = ctx->m;
+    uint64_t cm = mont_to(ctx, c % n);
+    uint64_t y = mont_to(ctx, 2), x = y, ys = y, q = ctx->one, g = 1;
+    for (uint64_t r = 1; g == 1; r <<= 1) {
+        x = y;
+        for (uint64_t i = 0; i < r; i++) y = rho_step_u64(ctx, y, cm);
+        for (uint64_t k = 0; k < r && g == 1; k += RHO_BATCH) {
+            ys = y;
+            uint64_t lim = r - k < RHO_BATCH ? r - k : RHO_BATCH;
+            for (uint64_t i = 0; i < lim; i++) {
+                y = rho_step_u64(ctx, y, cm);
+                q = mont_mul(ctx, q, x > y ? x - y : y - x);
+            }
+            /* q is in Montgomery form, which has the same gcd with n. */
+            g = gcd_u64(q, n);
+        }
+    }
+    if (g == n) {
+        /* The batch overshot, so redo it one difference at a time. */
+        do {
+            ys = rho_step_u64(ctx, ys, cm);
+            g = gcd_u64(x > ys ? x - ys : ys - x, n);
+        } while (g == 1);
+    }
+    return g;
+}
+
+/* y = y^2 + c mod n. t has room for 2 * nn limbs. */
+static void rho_step_big(uint32_t *y, const uint32_t *c, const uint32_t *n, int32_t nn, uint32_t *t) {
+    big_mulmod(y, y, y, n, nn, t);
+    mag_add(t, y, nn, c, nn);
+    if (mag_cmp(t, nn + 1, n, nn) >= 0) mag_sub(t, t, nn + 1, n, nn);
+    memcpy(y, t, sizeof(uint32_t) * (size_t) nn);
+}
+
+static void rho_absdiff(uint32_t *d, const uint32_t *x, const uint32_t *y, int32_t nn) {
+    if (mag_cmp(x, nn, y, nn) >= 0) {
+        mag_sub(d, x, nn, y, nn);
+    } else {
+        mag_sub(d, y, nn, x, nn);
+    }
+}
+
+/* Same as rho_u64 for n of nn limbs, with c < n. Writes the divisor to g,
+ * which has room for nn limbs, and returns its length. */
+static int32_t rho_big(uint32_t *g, const uint32_t *n, int32_t nn, uint32_t c) {
+    uint32_t *buf = janet_smalloc(sizeof(uint32_t) * (size_t)(8 * nn));
+    uint32_t *cc = buf, *x = cc + nn, *y = x + nn, *ys = y + nn;
+    uint32_t *q = ys + nn, *d = q + nn, *t = d + nn;
+    memset(buf, 0, sizeof(uint32_t) * (size_t)(6 * nn));
+    cc[0] = c;
+    y[0] = 2;
+    q[0] = 1;
+    g[0] = 1;
+    int32_t gn = 1;
+    for (uint64_t r = 1; gn == 1 && g[0] == 1; r <<= 1) {
+        memcpy(x, y, sizeof(uint32_t) * (size_t) nn);
+        for (uint64_t i = 0; i < r; i++) rho_step_big(y, cc, n, nn, t);
+        for (uint64_t k = 0; k < r && gn == 1 && g[0] == 1; k += RHO_BATCH) {
+            memcpy(ys, y, sizeof(uint32_t) * (size_t) nn);
+            uint64_t lim = r - k < RHO_BATCH ? r - k : RHO_BATCH;
+            for (uint64_t i = 0; i < lim; i++) {
+                rho_step_big(y, cc, n, nn, t);
+                rho_absdiff(d, x, y, nn);
+                big_mulmod(q, q, d, n, nn, t);
+            }
+            gn = mag_gcd(g, q, nn, n, nn);
+        }
+    }
+    if (!mag_cmp(g, gn, n, nn)) {
+        do {
+            rho_step_big(ys, cc, n, nn, t);
+            rho_absdiff(d, x, ys, nn);
+            gn = mag_gcd(g, d, nn, n, nn);
+        } while (gn == 1 && g[0] == 1);
+    }
+    janet_sfree(buf);
+    return gn;
+}
+
+JANET_FN(cfun_cmath_pollard_rho,
+        "(math/pollard-rho n &opt c)",
+        "Find a nontrivial divisor of the composite integer `n` with Pollard's rho algorithm "
+        "and Brent's cycle detection, iterating x^2 + `c` (default 1) and moving on to the "
+        "next `c` whenever a cycle closes without a factor. Returns `n` itself if it is "
+        "prime. The result has the same type as `n`, which may be a bigint.") {
+    static const uint32_t bases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41};
+    janet_arity(argc, 1, 2);
+    BigView n;
+    bigview_get(argv, 0, &n);
+    uint32_t c = argc > 1 ? (uint32_t) janet_getnat(argv, 1) : 1;
+    if (n.sign <= 0) janet_panicf("expected positive integer, got %v", argv[0]);
+    if (n.len <= 2) {
+        uint64_t v = n.limbs[0] | (n.len > 1 ? (uint64_t) n.limbs[1] << 32 : 0);
+        if (v < 4 || is_prime_u64(v)) return argv[0];
+        uint64_t g = 2;
+        if (v & 1) {
+            MontCtx ctx;
+            mont_init(&ctx, v);
+            while ((g = rho_u64(&ctx, c)) == v) c++;
+        }
+        BigView gv;
+        bigview_set_u64(&gv, 1, g);
+        return big_result(gv.limbs, gv.len, &n, argv[0]);
+    }
+    if (!(n.limbs[0] & 1)) {
+        const uint32_t two = 2;
+        return big_result(&two, 1, &n, argv[0]);
+    }
+    if (big_sprp(n.limbs, n.len, bases, (int)(sizeof(bases) / sizeof(bases[0])))) return argv[0];
+    uint32_t *g = janet_smalloc(sizeof(uint32_t) * (size_t) n.len);
+    int32_t gn = rho_big(g, n.limbs, n.len, c);
+    while (!mag_cmp(g, gn, n.limbs, n.len)) gn = rho_big(g, n.limbs, n.len, ++c);
+    Janet out = big_result(g, gn, &n, argv[0]);
+    janet_sfree(g);
+    return out;
+}
+
+/* Dense matrices */
+
+/* Row-major f64 matrix stored in a typed array view, so the data can be
+ * shared with spork/tarray without copying. */
+typedef struct {
+    int32_t rows;
+    int32_t cols;
+    JanetTArrayView *view;
+} Matrix;
+
+static int matrix_gcmark(void *p, size_t size) {
+    (void) size;
+    Matrix *m = (Matrix *) p;
+    janet_mark(janet_wrap_abstract(m->view));
+    return 0;
+}
+
+static int matrix_get(void *p, Janet key, Janet *out);
+
+static void matrix_tostring(void *p, JanetBuffer *buffer) {
+    Matrix *m = (Matrix *) p;
+    janet_formatb(buffer, "%dx%d", m->rows, m->cols);
+}
+
+static const JanetAbstractType matrix_type = {
+    .name = "math/matrix",
+    .gcmark = matrix_gcmark,
+    .get = matrix_get,
+    .tostring = matrix_tostring
+};
+
+static double *matrix_data(const Matrix *m) {
+    return m->view->as.f64;
+}
+
+static Matrix *matrix_wrap(int32_t rows, int32_t cols, JanetTArrayView *view) {
+    Matrix *m = janet_abstract(&matrix_type, sizeof(Matrix));
+    m->rows = rows;
+    m->cols = cols;
+    m->view = view;
+    return m;
+}
+
+/* New zeroed matrix. */
+static Matrix *matrix_new(int32_t rows, int32_t cols) {
+    if (cols > 0 && rows > INT32_MAX / cols) janet_panic("matrix too large");
+    JanetTArrayView *view = janet_tarray_view_new(JANET_TARRAY_TYPE_F64, (size_t) rows * (size_t) cols);
+    return matrix_wrap(rows, cols, view);
+}
+
+static Matrix *getmatrix(const Janet *argv, int32_t n) {
+    return (Matrix *) janet_getabstract(argv, n, &matrix_type);
+}
+
+static size_t matrix_count(const Matrix *m) {
+    return (size_t) m->rows * (size_t) m->cols;
+}
+
+static int matrix_overlaps(const Matrix *a, const Matrix *b) {
+    const double *pa = matrix_data(a);
+    const double *pb = matrix_data(b);
+    if (matrix_count(a) == 0 || matrix_count(b) == 0) return 0;
+    return pa < pb + matrix_count(b) && pb < pa + matrix_count(a);
+}
+
+static void matrix_check_same_size(const Matrix *a, const Matrix *b) {
+    if (a->rows != b->rows || a->cols != b->cols) {
+        janet_panicf("matrix size mismatch, %dx%d and %dx%d", a->rows, a->cols, b->rows, b->cols);
+    }
+}
+
+/* GEMM. C is cut into KC x NC panels of B that stay in cache while every
+ * row of A streams past them, and each panel is walked with a small register
+ * tile. Leftover rows and columns go through gemm_edge. Every operand has its
+ * own row stride, so blocks inside larger matrices can be used in place. */
+
+#define GEMM_KC 128
+#define GEMM_NC 256
+
+typedef void (*GemmPanelFn)(const double *a, size_t lda, const double *b, size_t ldb,
+                            double *c, size_t ldc, int32_t m,
+                            int32_t k0, int32_t k1, int32_t j0, int32_t j1);
+
+/* c[i0:i1, j0:j1] += a[i0:i1, k0:k1] * b[k0:k1, j0:j1] */
+static void gemm_edge(const double *a, size_t lda, const double *b, size_t ldb,
+                      double *c, size_t ldc, int32_t i0, int32_t i1, int32_t k0, int32_t k1, int32_t j0, int32_t j1) {
+    for (int32_t i = i0; i < i1; i++) {
+        double *ci = c + i * ldc;
+        for (int32_t k = k0; k < k1; k++) {
+            double aik = a[i * lda + k];
+            const double *bk = b + k * ldb;
+            for (int32_t j = j0; j < j1; j++) {
+                ci[j] += aik * bk[j];
+            }
+        }
+    }
+}
+
+static void gemm_panel_generic(const double *a, size_t lda, const double *b, size_t ldb,
+                               double *c, size_t ldc, int32_t m,
+                               int32_t k0, int32_t k1, int32_t j0, int32_t j1) {
+    int32_t mi = m - m % 4;
+    int32_t mj = j1 - (j1 - j0) % 4;
+    for (int32_t i = 0; i < mi; i += 4) {
+        const double *a0 = a + i * lda;
+        const double *a1 = a0 + lda;
+        const double *a2 = a1 + lda;
+        const double *a3 = a2 + lda;
+        for (int32_t j = j0; j < mj; j += 4) {
+            double acc[4][4];
+            for (int r = 0; r < 4; r++) {
+                for (int s = 0; s < 4; s++) {
+                    acc[r][s] = c[(i + r) * ldc + j + s];
+                }
+            }
+            for (int32_t k = k0; k < k1; k++) {
+                const double *bk = b + k * ldb + j;
+                double av[4] = {a0[k], a1[k], a2[k], a3[k]};
+                for (int r = 0; r < 4; r++) {
+                    for (int s = 0; s < 4; s++) {
+                        acc[r][s] += av[r] * bk[s];
+                    }
+                }
+            }
+            for (int r = 0; r < 4; r++) {
+                for (int s = 0; s < 4; s++) {
+                    c[(i + r) * ldc + j + s] = acc[r][s];
+                }
+            }
+        }
+    }
+    if (mj < j1) gemm_edge(a, lda, b, ldb, c, ldc, 0, mi, k0, k1, mj, j1);
+    if (mi < m) gemm_edge(a, lda, b, ldb, c, ldc, mi, m, k0, k1, j0, j1);
+}
+
+#ifdef CMATH_X86
+
+/* 4x8 tile held in eight ymm accumulators. */
+__attribute__((target("avx2,fma")))
+static void gemm_panel_avx2(const double *a, size_t lda, const double *b, size_t ldb,
+                            double *c, size_t ldc, int32_t m,
+                            int32_t k0, int32_t k1, int32_t j0, int32_t j1) {
+    int32_t mi = m - m % 4;
+    int32_t mj = j1 - (j1 - j0) % 8;
+    for (int32_t i = 0; i < mi; i += 4) {
+        const double *a0 = a + i * lda;
+        const double *a1 = a0 + lda;
+        const double *a2 = a1 + lda;
+        const double *a3 = a2 + lda;
+        double *c0 = c + i * ldc;
+        double *c1 = c0 + ldc;
+        double *c2 = c1 + ldc;
+        double *c3 = c2 + ldc;
+        for (int32_t j = j0; j < mj; j += 8) {
+            __m256d c00 = _mm256_loadu_pd(c0 + j), c01 = _mm256_loadu_pd(c0 + j + 4);
+            __m256d c10 = _mm256_loadu_pd(c1 + j), c11 = _mm256_loadu_pd(c1 + j + 4);
+            __m256d c20 = _mm256_loadu_pd(c2 + j), c21 = _mm256_loadu_pd(c2 + j + 4);
+            __m256d c30 = _mm256_loadu_pd(c3 + j), c31 = _mm256_loadu_pd(c3 + j + 4);
+            for (int32_t k = k0; k < k1; k++) {
+                const double *bk = b + k * ldb + j;
+                __m256d b0 = _mm256_loadu_pd(bk);
+                __m256d b1 = _mm256_loadu_pd(bk + 4);
+                __m256d av = _mm256_broadcast_sd(a0 + k);
+                c00 = _mm256_fmadd_pd(av, b0, c00);
+                c01 = _mm256_fmadd_pd(av, b1, c01);
+                av = _mm256_broadcast_sd(a1 + k);
+                c10 = _mm256_fmadd_pd(av, b0, c10);
+                c11 = _mm256_fmadd_pd(av, b1, c11);
+                av = _mm256_broadcast_sd(a2 + k);
+                c20 = _mm256_fmadd_pd(av, b0, c20);
+                c21 = _mm256_fmadd_pd(av, b1, c21);
+                av = _mm256_broadcast_sd(a3 + k);
+                c30 = _mm256_fmadd_pd(av, b0, c30);
+                c31 = _mm256_fmadd_pd(av, b1, c31);
+            }
+            _mm256_storeu_pd(c0 + j, c00);
+            _mm256_storeu_pd(c0 + j + 4, c01);
+            _mm256_storeu_pd(c1 + j, c10);
+            _mm256_storeu_pd(c1 + j + 4, c11);
+            _mm256_storeu_pd(c2 + j, c20);
+            _mm256_storeu_pd(c2 + j + 4, c21);
+            _mm256_storeu_pd(c3 + j, c30);
+            _mm256_storeu_pd(c3 + j + 4, c31);
+        }
+    }
+    if (mj < j1) gemm_edge(a, lda, b, ldb, c, ldc, 0, mi, k0, k1, mj, j1);
+    if (mi < m) gemm_edge(a, lda, b, ldb, c, ldc, mi, m, k0, k1, j0, j1);
+}
+
+#endif
+
+static GemmPanelFn gemm_panel = gemm_panel_generic;
+
+static void simd_init(void) {
+#ifdef CMATH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        gemm_panel = gemm_panel_avx2;
+    }
+#endif
+}
+
+/* c (m x p) += a (m x n) * b (n x p). c must not overlap a or b. */
+static void gemm_acc(const double *a, size_t lda, const double *b, size_t ldb,
+                     double *c, size_t ldc, int32_t m, int32_t n, int32_t p) {
+    for (int32_t k0 = 0; k0 < n; k0 += GEMM_KC) {
+        int32_t k1 = (n - k0 > GEMM_KC) ? k0 + GEMM_KC : n;
+        for (int32_t j0 = 0; j0 < p; j0 += GEMM_NC) {
+            int32_t j1 = (p - j0 > GEMM_NC) ? j0 + GEMM_NC : p;
+            gemm_panel(a, lda, b, ldb, c, ldc, m, k0, k1, j0, j1);
+        }
+    }
+}
+
+/* c (m x p) = a (m x n) * b (n x p) for contiguous matrices. */
+static void gemm(const double *a, const double *b, double *c, int32_t m, int32_t n, int32_t p) {
+    if (m > 0 && p > 0) memset(c, 0, sizeof(double) * (size_t) m * (size_t) p);
+    gemm_acc(a, n, b, p, c, p, m, n, p);
+}
+
+/* Decompositions. Factorizations work on a scratch copy of the matrix and
+ * push their trailing updates through gemm_acc in blocks of DECOMP_NB
+ * columns, so large inputs run at matrix multiply speed. */
+
+#define DECOMP_NB 32
+
+static double *scratch_copy(const double *src, size_t count) {
+    double *dst = janet_smalloc(sizeof(double) * (count ? count : 1));
+    if (count) memcpy(dst, src, sizeof(double) * count);
+    return dst;
+}
+
+/* Blocked LU with partial pivoting of the n x n matrix a, in place. The unit
+ * lower triangle holds L and the upper triangle U. perm[i] is the row of the
+ * original matrix that ended up in row i. Returns the sign of the permutation,
+ * or 0 if a zero pivot was found. */
+static int lu_factor(double *a, int32_t n, int32_t *perm) {
+    int sign = 1;
+    int singular = 0;
+    for (int32_t i = 0; i < n; i++) perm[i] = i;
+    for (int32_t k0 = 0; k0 < n; k0 += DECOMP_NB) {
+        int32_t k1 = (n - k0 > DECOMP_NB) ? k0 + DECOMP_NB : n;
+        /* Factor the panel, swapping whole rows. */
+        for (int32_t k = k0; k < k1; k++) {
+            int32_t piv = k;
+            double best = fabs(a[(size_t) k * n + k]);
+            for (int32_t i = k + 1; i < n; i++) {
+                double v = fabs(a[(size_t) i * n + k]);
+                if (v > best) {
+                    best = v;
+                    piv = i;
+                }
+            }
+            if (piv != k) {
+                double *rk = a + (size_t) k * n;
+                double *rp = a + (size_t) piv * n;
+                for (int32_t j = 0; j < n; j++) {
+                    double t = rk[j];
+                    rk[j] = rp[j];
+                    rp[j] = t;
+                }
+                int32_t t = perm[k];
+                perm[k] = perm[piv];
+                perm[piv] = t;
+                sign = -sign;
+            }
+            const double *rk = a + (size_t) k * n;
+            if (rk[k] == 0.0) {
+                singular = 1;
+                continue;
+            }
+            for (int32_t i = k + 1; i < n; i++) {
+                double *ri = a + (size_t) i * n;
+                double l = ri[k] /= rk[k];
+                for (int32_t j = k + 1; j < k1; j++) {
+                    ri[j] -= l * rk[j];
+                }
+            }
+        }
+        if (k1 == n) break;
+        /* U12 = L11^-1 A12 */
+        for (int32_t i = k0 + 1; i < k1; i++) {
+            double *ri = a + (size_t) i * n;
+            for (int32_t r = k0; r < i; r++) {
+                double l = ri[r];
+                const double *rr = a + (size_t) r * n;
+                for (int32_t j = k1; j < n; j++) {
+                    ri[j] -= l * rr[j];
+                }
+            }
+        }
+        /* A22 -= L21 U12 */
+        int32_t nb = k1 - k0;
+        int32_t rest = n - k1;
+        double *l21 = janet_smalloc(sizeof(double) * (size_t) rest * nb);
+        for (int32_t i = 0; i < rest; i++) {
+            const double *ri = a + (size_t)(k1 + i) * n + k0;
+            for (int32_t j = 0; j < nb; j++) {
+                l21[(size_t) i * nb + j] = -ri[j];
+            }
+        }
+        gemm_acc(l21, nb, a + (size_t) k0 * n + k1, n, a + (size_t) k1 * n + k1, n, rest, nb, rest);
+        janet_sfree(l21);
+    }
+    return singular ? 0 : sign;
+}
+
+/* Solve LU x = P b for the factored n x n matrix lu, overwriting the n x k
+ * matrix x, which must already hold the permuted right hand side. */
+static void lu_solve(const double *lu, int32_t n, double *x, int32_t k) {
+    for (int32_t i = 0; i < n; i++) {
+        double *xi = x + (size_t) i * k;
+        const double *li = lu + (size_t) i * n;
+        for (int32_t r = 0; r < i; r++) {
+            double l = li[r];
+            if (l == 0.0) continue;
+            const double *xr = x + (size_t) r * k;
+            for (int32_t j = 0; j < k; j++) xi[j] -= l * xr[j];
+        }
+    }
+    for (int32_t i = n - 1; i >= 0; i--) {
+        double *xi = x + (size_t) i * k;
+        const double *ui = lu + (size_t) i * n;
+        for (int32_t r = i + 1; r < n; r++) {
+            double u = ui[r];
+            if (u == 0.0) continue;
+            const double *xr = x + (size_t) r * k;
+            for (int32_t j = 0; j < k; j++) xi[j] -= u * xr[j];
+        }
+        double d = ui[i];
+        for (int32_t j = 0; j < k; j++) xi[j] /= d;
+    }
+}
+
+/* Apply the block reflector I - Y T Y' (or its transpose) from the left to
+ * the mr x nc block c. y is mr x nb with a unit diagonal, yt its transpose. */
+static void householder_apply(const double *y, const double *yt, const double *t, int32_t nb,
+                              int32_t mr, double *c, size_t ldc, int32_t nc, int transpose) {
+    if (nc == 0) return;
+    double *w = janet_smalloc(sizeof(double) * (size_t) nb * nc);
+    memset(w, 0, sizeof(double) * (size_t) nb * nc);
+    gemm_acc(yt, mr, c, ldc, w, nc, nb, mr, nc);
+    if (transpose) {
+        /* w = T' w, T' is lower triangular */
+        for (int32_t i = nb - 1; i >= 0; i--) {
+            double *wi = w + (size_t) i * nc;
+            double tii = t[(size_t) i * nb + i];
+            for (int32_t j = 0; j < nc; j++) wi[j] *= tii;
+            for (int32_t r = 0; r < i; r++) {
+                double tri = t[(size_t) r * nb + i];
+                const double *wr = w + (size_t) r * nc;
+                for (int32_t j = 0; j < nc; j++) wi[j] += tri * wr[j];
+            }
+        }
+    } else {
+        /* w = T w, T is upper triangular */
+        for (int32_t i = 0; i < nb; i++) {
+            double *wi = w + (size_t) i * nc;
+            double tii = t[(size_t) i * nb + i];
+            for (int32_t j = 0; j < nc; j++) wi[j] *= tii;
+            for (int32_t r = i + 1; r < nb; r++) {
+                double tir = t[(size_t) i * nb + r];
+                const double *wr = w + (size_t) r * nc;
+                for (int32_t j = 0; j < nc; j++) wi[j] += tir * wr[j];
+            }
+        }
+    }
+    for (size_t i = 0; i < (size_t) nb * nc; i++) w[i] = -w[i];
+    gemm_acc(y, nb, w, nc, c, ldc, mr, nb, nc);
+    janet_sfree(w);
+}
+
+/* Gather the reflectors of columns k0 .. k0 + nb of the factored m x n
+ * matrix a into y and yt, and build the triangular factor t. */
+static void householder_block(const double *a, int32_t m, int32_t n, int32_t k0, int32_t nb,
+                              const double *tau, double *y, double *yt, double *t) {
+    int32_t mr = m - k0;
+    for (int32_t r = 0; r < mr; r++) {
+        for (int32_t c = 0; c < nb; c++) {
+            double v = (r < c) ? 0.0 : (r == c) ? 1.0 : a[(size_t)(k0 + r) * n + k0 + c];
+            y[(size_t) r * nb + c] = v;
+            yt[(size_t) c * mr + r] = v;
+        }
+    }
+    memset(t, 0, sizeof(double) * (size_t) nb * nb);
+    for (int32_t j = 0; j < nb; j++) {
+        double tj = tau[k0 + j];
+        t[(size_t) j * nb + j] = tj;
+        /* t[0:j, j] = -tau_j T[0:j, 0:j] Y[:, 0:j]' y_j */
+        for (int32_t i = 0; i < j; i++) {
+            double z = 0.0;
+            const double *yi = yt + (size_t) i * mr;
+            const double *yj = yt + (size_t) j * mr;
+            for (int32_t r = j; r < mr; r++) z += yi[r] * yj[r];
+            t[(size_t) i * nb + j] = z;
+        }
+        for (int32_t i = 0; i < j; i++) {
+            double s = 0.0;
+            for (int32_t r = i; r < j; r++) s += t[(size_t) i * nb + r] * t[(size_t) r * nb + j];
+            t[(size_t) i * nb + j] = s;
+        }
+        for (int32_t i = 0; i < j; i++) t[(size_t) i * nb + j] *= -tj;
+    }
+}
+
+/* Blocked Householder QR of the m x n matrix a, in place. R ends up in the
+ * upper triangle and the reflectors below it, scaled so v[0] = 1. */
+static void qr_factor(double *a, int32_t m, int32_t n, double *tau) {
+    int32_t k = m < n ? m : n;
+    double *y = janet_smalloc(sizeof(double) * ((size_t) m * DECOMP_NB + 1));
+    double *yt = janet_smalloc(sizeof(double) * ((size_t) m * DECOMP_NB + 1));
+    double *t = janet_smalloc(sizeof(double) * DECOMP_NB * DECOMP_NB);
+    double *w = janet_smalloc(sizeof(double) * DECOMP_NB);
+    for (int32_t k0 = 0; k0 < k; k0 += DECOMP_NB) {
+        int32_t k1 = (k - k0 > DECOMP_NB) ? k0 + DECOMP_NB : k;
+        int32_t pw = (n - k0 > DECOMP_NB) ? DECOMP_NB : n - k0;
+        for (int32_t j = k0; j < k1; j++) {
+            double alpha = a[(size_t) j * n + j];
+            double xnorm = 0.0;
+            for (int32_t i = j + 1; i < m; i++) {
+                xnorm = hypot(xnorm, a[(size_t) i * n + j]);
+            }
+            if (xnorm == 0.0) {
+                tau[j] = 0.0;
+                continue;
+            }
+            double beta = -copysign(hypot(alpha, xnorm), alpha);
+            tau[j] = (beta - alpha) / beta;
+            double scale = 1.0 / (alpha - beta);
+            for (int32_t i = j + 1; i < m; i++) a[(size_t) i * n + j] *= scale;
+            a[(size_t) j * n + j] = beta;
+            /* Apply to the rest of the panel. */
+            int32_t c0 = j + 1;
+            int32_t c1 = k0 + pw;
+            if (c0 >= c1) continue;
+            for (int32_t c = c0; c < c1; c++) w[c - c0] = a[(size_t) j * n + c];
+            for (int32_t i = j + 1; i < m; i++) {
+                double v = a[(size_t) i * n + j];
+                const double *ri = a + (size_t) i * n;
+                for (int32_t c = c0; c < c1; c++) w[c - c0] += v * ri[c];
+            }
+            for (int32_t c = c0; c < c1; c++) w[c - c0] *= tau[j];
+            for (int32_t c = c0; c < c1; c++) a[(size_t) j * n + c] -= w[c - c0];
+            for (int32_t i = j + 1; i < m; i++) {
+                double v = a[(size_t) i * n + j];
+                double *ri = a + (size_t) i * n;
+                for (int32_t c = c0; c < c1; c++) ri[c] -= v * w[c - c0];
+            }
+        }
+        int32_t nb = k1 - k0;
+        int32_t cstart = k0 + pw;
+        if (cstart < n) {
+            householder_block(a, m, n, k0, nb, tau, y, yt, t);
+            householder_apply(y, yt, t, nb, m - k0, a + (size_t) k0 * n + cstart, n, n - cstart, 1);
+        }
+    }
+    janet_sfree(w);
+    janet_sfree(t);
+    janet_sfree(yt);
+    janet_sfree(y);
+}
+
+/* Form the m x m matrix Q from a factored m x n matrix. */
+static void qr_form_q(const double *a, int32_t m, int32_t n, const double *tau, double *q) {
+    int32_t k = m < n ? m : n;
+    memset(q, 0, sizeof(double) * (size_t) m * m);
+    for (int32_t i = 0; i < m; i++) q[(size_t) i * m + i] = 1.0;
+    if (k == 0) return;
+    double *y = janet_smalloc(sizeof(double) * (size_t) m * DECOMP_NB);
+    double *yt = janet_smalloc(sizeof(double) * (size_t) m * DECOMP_NB);
+    double *t = janet_smalloc(sizeof(double) * DECOMP_NB * DECOMP_NB);
+    int32_t last = ((k - 1) / DECOMP_NB) * DECOMP_NB;
+    for (int32_t k0 = last; k0 >= 0; k0 -= DECOMP_NB) {
+        int32_t nb = (k - k0 > DECOMP_NB) ? DECOMP_NB : k - k0;
+        householder_block(a, m, n, k0, nb, tau, y, yt, t);
+        householder_apply(y, yt, t, nb, m - k0, q + (size_t) k0 * m + k0, m, m - k0, 0);
+    }
+    janet_sfree(t);
+    janet_sfree(yt);
+    janet_sfree(y);
+}
+
+/* One-sided Jacobi SVD of the m x n matrix a with m >= n. g holds the
+ * columns of a as its n rows and vt the rows of V'. On return the rows of
+ * g are the left singular vectors scaled by the singular values. */
+static void jacobi_svd(double *g, int32_t m, int32_t n, double *vt) {
+    memset(vt, 0, sizeof(double) * (size_t) n * n);
+    for (int32_t i = 0; i < n; i++) vt[(size_t) i * n + i] = 1.0;
+    for (int sweep = 0; sweep < 60; sweep++) {
+        int rotated = 0;
+        for (int32_t p = 0; p < n - 1; p++) {
+            double *gp = g + (size_t) p * m;
+            for (int32_t q = p + 1; q < n; q++) {
+                double *gq = g + (size_t) q * m;
+                double alpha = 0.0, beta = 0.0, gamma = 0.0;
+                for (int32_t i = 0; i < m; i++) {
+                    alpha += gp[i] * gp[i];
+                    beta += gq[i] * gq[i];
+                    gamma += gp[i] * gq[i];
+                }
+                if (gamma == 0.0 || fabs(gamma) <= DBL_EPSILON * sqrt(alpha * beta)) continue;
+                rotated = 1;
+                double zeta = (beta - alpha) / (2.0 * gamma);
+                double tn = copysign(1.0, zeta) / (fabs(zeta) + sqrt(1.0 + zeta * zeta));
+                double c = 1.0 / sqrt(1.0 + tn * tn);
+                double s = c * tn;
+                for (int32_t i = 0; i < m; i++) {
+                    double x = gp[i];
+                    double y = gq[i];
+                    gp[i] = c * x - s * y;
+                    gq[i] = s * x + c * y;
+                }
+                double *vp = vt + (size_t) p * n;
+                double *vq = vt + (size_t) q * n;
+                for (int32_t i = 0; i < n; i++) {
+                    double x = vp[i];
+                    double y = vq[i];
+                    vp[i] = c * x - s * y;
+                    vq[i] = s * x + c * y;
+                }
+            }
+        }
+        if (!rotated) break;
+    }
+}
+
+JANET_FN(cfun_cmath_matrix,
+        "(math/matrix rows cols &opt init)",
+        "Create a native dense matrix of `rows` x `cols` 64-bit floats stored in row-major order. "
+        "`init` can be a number to fill the matrix with, or an f64 typed array of exactly "
+        "`rows` * `cols` elements whose storage is shared with the matrix. "
+        "Without `init` the matrix is filled with zeros. Requires spork/tarray.") {
+    janet_arity(argc, 2, 3);
+    int32_t rows = janet_getnat(argv, 0);
+    int32_t cols = janet_getnat(argv, 1);
+    if (argc < 3 || janet_checktype(argv[2], JANET_NIL)) {
+        return janet_wrap_abstract(matrix_new(rows, cols));
+    }
+    if (janet_checktype(argv[2], JANET_NUMBER)) {
+        Matrix *m = matrix_new(rows, cols);
+        double x = janet_unwrap_number(argv[2]);
+        double *d = matrix_data(m);
+        for (size_t i = 0; i < matrix_count(m); i++) d[i] = x;
+        return janet_wrap_abstract(m);
+    }
+    JanetTArrayView *view = janet_checktarray_view(argv[2]);
+    if (view == NULL || view->type != JANET_TARRAY_TYPE_F64) {
+        janet_panicf("bad slot #2, expected number or f64 typed array, got %v", argv[2]);
+    }
+    if (view->stride != 1 && view->size > 1) {
+        janet_panic("bad slot #2, expected contiguous typed array");
+    }
+    if (view->size != (size_t) rows * (size_t) cols) {
+        janet_panicf("bad slot #2, expected typed array of %d elements, got %d",
+                     rows * cols, (int32_t) view->size);
+    }
+    return janet_wrap_abstract(matrix_wrap(rows, cols, view));
+}
+
+JANET_FN(cfun_cmath_matrixp,
+        "(math/matrix? x)",
+        "Check if `x` is a native matrix.") {
+    janet_fixarity(argc, 1);
+    return janet_wrap_boolean(janet_checkabstract(argv[0], &matrix_type) != NULL);
+}
+
+JANET_FN(cfun_cmath_rows_to_matrix,
+        "(math/rows->matrix m)",
+        "Create a native matrix from an indexed collection of equally long rows of numbers.") {
+    janet_fixarity(argc, 1);
+    JanetView rows = janet_getindexed(argv, 0);
+    int32_t cols = 0;
+    if (rows.len > 0) {
+        JanetView first;
+        if (!janet_indexed_view(rows.items[0], &first.items, &first.len)) {
+            janet_panicf("expected row to be indexed, got %v", rows.items[0]);
+        }
+        cols = first.len;
+    }
+    Matrix *m = matrix_new(rows.len, cols);
+    double *d = matrix_data(m);
+    for (int32_t i = 0; i < rows.len; i++) {
+        JanetView row;
+        if (!janet_indexed_view(rows.items[i], &row.items, &row.len)) {
+            janet_panicf("expected row to be indexed, got %v", rows.items[i]);
+        }
+        if (row.len != cols) {
+            janet_panicf("row %d has %d columns, expected %d", i, row.len, cols);
+        }
+        for (int32_t j = 0; j < cols; j++) {
+            if (!janet_checktype(row.items[j], JANET_NUMBER)) {
+                janet_panicf("expected number at [%d %d], got %v", i, j, row.items[j]);
+            }
+            d[(size_t) i * cols + j] = janet_unwrap_number(row.items[j]);
+        }
+    }
+    return janet_wrap_abstract(m);
+}
+
+JANET_FN(cfun_cmath_matrix_to_rows,
+        "(math/matrix->rows m)",
+        "Convert a native matrix to an array of row arrays.") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getmatrix(argv, 0);
+    const double *d = matrix_data(m);
+    JanetArray *rows = janet_array(m->rows);
+    for (int32_t i = 0; i < m->rows; i++) {
+        JanetArray *row = janet_array(m->cols);
+        for (int32_t j = 0; j < m->cols; j++) {
+            row->data[j] = janet_wrap_number(d[(size_t) i * m->cols + j]);
+        }
+        row->count = m->cols;
+        janet_array_push(rows, janet_wrap_array(row));
+    }
+    return janet_wrap_array(rows);
+}
+
+JANET_FN(cfun_cmath_matrix_size,
+        "(math/matrix-size m)",
+        "Get the size of a native matrix as a tuple [rows cols].") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getmatrix(argv, 0);
+    Janet *t = janet_tuple_begin(2);
+    t[0] = janet_wrap_integer(m->rows);
+    t[1] = janet_wrap_integer(m->cols);
+    return janet_wrap_tuple(janet_tuple_end(t));
+}
+
+static size_t matrix_getindex(const Matrix *m, const Janet *argv) {
+    int32_t i = janet_getnat(argv, 1);
+    int32_t j = janet_getnat(argv, 2);
+    if (i >= m->rows || j >= m->cols) {
+        janet_panicf("index [%d %d] out of range for %dx%d matrix", i, j, m->rows, m->cols);
+    }
+    return (size_t) i * m->cols + j;
+}
+
+JANET_FN(cfun_cmath_matrix_get,
+        "(math/matrix-get m i j)",
+        "Get the element in row `i` and column `j` of a native matrix.") {
+    janet_fixarity(argc, 3);
+    Matrix *m = getmatrix(argv, 0);
+    return janet_wrap_number(matrix_data(m)[matrix_getindex(m, argv)]);
+}
+
+JANET_FN(cfun_cmath_matrix_set,
+        "(math/matrix-set m i j x)",
+        "Set the element in row `i` and column `j` of a native matrix to `x`. Returns `m`.") {
+    janet_fixarity(argc, 4);
+    Matrix *m = getmatrix(argv, 0);
+    size_t idx = matrix_getindex(m, argv);
+    matrix_data(m)[idx] = janet_getnumber(argv, 3);
+    return argv[0];
+}
+
+JANET_FN(cfun_cmath_matrix_view,
+        "(math/matrix-view m)",
+        "Get the f64 typed array holding the elements of a native matrix in row-major order. "
+        "Writes to the typed array are visible in the matrix.") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getmatrix(argv, 0);
+    return janet_wrap_abstract(m->view);
+}
+
+JANET_FN(cfun_cmath_matrix_copy,
+        "(math/matrix-copy m)",
+        "Create a copy of a native matrix with its own storage.") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getmatrix(argv, 0);
+    Matrix *res = matrix_new(m->rows, m->cols);
+    if (matrix_count(m) > 0) {
+        memcpy(matrix_data(res), matrix_data(m), sizeof(double) * matrix_count(m));
+    }
+    return janet_wrap_abstract(res);
+}
+
+JANET_FN(cfun_cmath_matrix_mul,
+        "(math/matrix-mul a b &opt into)",
+        "Multiply native matrices `a` and `b`. The result is written to the matrix `into` if "
+        "given, which must have the right size and must not share storage with `a` or `b`, "
+        "otherwise to a new matrix. Returns the result.") {
+    janet_arity(argc, 2, 3);
+    Matrix *a = getmatrix(argv, 0);
+    Matrix *b = getmatrix(argv, 1);
+    if (a->cols != b->rows) {
+        janet_panicf("cannot multiply %dx%d matrix by %dx%d matrix", a->rows, a->cols, b->rows, b->cols);
+    }
+    Matrix *c;
+    if (argc > 2 && !janet_checktype(argv[2], JANET_NIL)) {
+        c = getmatrix(argv, 2);
+        if (c->rows != a->rows || c->cols != b->cols) {
+            janet_panicf("expected %dx%d result matrix, got %dx%d", a->rows, b->cols, c->rows, c->cols);
+        }
+        if (matrix_overlaps(c, a) || matrix_overlaps(c, b)) {
+            janet_panic("result matrix must not share storage with an operand");
+        }
+    } else {
+        c = matrix_new(a->rows, b->cols);
+    }
+    gemm(matrix_data(a), matrix_data(b), matrix_data(c), a->rows, a->cols, b->cols);
+    return janet_wrap_abstract(c);
+}
+
+JANET_FN(cfun_cmath_matrix_trans,
+        "(math/matrix-trans m)",
+        "Create the transpose of a native matrix.") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getmatrix(argv, 0);
+    Matrix *t = matrix_new(m->cols, m->rows);
+    const double *src = matrix_data(m);
+    double *dst = matrix_data(t);
+    int32_t r = m->rows;
+    int32_t c = m->cols;
+    for (int32_t i0 = 0; i0 < r; i0 += 32) {
+        int32_t i1 = (r - i0 > 32) ? i0 + 32 : r;
+        for (int32_t j0 = 0; j0 < c; j0 += 32) {
+            int32_t j1 = (c - j0 > 32) ? j0 + 32 : c;
+            for (int32_t i = i0; i < i1; i++) {
+                for (int32_t j = j0; j < j1; j++) {
+                    dst[(size_t) j * r + i] = src[(size_t) i * c + j];
+                }
+            }
+        }
+    }
+    return janet_wrap_abstract(t);
+}
+
+JANET_FN(cfun_cmath_matrix_scale,
+        "(math/matrix-scale m k)",
+        "Multiply every element of a native matrix by the number `k` in place. Returns `m`.") {
+    janet_fixarity(argc, 2);
+    Matrix *m = getmatrix(argv, 0);
+    double k = janet_getnumber(argv, 1);
+    double *d = matrix_data(m);
+    for (size_t i = 0; i < matrix_count(m); i++) d[i] *= k;
+    return argv[0];
+}
+
+JANET_FN(cfun_cmath_matrix_add,
+        "(math/matrix-add m a)",
+        "Add `a` to a native matrix in place. `a` can be a number or a matrix of the same size. "
+        "Returns `m`.") {
+    janet_fixarity(argc, 2);
+    Matrix *m = getmatrix(argv, 0);
+    double *d = matrix_data(m);
+    if (janet_checktype(argv[1], JANET_NUMBER)) {
+        double x = janet_unwrap_number(argv[1]);
+        for (size_t i = 0; i < matrix_count(m); i++) d[i] += x;
+    } else {
+        Matrix *a = getmatrix(argv, 1);
+        matrix_check_same_size(m, a);
+        const double *s = matrix_data(a);
+        for (size_t i = 0; i < matrix_count(m); i++) d[i] += s[i];
+    }
+    return argv[0];
+}
+
+JANET_FN(cfun_cmath_matrix_emul,
+        "(math/matrix-emul m a)",
+        "Multiply a native matrix element-wise by the matrix `a` of the same size in place. "
+        "Returns `m`.") {
+    janet_fixarity(argc, 2);
+    Matrix *m = getmatrix(argv, 0);
+    Matrix *a = getmatrix(argv, 1);
+    matrix_check_same_size(m, a);
+    double *d = matrix_data(m);
+    const double *s = matrix_data(a);
+    for (size_t i = 0; i < matrix_count(m); i++) d[i] *= s[i];
+    return argv[0];
+}
+
+static Matrix *getsquare(const Janet *argv, int32_t n) {
+    Matrix *m = getmatrix(argv, n);
+    if (m->rows != m->cols) {
+        janet_panicf("bad slot #%d, expected square matrix, got %dx%d", n, m->rows, m->cols);
+    }
+    return m;
+}
+
+static Janet matrix_struct(const char *k1, Matrix *m1, const char *k2, Matrix *m2,
+                           const char *k3, Matrix *m3) {
+    JanetKV *st = janet_struct_begin(m3 ? 3 : 2);
+    janet_struct_put(st, janet_ckeywordv(k1), janet_wrap_abstract(m1));
+    janet_struct_put(st, janet_ckeywordv(k2), janet_wrap_abstract(m2));
+    if (m3) janet_struct_put(st, janet_ckeywordv(k3), janet_wrap_abstract(m3));
+    return janet_wrap_struct(janet_struct_end(st));
+}
+
+JANET_FN(cfun_cmath_matrix_det,
+        "(math/matrix-det m)",
+        "Compute the determinant of a square native matrix from its LU decomposition.") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getsquare(argv, 0);
+    int32_t n = m->rows;
+    if (n == 0) return janet_wrap_number(1.0);
+    double *lu = scratch_copy(matrix_data(m), matrix_count(m));
+    int32_t *perm = janet_smalloc(sizeof(int32_t) * n);
+    double det = lu_factor(lu, n, perm);
+    for (int32_t i = 0; det != 0.0 && i < n; i++) det *= lu[(size_t) i * n + i];
+    janet_sfree(perm);
+    janet_sfree(lu);
+    return janet_wrap_number(det);
+}
+
+JANET_FN(cfun_cmath_matrix_lu,
+        "(math/matrix-lu m)",
+        "LU decomposition of a square native matrix with partial pivoting. Returns a struct "
+        "with the unit lower triangular matrix `:L`, the upper triangular matrix `:U` and the "
+        "permutation matrix `:P` such that P * m = L * U.") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getsquare(argv, 0);
+    int32_t n = m->rows;
+    Matrix *l = matrix_new(n, n);
+    Matrix *u = matrix_new(n, n);
+    Matrix *p = matrix_new(n, n);
+    if (n > 0) {
+        double *lu = scratch_copy(matrix_data(m), matrix_count(m));
+        int32_t *perm = janet_smalloc(sizeof(int32_t) * n);
+        lu_factor(lu, n, perm);
+        double *ld = matrix_data(l);
+        double *ud = matrix_data(u);
+        double *pd = matrix_data(p);
+        for (int32_t i = 0; i < n; i++) {
+            for (int32_t j = 0; j < n; j++) {
+                double x = lu[(size_t) i * n + j];
+                if (j < i) ld[(size_t) i * n + j] = x;
+                else ud[(size_t) i * n + j] = x;
+            }
+            ld[(size_t) i * n + i] = 1.0;
+            pd[(size_t) i * n + perm[i]] = 1.0;
+        }
+        janet_sfree(perm);
+        janet_sfree(lu);
+    }
+    return matrix_struct("L", l, "U", u, "P", p);
+}
+
+/* x = P b for the n x k matrix b. */
+static void permute_rows(const double *b, const int32_t *perm, int32_t n, int32_t k, double *x) {
+    for (int32_t i = 0; i < n; i++) {
+        memcpy(x + (size_t) i * k, b + (size_t) perm[i] * k, sizeof(double) * k);
+    }
+}
+
+/* Factor a, treating pivots lost in rounding error as zero, so that exactly
+ * singular input does not solve to huge garbage. */
+static double *lu_or_panic(const Matrix *a, int32_t *perm) {
+    int32_t n = a->rows;
+    double *lu = scratch_copy(matrix_data(a), matrix_count(a));
+    double amax = 0.0;
+    for (size_t i = 0; i < matrix_count(a); i++) {
+        double v = fabs(lu[i]);
+        if (v > amax) amax = v;
+    }
+    double tol = amax * DBL_EPSILON * n;
+    int singular = lu_factor(lu, n, perm) == 0;
+    for (int32_t i = 0; !singular && i < n; i++) {
+        singular = !(fabs(lu[(size_t) i * n + i]) > tol);
+    }
+    if (singular) {
+        janet_sfree(lu);
+        janet_panic("matrix is singular");
+    }
+    return lu;
+}
+
+JANET_FN(cfun_cmath_matrix_solve,
+        "(math/matrix-solve a b)",
+        "Solve the linear system a * x = b for x, where `a` is a square native matrix and `b` "
+        "a native matrix with as many rows as `a`. Each column of `b` is a right hand side. "
+        "Raises an error if `a` is singular.") {
+    janet_fixarity(argc, 2);
+    Matrix *a = getsquare(argv, 0);
+    Matrix *b = getmatrix(argv, 1);
+    if (b->rows != a->rows) {
+        janet_panicf("expected right hand side with %d rows, got %d", a->rows, b->rows);
+    }
+    int32_t n = a->rows;
+    Matrix *x = matrix_new(n, b->cols);
+    if (n == 0) return janet_wrap_abstract(x);
+    int32_t *perm = janet_smalloc(sizeof(int32_t) * n);
+    double *lu = lu_or_panic(a, perm);
+    permute_rows(matrix_data(b), perm, n, b->cols, matrix_data(x));
+    lu_solve(lu, n, matrix_data(x), b->cols);
+    janet_sfree(lu);
+    janet_sfree(perm);
+    return janet_wrap_abstract(x);
+}
+
+JANET_FN(cfun_cmath_matrix_inverse,
+        "(math/matrix-inverse m)",
+        "Compute the inverse of a square native matrix. Raises an error if `m` is singular.") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getsquare(argv, 0);
+    int32_t n = m->rows;
+    Matrix *x = matrix_new(n, n);
+    if (n == 0) return janet_wrap_abstract(x);
+    int32_t *perm = janet_smalloc(sizeof(int32_t) * n);
+    double *lu = lu_or_panic(m, perm);
+    double *xd = matrix_data(x);
+    for (int32_t i = 0; i < n; i++) xd[(size_t) i * n + perm[i]] = 1.0;
+    lu_solve(lu, n, xd, n);
+    janet_sfree(lu);
+    janet_sfree(perm);
+    return janet_wrap_abstract(x);
+}
+
+JANET_FN(cfun_cmath_matrix_cholesky,
+        "(math/matrix-cholesky m)",
+        "Cholesky decomposition of a symmetric positive definite native matrix. Returns the "
+        "lower triangular matrix L such that m = L * L', reading only the lower triangle of "
+        "`m`. Raises an error if `m` is not positive definite.") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getsquare(argv, 0);
+    int32_t n = m->rows;
+    Matrix *l = matrix_new(n, n);
+    const double *a = matrix_data(m);
+    double *ld = matrix_data(l);
+    for (int32_t i = 0; i < n; i++) {
+        double *li = ld + (size_t) i * n;
+        for (int32_t j = 0; j <= i; j++) {
+            const double *lj = ld + (size_t) j * n;
+            double s = a[(size_t) i * n + j];
+            for (int32_t r = 0; r < j; r++) s -= li[r] * lj[r];
+            if (i == j) {
+                if (!(s > 0.0)) janet_panic("matrix is not positive definite");
+                li[i] = sqrt(s);
+            } else {
+                li[j] = s / lj[j];
+            }
+        }
+    }
+    return janet_wrap_abstract(l);
+}
+
+JANET_FN(cfun_cmath_matrix_qr,
+        "(math/matrix-qr m)",
+        "QR decomposition of an m x n native matrix by blocked Householder reflections. "
+        "Returns a struct with the m x m orthogonal matrix `:Q` and the m x n upper "
+        "triangular matrix `:R` such that m = Q * R.") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getmatrix(argv, 0);
+    int32_t rows = m->rows;
+    int32_t cols = m->cols;
+    Matrix *q = matrix_new(rows, rows);
+    Matrix *r = matrix_new(rows, cols);
+    double *a = scratch_copy(matrix_data(m), matrix_count(m));
+    int32_t k = rows < cols ? rows : cols;
+    double *tau = janet_smalloc(sizeof(double) * (k ? k : 1));
+    qr_factor(a, rows, cols, tau);
+    qr_form_q(a, rows, cols, tau, matrix_data(q));
+    double *rd = matrix_data(r);
+    for (int32_t i = 0; i < rows; i++) {
+        for (int32_t j = i; j < cols; j++) {
+            rd[(size_t) i * cols + j] = a[(size_t) i * cols + j];
+        }
+    }
+    janet_sfree(tau);
+    janet_sfree(a);
+    return matrix_struct("Q", q, "R", r, NULL, NULL);
+}
+
+/* Fill the rows of l (each rr long) flagged in `weak` with unit vectors
+ * orthogonal to all the other rows, which must already be orthonormal. */
+static void orthonormal_complete(double *l, int32_t rr, int32_t cc, const char *weak) {
+    double *x = janet_smalloc(sizeof(double) * (rr ? rr : 1));
+    double *best = janet_smalloc(sizeof(double) * (rr ? rr : 1));
+    char *done = janet_smalloc(cc ? cc : 1);
+    for (int32_t j = 0; j < cc; j++) done[j] = !weak[j];
+    for (int32_t j = 0; j < cc; j++) {
+        if (done[j]) continue;
+        double best_norm = -1.0;
+        for (int32_t e = 0; e < rr; e++) {
+            memset(x, 0, sizeof(double) * rr);
+            x[e] = 1.0;
+            for (int pass = 0; pass < 2; pass++) {
+                for (int32_t o = 0; o < cc; o++) {
+                    if (!done[o]) continue;
+                    const double *lo = l + (size_t) o * rr;
+                    double d = 0.0;
+                    for (int32_t i = 0; i < rr; i++) d += lo[i] * x[i];
+                    for (int32_t i = 0; i < rr; i++) x[i] -= d * lo[i];
+                }
+            }
+            double norm = 0.0;
+            for (int32_t i = 0; i < rr; i++) norm += x[i] * x[i];
+            if (norm > best_norm) {
+                best_norm = norm;
+                memcpy(best, x, sizeof(double) * rr);
+            }
+        }
+        double scale = 1.0 / sqrt(best_norm);
+        double *lj = l + (size_t) j * rr;
+        for (int32_t i = 0; i < rr; i++) lj[i] = best[i] * scale;
+        done[j] = 1;
+    }
+    janet_sfree(done);
+    janet_sfree(best);
+    janet_sfree(x);
+}
+
+JANET_FN(cfun_cmath_matrix_svd,
+        "(math/matrix-svd m)",
+        "Singular value decomposition of an m x n native matrix by one-sided Jacobi rotations. "
+        "With k = min(m, n), returns a struct with the m x k matrix `:U`, the k x k diagonal "
+        "matrix `:S` of singular values in decreasing order and the n x k matrix `:V` such that "
+        "m = U * S * V'.") {
+    janet_fixarity(argc, 1);
+    Matrix *m = getmatrix(argv, 0);
+    int32_t rows = m->rows;
+    int32_t cols = m->cols;
+    int tall = rows >= cols;
+    int32_t rr = tall ? rows : cols;
+    int32_t cc = tall ? cols : rows;
+    const double *a = matrix_data(m);
+    /* The rows of g are the columns of m, or of m' if m is wide. */
+    double *g = janet_smalloc(sizeof(double) * ((size_t) rr * cc + 1));
+    double *vt = janet_smalloc(sizeof(double) * ((size_t) cc * cc + 1));
+    if (tall) {
+        for (int32_t i = 0; i < rows; i++) {
+            for (int32_t j = 0; j < cols; j++) {
+                g[(size_t) j * rows + i] = a[(size_t) i * cols + j];
+            }
+        }
+    } else if (matrix_count(m) > 0) {
+        memcpy(g, a, sizeof(double) * matrix_count(m));
+    }
+    jacobi_svd(g, rr, cc, vt);
+    double *sigma = janet_smalloc(sizeof(double) * (cc ? cc : 1));
+    int32_t *order = janet_smalloc(sizeof(int32_t) * (cc ? cc : 1));
+    char *weak = janet_smalloc(cc ? cc : 1);
+    double smax = 0.0;
+    for (int32_t j = 0; j < cc; j++) {
+        double s = 0.0;
+        const double *gj = g + (size_t) j * rr;
+        for (int32_t i = 0; i < rr; i++) s += gj[i] * gj[i];
+        sigma[j] = sqrt(s);
+        if (sigma[j] > smax) smax = sigma[j];
+    }
+    for (int32_t j = 0; j < cc; j++) {
+        weak[j] = !(sigma[j] > smax * DBL_EPSILON * rr);
+        if (!weak[j]) {
+            double *gj = g + (size_t) j * rr;
+            for (int32_t i = 0; i < rr; i++) gj[i] /= sigma[j];
+        }
+    }
+    orthonormal_complete(g, rr, cc, weak);
+    for (int32_t j = 0; j < cc; j++) {
+        int32_t o = j;
+        while (o > 0 && sigma[order[o - 1]] < sigma[j]) {
+            order[o] = order[o - 1];
+            o--;
+        }
+        order[o] = j;
+    }
+    Matrix *u = matrix_new(rows, cc);
+    Matrix *s = matrix_new(cc, cc);
+    Matrix *v = matrix_new(cols, cc);
+    double *left = matrix_data(tall ? u : v);
+    double *right = matrix_data(tall ? v : u);
+    double *sd = matrix_data(s);
+    for (int32_t j = 0; j < cc; j++) {
+        int32_t o = order[j];
+        sd[(size_t) j * cc + j] = sigma[o];
+        for (int32_t i = 0; i < rr; i++) left[(size_t) i * cc + j] = g[(size_t) o * rr + i];
+        for (int32_t i = 0; i < cc; i++) right[(size_t) i * cc + j] = vt[(size_t) o * cc + i];
+    }
+    janet_sfree(weak);
+    janet_sfree(order);
+    janet_sfree(sigma);
+    janet_sfree(vt);
+    janet_sfree(g);
+    return matrix_struct("U", u, "S", s, "V", v);
+}
+
+static const JanetMethod matrix_methods[] = {
+    {"get", cfun_cmath_matrix_get},
+    {"set", cfun_cmath_matrix_set},
+    {"size", cfun_cmath_matrix_size},
+    {NULL, NULL}
+};
+
+static int matrix_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD)) return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), matrix_methods, out);
+}
+
+/* Streaming statistics */
+
+/* Call fn for every sample in x, which can be a number, an indexed
+ * collection of numbers or a typed array. NaN samples are skipped. */
+typedef void (*SampleFn)(void *ctx, double x);
+
+static double tarray_get(const JanetTArrayView *view, size_t i) {
+    size_t k = i * view->stride;
+    switch (view->type) {
+        case JANET_TARRAY_TYPE_U8:
+            return view->as.u8[k];
+        case JANET_TARRAY_TYPE_S8:
+            return view->as.s8[k];
+        case JANET_TARRAY_TYPE_U16:
+            return view->as.u16[k];
+        case JANET_TARRAY_TYPE_S16:
+            return view->as.s16[k];
+        case JANET_TARRAY_TYPE_U32:
+            return view->as.u32[k];
+        case JANET_TARRAY_TYPE_S32:
+            return view->as.s32[k];
+        case JANET_TARRAY_TYPE_U64:
+            return (double) view->as.u64[k];
+        case JANET_TARRAY_TYPE_S64:
+            return (double) view->as.s64[k];
+        case JANET_TARRAY_TYPE_F32:
+            return view->as.f32[k];
+        default:
+            return view->as.f64[k];
+    }
+}
+
+static void each_sample(const Janet *argv, int32_t n, SampleFn fn, void *ctx) {
+    Janet x = argv[n];
+    if (janet_checktype(x, JANET_NUMBER)) {
+        double d = janet_unwrap_number(x);
+        if (!isnan(d)) fn(ctx, d);
+        return;
+    }
+    JanetTArrayView *view = janet_checktarray_view(x);
+    if (view != NULL) {
+        for (size_t i = 0; i < view->size; i++) {
+            double d = tarray_get(view, i);
+            if (!isnan(d)) fn(ctx, d);
+        }
+        return;
+    }
+    const Janet *items;
+    int32_t len;
+    if (!janet_indexed_view(x, &items, &len)) {
+        janet_panicf("bad slot #%d, expected number, indexed or typed array, got %v", n, x);
+    }
+    for (int32_t i = 0; i < len; i++) {
+        if (!janet_checktype(items[i], JANET_NUMBER)) {
+            janet_panicf("expected number, got %v", items[i]);
+        }
+        double d = janet_unwrap_number(items[i]);
+        if (!isnan(d)) fn(ctx, d);
+    }
+}
+
+static void marshal_double(JanetMarshalContext *ctx, double x) {
+    janet_marshal_janet(ctx, janet_wrap_number(x));
+}
+
+static double unmarshal_double(JanetMarshalContext *ctx) {
+    Janet x = janet_unmarshal_janet(ctx);
+    if (!janet_checktype(x, JANET_NUMBER)) janet_panic("expected number");
+    return janet_unwrap_number(x);
+}
+
+/* Running moments, updated one sample at a time with Welford's method and
+ * merged with the pairwise formulas of Chan and Pebay. */
+typedef struct {
+    double n;
+    double mean;
+    double m2;
+    double m3;
+    double m4;
+    double min;
+    double max;
+    double sum;
+    double sum_c;
+} Stats;
+
+static int stats_get(void *p, Janet key, Janet *out);
+static void stats_marshal(void *p, JanetMarshalContext *ctx);
+static void *stats_unmarshal(JanetMarshalContext *ctx);
+
+static const JanetAbstractType stats_type = {
+    .name = "math/stats",
+    .get = stats_get,
+    .marshal = stats_marshal,
+    .unmarshal = stats_unmarshal
+};
+
+static void stats_init(Stats *s) {
+    s->n = 0.0;
+    s->mean = 0.0;
+    s->m2 = 0.0;
+    s->m3 = 0.0;
+    s->m4 = 0.0;
+    s->min = INFINITY;
+    s->max = -INFINITY;
+    s->sum = 0.0;
+    s->sum_c = 0.0;
+}
+
+/* Neumaier compensated summation */
+static void stats_sum(Stats *s, double x) {
+    double t = s->sum + x;
+    if (fabs(s->sum) >= fabs(x)) {
+        s->sum_c += (s->sum - t) + x;
+    } else {
+        s->sum_c += (x - t) + s->sum;
+    }
+    s->sum = t;
+}
+
+static void stats_push(void *ctx, double x) {
+    Stats *s = (Stats *) ctx;
+    double n1 = s->n;
+    double n = n1 + 1.0;
+    double delta = x - s->mean;
+    double delta_n = delta / n;
+    double delta_n2 = delta_n * delta_n;
+    double term1 = delta * delta_n * n1;
+    s->n = n;
+    s->mean += delta_n;
+    s->m4 += term1 * delta_n2 * (n * n - 3.0 * n + 3.0) + 6.0 * delta_n2 * s->m2 - 4.0 * delta_n * s->m3;
+    s->m3 += term1 * delta_n * (n - 2.0) - 3.0 * delta_n * s->m2;
+    s->m2 += term1;
+    if (x < s->min) s->min = x;
+    if (x > s->max) s->max = x;
+    stats_sum(s, x);
+}
+
+static void stats_merge(Stats *a, const Stats *b) {
+    if (b->n == 0.0) return;
+    if (a->n == 0.0) {
+        *a = *b;
+        return;
+    }
+    double na = a->n;
+    double nb = b->n;
+    double n = na + nb;
+    double d = b->mean - a->mean;
+    double d2 = d * d;
+    double m2 = a->m2 + b->m2 + d2 * na * nb / n;
+    double m3 = a->m3 + b->m3 + d2 * d * na * nb * (na - nb) / (n * n)
+                + 3.0 * d * (na * b->m2 - nb * a->m2) / n;
+    double m4 = a->m4 + b->m4 + d2 * d2 * na * nb * (na * na - na * nb + nb * nb) / (n * n * n)
+                + 6.0 * d2 * (na * na * b->m2 + nb * nb * a->m2) / (n * n)
+                + 4.0 * d * (na * b->m3 - nb * a->m3) / n;
+    a->mean += d * nb / n;
+    a->m2 = m2;
+    a->m3 = m3;
+    a->m4 = m4;
+    a->n = n;
+    if (b->min < a->min) a->min = b->min;
+    if (b->max > a->max) a->max = b->max;
+    stats_sum(a, b->sum);
+    a->sum_c += b->sum_c;
+}
+
+static void stats_marshal(void *p, JanetMarshalContext *ctx) {
+    Stats *s = (Stats *) p;
+    janet_marshal_abstract(ctx, p);
+    marshal_double(ctx, s->n);
+    marshal_double(ctx, s->mean);
+    marshal_double(ctx, s->m2);
+    marshal_double(ctx, s->m3);
+    marshal_double(ctx, s->m4);
+    marshal_double(ctx, s->min);
+    marshal_double(ctx, s->max);
+    marshal_double(ctx, s->sum);
+    marshal_double(ctx, s->sum_c);
+}
+
+static void *stats_unmarshal(JanetMarshalContext *ctx) {
+    Stats *s = janet_unmarshal_abstract(ctx, sizeof(Stats));
+    s->n = unmarshal_double(ctx);
+    s->mean = unmarshal_double(ctx);
+    s->m2 = unmarshal_double(ctx);
+    s->m3 = unmarshal_double(ctx);
+    s->m4 = unmarshal_double(ctx);
+    s->min = unmarshal_double(ctx);
+    s->max = unmarshal_double(ctx);
+    s->sum = unmarshal_double(ctx);
+    s->sum_c = unmarshal_double(ctx);
+    return s;
+}
+
+JANET_FN(cfun_cmath_stats,
+        "(math/stats &opt xs)",
+        "Create an accumulator of count, sum, mean, variance, skewness, kurtosis, minimum and "
+        "maximum that is updated one sample at a time in constant memory. `xs` can be a number, "
+        "an indexed collection of numbers or a typed array of initial samples. "
+        "NaN samples are ignored. Accumulators can be merged and sent between threads.") {
+    janet_arity(argc, 0, 1);
+    Stats *s = janet_abstract(&stats_type, sizeof(Stats));
+    stats_init(s);
+    if (argc > 0 && !janet_checktype(argv[0], JANET_NIL)) each_sample(argv, 0, stats_push, s);
+    return janet_wrap_abstract(s);
+}
+
+JANET_FN(cfun_cmath_stats_add,
+        "(math/stats-add acc xs)",
+        "Add the samples `xs` to the accumulator `acc`. `xs` can be a number, an indexed "
+        "collection of numbers or a typed array. Returns `acc`.") {
+    janet_fixarity(argc, 2);
+    Stats *s = janet_getabstract(argv, 0, &stats_type);
+    each_sample(argv, 1, stats_push, s);
+    return argv[0];
+}
+
+JANET_FN(cfun_cmath_stats_merge,
+        "(math/stats-merge acc other)",
+        "Merge the accumulator `other` into `acc`, as if all its samples had been added to "
+        "`acc`. Returns `acc`.") {
+    janet_fixarity(argc, 2);
+    Stats *a = janet_getabstract(argv, 0, &stats_type);
+    Stats *b = janet_getabstract(argv, 1, &stats_type);
+    Stats copy = *b;
+    stats_merge(a, &copy);
+    return argv[0];
+}
+
+static void summary_put(JanetKV *st, const char *key, double x) {
+    janet_struct_put(st, janet_ckeywordv(key), janet_wrap_number(x));
+}
+
+JANET_FN(cfun_cmath_stats_summary,
+        "(math/stats-summary acc)",
+        "Get a struct with the `:count`, `:sum`, `:mean`, `:min`, `:max`, population `:variance`, "
+        "`:sample-variance`, `:standard-deviation`, sample `:skewness` and excess `:kurtosis` "
+        "of the samples in `acc`. Statistics that need more samples than were seen are NaN.") {
+    janet_fixarity(argc, 1);
+    Stats *s = janet_getabstract(argv, 0, &stats_type);
+    double n = s->n;
+    double nan = janet_unwrap_number(wrap_nan());
+    JanetKV *st = janet_struct_begin(10);
+    summary_put(st, "count", n);
+    summary_put(st, "sum", s->sum + s->sum_c);
+    summary_put(st, "mean", n > 0 ? s->mean : nan);
+    summary_put(st, "min", n > 0 ? s->min : nan);
+    summary_put(st, "max", n > 0 ? s->max : nan);
+    summary_put(st, "variance", n > 0 ? s->m2 / n : nan);
+    summary_put(st, "sample-variance", n > 1 ? s->m2 / (n - 1.0) : nan);
+    summary_put(st, "standard-deviation", n > 0 ? sqrt(s->m2 / n) : nan);
+    double sd = n > 1 ? sqrt(s->m2 / (n - 1.0)) : 0.0;
+    summary_put(st, "skewness", (n > 2 && sd > 0) ? n * s->m3 / ((n - 1.0) * (n - 2.0) * sd * sd * sd) : nan);
+    summary_put(st, "kurtosis", (n > 1 && s->m2 > 0) ? n * s->m4 / (s->m2 * s->m2) - 3.0 : nan);
+    return janet_wrap_struct(janet_struct_end(st));
+}
+
+static const JanetMethod stats_methods[] = {
+    {"add", cfun_cmath_stats_add},
+    {"merge", cfun_cmath_stats_merge},
+    {"summary", cfun_cmath_stats_summary},
+    {NULL, NULL}
+};
+
+static int stats_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD)) return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), stats_methods, out);
+}
+
+/* Paired samples and least squares */
+
+/* What to do with observations that have a NaN or nil in them. */
+typedef enum {
+    MISSING_SKIP,
+    MISSING_PROPAGATE,
+    MISSING_ERROR
+} MissingPolicy;
+
+static MissingPolicy optmissing(const Janet *argv, int32_t argc, int32_t n) {
+    if (argc <= n || janet_checktype(argv[n], JANET_NIL)) return MISSING_SKIP;
+    JanetKeyword kw = janet_getkeyword(argv, n);
+    if (!janet_cstrcmp(kw, "skip")) return MISSING_SKIP;
+    if (!janet_cstrcmp(kw, "propagate")) return MISSING_PROPAGATE;
+    if (!janet_cstrcmp(kw, "error")) return MISSING_ERROR;
+    janet_panicf("expected :skip, :propagate or :error, got %v", argv[n]);
+}
+
+/* A column of observations, either a typed array or an indexed collection
+ * of numbers where nil stands for a missing value. */
+typedef struct {
+    JanetTArrayView *view;
+    const Janet *items;
+    size_t len;
+} Column;
+
+static int column_check(Janet x, Column *c) {
+    c->view = janet_checktarray_view(x);
+    c->items = NULL;
+    if (c->view != NULL) {
+        c->len = c->view->size;
+        return 1;
+    }
+    int32_t len;
+    if (!janet_indexed_view(x, &c->items, &len)) return 0;
+    c->len = (size_t) len;
+    return 1;
+}
+
+static void column_get(const Janet *argv, int32_t n, Column *c) {
+    if (!column_check(argv[n], c)) {
+        janet_panicf("bad slot #%d, expected indexed or typed array, got %v", n, argv[n]);
+    }
+}
+
+static double column_at(const Column *c, size_t i) {
+    if (c->view != NULL) return tarray_get(c->view, i);
+    Janet x = c->items[i];
+    if (janet_checktype(x, JANET_NIL)) return janet_unwrap_number(wrap_nan());
+    if (!janet_checktype(x, JANET_NUMBER)) janet_panicf("expected number, got %v", x);
+    return janet_unwrap_number(x);
+}
+
+/* Running means and co-moments of (x, y) pairs, by Welford's method. */
+typedef struct {
+    double n;
+    double mx;
+    double my;
+    double m2x;
+    double m2y;
+    double cxy;
+} Paired;
+
+static void paired_push(Paired *p, double x, double y) {
+    p->n += 1.0;
+    double dx = x - p->mx;
+    double dy = y - p->my;
+    p->mx += dx / p->n;
+    p->my += dy / p->n;
+    p->m2x += dx * (x - p->mx);
+    p->m2y += dy * (y - p->my);
+    p->cxy += dx * (y - p->my);
+}
+
+JANET_FN(cfun_cmath_paired_stats,
+        "(math/paired-stats xs ys &opt missing)",
+        "Compute statistics of the paired observations in the columns `xs` and `ys` in a "
+        "single pass. Columns are typed arrays or indexed collections of numbers of equal "
+        "length. Returns a struct with the `:count` of pairs used, `:mean-x`, `:mean-y`, "
+        "the sample `:variance-x`, `:variance-y` and `:covariance`, the `:correlation`, and "
+        "the `:slope` and `:intercept` of the least squares line. `missing` decides what "
+        "happens to pairs with a NaN or nil in them: `:skip` them (the default), "
+        "`:propagate` NaN to every statistic, or raise an `:error`.") {
+    janet_arity(argc, 2, 3);
+    Column xs, ys;
+    column_get(argv, 0, &xs);
+    column_get(argv, 1, &ys);
+    if (xs.len != ys.len) {
+        janet_panicf("expected columns of equal length, got %d and %d",
+                     (int32_t) xs.len, (int32_t) ys.len);
+    }
+    MissingPolicy missing = optmissing(argv, argc, 2);
+    Paired p;
+    memset(&p, 0, sizeof(p));
+    int propagate = 0;
+    for (size_t i = 0; i < xs.len; i++) {
+        double x = column_at(&xs, i);
+        double y = column_at(&ys, i);
+        if (isnan(x) || isnan(y)) {
+            if (missing == MISSING_ERROR) janet_panicf("missing value at index %d", (int32_t) i);
+            if (missing == MISSING_PROPAGATE) propagate = 1;
+            continue;
+        }
+        paired_push(&p, x, y);
+    }
+    double n = p.n;
+    double nan = janet_unwrap_number(wrap_nan());
+    if (propagate) n = nan;
+    /* A single point gets a flat line through it, like linear-regression. */
+    double slope = n == 1 ? 0.0 : (n > 1 && p.m2x > 0) ? p.cxy / p.m2x : nan;
+    JanetKV *st = janet_struct_begin(9);
+    summary_put(st, "count", p.n);
+    summary_put(st, "mean-x", n > 0 ? p.mx : nan);
+    summary_put(st, "mean-y", n > 0 ? p.my : nan);
+    summary_put(st, "variance-x", n > 1 ? p.m2x / (n - 1.0) : nan);
+    summary_put(st, "variance-y", n > 1 ? p.m2y / (n - 1.0) : nan);
+    summary_put(st, "covariance", n > 1 ? p.cxy / (n - 1.0) : nan);
+    summary_put(st, "correlation", (n > 1 && p.m2x > 0 && p.m2y > 0) ? p.cxy / sqrt(p.m2x * p.m2y) : nan);
+    summary_put(st, "slope", slope);
+    summary_put(st, "intercept", n > 0 ? p.my - slope * p.mx : nan);
+    return janet_wrap_struct(janet_struct_end(st));
+}
+
+JANET_FN(cfun_cmath_least_squares,
+        "(math/least-squares a b &opt missing)",
+        "Find the x that minimizes |a * x - b| by a Householder QR decomposition of `a`. `a` "
+        "is a native matrix with one row per observation, or an indexed collection of columns "
+        "with one column per predictor, and `b` a column with a value per observation. "
+        "Columns are typed arrays or indexed collections of numbers. Add a column of ones to "
+        "`a` to fit an intercept. Returns a struct with the `:coefficients` x as an f64 typed "
+        "array, the `:residual-sum-of-squares` and the `:count` of observations used. "
+        "`missing` decides what happens to observations with a NaN or nil in them: `:skip` "
+        "them (the default), `:propagate` NaN to the results, or raise an `:error`. Raises "
+        "an error if the columns of `a` are linearly dependent.") {
+    janet_arity(argc, 2, 3);
+    Column b;
+    column_get(argv, 1, &b);
+    MissingPolicy missing = optmissing(argv, argc, 2);
+    Matrix *mat = janet_checkabstract(argv[0], &matrix_type);
+    Column *cols = NULL;
+    int32_t n;
+    if (mat != NULL) {
+        n = mat->cols;
+        if ((size_t) mat->rows != b.len) {
+            janet_panicf("expected %d observations in b, got %d", mat->rows, (int32_t) b.len);
+        }
+    } else {
+        JanetView view = janet_getindexed(argv, 0);
+        n = view.len;
+        cols = janet_smalloc(sizeof(Column) * (size_t)(n ? n : 1));
+        for (int32_t j = 0; j < n; j++) {
+            if (!column_check(view.items[j], &cols[j])) {
+                janet_panicf("expected column to be indexed or typed array, got %v", view.items[j]);
+            }
+            if (cols[j].len != b.len) {
+                janet_panicf("column %d has %d observations, expected %d",
+                             j, (int32_t) cols[j].len, (int32_t) b.len);
+            }
+        }
+    }
+    /* Gather the complete observations into a row-major copy. */
+    size_t rows = b.len;
+    double *a = janet_smalloc(sizeof(double) * (rows * (size_t) n + 1));
+    double *y = janet_smalloc(sizeof(double) * (rows + 1));
+    int32_t m = 0;
+    int propagate = 0;
+    for (size_t i = 0; i < rows; i++) {
+        double *row = a + (size_t) m * n;
+        y[m] = column_at(&b, i);
+        int complete = !isnan(y[m]);
+        for (int32_t j = 0; j < n; j++) {
+            row[j] = mat != NULL ? matrix_data(mat)[i * (size_t) n + j] : column_at(&cols[j], i);
+            if (isnan(row[j])) complete = 0;
+        }
+        if (complete) {
+            m++;
+        } else if (missing == MISSING_ERROR) {
+            janet_panicf("missing value in observation %d", (int32_t) i);
+        } else if (missing == MISSING_PROPAGATE) {
+            propagate = 1;
+        }
+    }
+    if (!propagate && m < n) {
+        janet_panicf("expected at least %d complete observations, got %d", n, m);
+    }
+    JanetTArrayView *coef = janet_tarray_view_new(JANET_TARRAY_TYPE_F64, (size_t) n);
+    double *x = coef->as.f64;
+    double rss = 0.0;
+    if (propagate) {
+        rss = janet_unwrap_number(wrap_nan());
+        for (int32_t j = 0; j < n; j++) x[j] = rss;
+    } else {
+        double *tau = janet_smalloc(sizeof(double) * (size_t)(n ? n : 1));
+        qr_factor(a, m, n, tau);
+        /* y = Q' y, one reflector at a time. */
+        for (int32_t j = 0; j < n; j++) {
+            if (tau[j] == 0.0) continue;
+            double s = y[j];
+            for (int32_t i = j + 1; i < m; i++) s += a[(size_t) i * n + j] * y[i];
+            s *= tau[j];
+            y[j] -= s;
+            for (int32_t i = j + 1; i < m; i++) y[i] -= s * a[(size_t) i * n + j];
+        }
+        double rmax = 0.0;
+        for (int32_t j = 0; j < n; j++) {
+            double r = fabs(a[(size_t) j * n + j]);
+            if (r > rmax) rmax = r;
+        }
+        double tol = rmax * DBL_EPSILON * (m > n ? m : n);
+        for (int32_t j = 0; j < n; j++) {
+            if (!(fabs(a[(size_t) j * n + j]) > tol)) {
+                janet_panic("columns are linearly dependent");
+            }
+        }
+        for (int32_t j = n - 1; j >= 0; j--) {
+            double s = y[j];
+            for (int32_t k = j + 1; k < n; k++) s -= a[(size_t) j * n + k] * x[k];
+            x[j] = s / a[(size_t) j * n + j];
+        }
+        for (int32_t i = n; i < m; i++) rss += y[i] * y[i];
+        janet_sfree(tau);
+    }
+    janet_sfree(y);
+    janet_sfree(a);
+    if (cols != NULL) janet_sfree(cols);
+    JanetKV *st = janet_struct_begin(3);
+    janet_struct_put(st, janet_ckeywordv("coefficients"), janet_wrap_abstract(coef));
+    summary_put(st, "residual-sum-of-squares", rss);
+    summary_put(st, "count", m);
+    return janet_wrap_struct(janet_struct_end(st));
+}
+
+/* Quantile selection */
+
+#define SELECT_SMALL 16
+
+static void select_insertion(double *a, size_t lo, size_t hi) {
+    for (size_t i = lo + 1; i < hi; i++) {
+        double x = a[i];
+        size_t j = i;
+        while (j > lo && a[j - 1] > x) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = x;
+    }
+}
+
+static void select_sift(double *a, size_t root, size_t n) {
+    for (;;) {
+        size_t child = 2 * root + 1;
+        if (child >= n) return;
+        if (child + 1 < n && a[child + 1] > a[child]) child++;
+        if (a[root] >= a[child]) return;
+        double t = a[root];
+        a[root] = a[child];
+        a[child] = t;
+        root = child;
+    }
+}
+
+static void select_heapsort(double *a, size_t n) {
+    for (size_t i = n / 2; i > 0; i--) select_sift(a, i - 1, n);
+    for (size_t end = n; end > 1; end--) {
+        double t = a[0];
+        a[0] = a[end - 1];
+        a[end - 1] = t;
+        select_sift(a, 0, end - 1);
+    }
+}
+
+static double median3(double x, double y, double z) {
+    if (x < y) {
+        if (y < z) return y;
+        return x < z ? z : x;
+    }
+    if (x < z) return x;
+    return y < z ? z : y;
+}
+
+/* Introselect for several order statistics at once. Puts the elements
+ * whose sorted positions are listed in ranks[rlo:rhi] (sorted ascending) at
+ * those positions in a[lo:hi]. Each three way partition sends the ranks on
+ * either side to their own half, and a range that partitions badly too many
+ * times is heapsorted instead. */
+static void select_ranks(double *a, size_t lo, size_t hi,
+                         const size_t *ranks, size_t rlo, size_t rhi, int depth) {
+    while (rlo < rhi) {
+        size_t n = hi - lo;
+        if (n <= SELECT_SMALL) {
+            select_insertion(a, lo, hi);
+            return;
+        }
+        if (depth-- <= 0) {
+            select_heapsort(a + lo, n);
+            return;
+        }
+        double pivot = median3(a[lo], a[lo + n / 2], a[hi - 1]);
+        size_t lt = lo, i = lo, gt = hi;
+        while (i < gt) {
+            double x = a[i];
+            if (x < pivot) {
+                a[i++] = a[lt];
+                a[lt++] = x;
+            } else if (x > pivot) {
+                a[i] = a[--gt];
+                a[gt] = x;
+            } else {
+                i++;
+            }
+        }
+        size_t r1 = rlo;
+        while (r1 < rhi && ranks[r1] < lt) r1++;
+        size_t r2 = r1;
+        while (r2 < rhi && ranks[r2] < gt) r2++;
+        if (lt - lo < hi - gt) {
+            select_ranks(a, lo, lt, ranks, rlo, r1, depth);
+            lo = gt;
+            rlo = r2;
+        } else {
+            select_ranks(a, gt, hi, ranks, r2, rhi, depth);
+            hi = lt;
+            rhi = r1;
+        }
+    }
+}
+
+static int size_cmp(const void *a, const void *b) {
+    size_t x = *(const size_t *) a;
+    size_t y = *(const size_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* The order statistics quantile-sorted in spork/math reads for p. */
+static int quantile_ranks(size_t n, double p, size_t *out) {
+    double idx = (double) n * p;
+    if (p == 1.0) {
+        out[0] = n - 1;
+        return 1;
+    }
+    if (p == 0.0) {
+        out[0] = 0;
+        return 1;
+    }
+    if (idx != floor(idx)) {
+        out[0] = (size_t) ceil(idx) - 1;
+        return 1;
+    }
+    if (n % 2 == 0) {
+        out[0] = (size_t) idx - 1;
+        out[1] = (size_t) idx;
+        return 2;
+    }
+    out[0] = (size_t) idx;
+    return 1;
+}
+
+static double quantile_value(const double *a, size_t n, double p) {
+    size_t r[2];
+    if (quantile_ranks(n, p, r) == 2) return (a[r[0]] + a[r[1]]) / 2.0;
+    return a[r[0]];
+}
+
+static double getprobability(Janet x) {
+    if (!janet_checktype(x, JANET_NUMBER)) janet_panicf("expected number, got %v", x);
+    double p = janet_unwrap_number(x);
+    if (!(p >= 0.0 && p <= 1.0)) janet_panic("quantile must be between 0 and 1");
+    return p;
+}
+
+static void push_sample(void *ctx, double x) {
+    double **cursor = (double **) ctx;
+    *(*cursor)++ = x;
+}
+
+/* Copy the samples in argv[n], less any NaNs, into scratch memory. */
+static double *copy_samples(const Janet *argv, int32_t n, size_t *count) {
+    size_t len = 1;
+    JanetTArrayView *ta = janet_checktarray_view(argv[n]);
+    const Janet *items;
+    int32_t ilen;
+    if (ta != NULL) {
+        len = ta->size;
+    } else if (janet_indexed_view(argv[n], &items, &ilen)) {
+        len = (size_t) ilen;
+    }
+    double *a = janet_smalloc(sizeof(double) * (len ? len : 1));
+    double *cursor = a;
+    each_sample(argv, n, push_sample, &cursor);
+    *count = (size_t)(cursor - a);
+    return a;
+}
+
+JANET_FN(cfun_cmath_quantiles,
+        "(math/quantiles xs &opt ps in-place)",
+        "Get the quantiles `ps` of the samples `xs` without sorting them, using introselect. "
+        "`xs` can be a typed array or an indexed collection of numbers. `ps` is a number "
+        "or an indexed collection of numbers between 0 and 1, and defaults to "
+        "[0.5 0.9 0.99 0.999]. All quantiles are found in one pass and match `math/quantile`. "
+        "NaN samples are ignored. If `in-place` is truthy and `xs` is a contiguous f64 typed "
+        "array, its elements are reordered instead of copied.") {
+    janet_arity(argc, 1, 3);
+    static const double default_ps[] = {0.5, 0.9, 0.99, 0.999};
+    int single = argc > 1 && janet_checktype(argv[1], JANET_NUMBER);
+    int32_t count = 4;
+    double *ps;
+    if (argc < 2 || janet_checktype(argv[1], JANET_NIL)) {
+        ps = janet_smalloc(sizeof(default_ps));
+        memcpy(ps, default_ps, sizeof(default_ps));
+    } else if (single) {
+        count = 1;
+        ps = janet_smalloc(sizeof(double));
+        ps[0] = getprobability(argv[1]);
+    } else {
+        JanetView view = janet_getindexed(argv, 1);
+        count = view.len;
+        ps = janet_smalloc(sizeof(double) * (count ? count : 1));
+        for (int32_t i = 0; i < count; i++) ps[i] = getprobability(view.items[i]);
+    }
+    int in_place = argc > 2 && janet_truthy(argv[2]);
+    JanetTArrayView *ta = janet_checktarray_view(argv[0]);
+    double *a;
+    size_t n;
+    if (in_place) {
+        if (ta == NULL || ta->type != JANET_TARRAY_TYPE_F64 || (ta->stride != 1 && ta->size > 1)) {
+            janet_panic("in-place selection needs a contiguous f64 typed array");
+        }
+        /* Move NaNs to the end. */
+        a = ta->as.f64;
+        n = 0;
+        for (size_t i = 0; i < ta->size; i++) {
+            double x = a[i];
+            if (isnan(x)) continue;
+            a[i] = a[n];
+            a[n++] = x;
+        }
+    } else {
+        a = copy_samples(argv, 0, &n);
+    }
+    if (n == 0) janet_panic("quantile requires at least one data point");
+    size_t *ranks = janet_smalloc(sizeof(size_t) * 2 * (count ? count : 1));
+    size_t nranks = 0;
+    for (int32_t i = 0; i < count; i++) {
+        nranks += quantile_ranks(n, ps[i], ranks + nranks);
+    }
+    qsort(ranks, nranks, sizeof(size_t), size_cmp);
+    size_t unique = 0;
+    for (size_t i = 0; i < nranks; i++) {
+        if (unique == 0 || ranks[unique - 1] != ranks[i]) ranks[unique++] = ranks[i];
+    }
+    int depth = 2;
+    for (size_t m = n; m > 1; m >>= 1) depth += 2;
+    select_ranks(a, 0, n, ranks, 0, unique, depth);
+    Janet result;
+    if (single) {
+        result = janet_wrap_number(quantile_value(a, n, ps[0]));
+    } else {
+        JanetArray *res = janet_array(count);
+        for (int32_t i = 0; i < count; i++) {
+            janet_array_push(res, janet_wrap_number(quantile_value(a, n, ps[i])));
+        }
+        result = janet_wrap_array(res);
+    }
+    janet_sfree(ranks);
+    if (!in_place) janet_sfree(a);
+    janet_sfree(ps);
+    return result;
+}
+
+/* Resampling */
+
+/* Iterations are run in fixed blocks, each with its own generator seeded
+ * from the seed and the block index. Results then only depend on the seed,
+ * not on how many workers there are or which one ran a block. */
+#define RESAMPLE_BLOCK 256
+
+/* xoshiro256** (Blackman and Vigna), seeded with splitmix64. */
+typedef struct {
+    uint64_t s[4];
+} ResampleRng;
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static void rng_seed(ResampleRng *rng, uint64_t seed, uint64_t block) {
+    uint64_t x = seed ^ splitmix64(&block);
+    for (int i = 0; i < 4; i++) rng->s[i] = splitmix64(&x);
+}
+
+static uint64_t rng_next(ResampleRng *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+}
+
+/* Uniform integer below n without modulo bias (Lemire). */
+static size_t rng_below(ResampleRng *rng, size_t n) {
+    uint64_t hi;
+    uint64_t lo = mul_wide(rng_next(rng), n, &hi);
+    if (lo < n) {
+        uint64_t threshold = (0 - (uint64_t) n) % n;
+        while (lo < threshold) lo = mul_wide(rng_next(rng), n, &hi);
+    }
+    return (size_t) hi;
+}
+
+static uint64_t optseed(const Janet *argv, int32_t argc, int32_t n) {
+    if (argc > n && !janet_checktype(argv[n], JANET_NIL)) return janet_getuinteger64(argv, n);
+    JanetRNG *rng = janet_default_rng();
+    uint64_t hi = janet_rng_u32(rng);
+    return (hi << 32) | janet_rng_u32(rng);
+}
+
+static size_t optiterations(const Janet *argv, int32_t argc, int32_t n) {
+    int32_t k = janet_optnat(argv, argc, n, 10000);
+    if (k == 0) janet_panic("expected a positive number of iterations");
+    return (size_t) k;
+}
+
+static int32_t resample_blocks(size_t iterations) {
+    return (int32_t)((iterations + RESAMPLE_BLOCK - 1) / RESAMPLE_BLOCK);
+}
+
+typedef enum {
+    ALTERNATIVE_TWO_SIDE,
+    ALTERNATIVE_GREATER,
+    ALTERNATIVE_LESSER
+} Alternative;
+
+static Alternative optalternative(const Janet *argv, int32_t argc, int32_t n) {
+    if (argc <= n || janet_checktype(argv[n], JANET_NIL)) return ALTERNATIVE_TWO_SIDE;
+    const uint8_t *kw = janet_getkeyword(argv, n);
+    if (!janet_cstrcmp(kw, "two-side")) return ALTERNATIVE_TWO_SIDE;
+    if (!janet_cstrcmp(kw, "greater")) return ALTERNATIVE_GREATER;
+    if (!janet_cstrcmp(kw, "lesser")) return ALTERNATIVE_LESSER;
+    janet_panicf("expected :two-side, :greater or :lesser, got %v", argv[n]);
+}
+
+typedef struct {
+    const double *pooled;
+    size_t n;
+    size_t nx;
+    size_t k;
+    int k_is_x;
+    double total;
+    double observed;
+    Alternative alternative;
+    uint64_t seed;
+    size_t iterations;
+    int64_t *hits;
+} PermutationJob;
+
+/* Difference of the means given the sum of the k samples drawn for the
+ * smaller side. */
+static double permutation_statistic(const PermutationJob *p, double s) {
+    double ny = (double)(p->n - p->nx);
+    double sx = p->k_is_x ? s : p->total - s;
+    return sx / (double) p->nx - (p->total - sx) / ny;
+}
+
+static void permutation_job(void *ctx, int32_t job) {
+    PermutationJob *p = (PermutationJob *) ctx;
+    size_t first = (size_t) job * RESAMPLE_BLOCK;
+    size_t count = p->iterations - first;
+    if (count > RESAMPLE_BLOCK) count = RESAMPLE_BLOCK;
+    double *a = janet_malloc(sizeof(double) * p->n);
+    if (a == NULL) {
+        p->hits[job] = -1;
+        return;
+    }
+    memcpy(a, p->pooled, sizeof(double) * p->n);
+    ResampleRng rng;
+    rng_seed(&rng, p->seed, (uint64_t) job);
+    double observed = p->observed;
+    int64_t hits = 0;
+    for (size_t it = 0; it < count; it++) {
+        /* A partial Fisher-Yates shuffle picks a uniform random subset for
+         * the smaller side, whatever order the block left the pool in. */
+        double s = 0.0;
+        for (size_t i = 0; i < p->k; i++) {
+            size_t j = i + rng_below(&rng, p->n - i);
+            double t = a[j];
+            a[j] = a[i];
+            a[i] = t;
+            s += t;
+        }
+        double d = permutation_statistic(p, s);
+        switch (p->alternative) {
+            case ALTERNATIVE_TWO_SIDE:
+                hits += fabs(d) >= fabs(observed);
+                break;
+            case ALTERNATIVE_GREATER:
+                hits += d >= observed;
+                break;
+            case ALTERNATIVE_LESSER:
+                hits += d <= observed;
+                break;
+        }
+    }
+    janet_free(a);
+    p->hits[job] = hits;
+}
+
+JANET_FN(cfun_cmath_permutation_test,
+        "(math/permutation-test xs ys &opt alternative k seed workers)",
+        "Conducts a permutation test to determine if two data sets `xs` and `ys` "
+        "are *significantly* different from each other, using the difference of their means. "
+        "`alternative` is `:two-side` (the default), `:greater` or `:lesser`. Returns the "
+        "fraction of `k` random relabelings (default 10000) whose difference is at least as "
+        "extreme as the observed one. The permutations run on up to `workers` threads "
+        "(default the number of cpus). With the same 64 bit `seed` the result is the same "
+        "for any number of workers. NaN samples are ignored.") {
+    janet_arity(argc, 2, 6);
+    size_t nx, ny;
+    double *xs = copy_samples(argv, 0, &nx);
+    double *ys = copy_samples(argv, 1, &ny);
+    Alternative alternative = optalternative(argv, argc, 2);
+    size_t iterations = optiterations(argv, argc, 3);
+    uint64_t seed = optseed(argv, argc, 4);
+    int32_t workers = spork_optworkers(argv, argc, 5);
+    if (nx == 0 || ny == 0) janet_panic("expected at least one sample on each side");
+    PermutationJob p;
+    p.n = nx + ny;
+    p.nx = nx;
+    p.k_is_x = nx <= ny;
+    p.k = p.k_is_x ? nx : ny;
+    double *pooled = janet_smalloc(sizeof(double) * p.n);
+    memcpy(pooled, xs, sizeof(double) * nx);
+    memcpy(pooled + nx, ys, sizeof(double) * ny);
+    double s = 0.0, total = 0.0;
+    for (size_t i = 0; i < p.n; i++) total += pooled[i];
+    for (size_t i = 0; i < p.k; i++) s += p.k_is_x ? xs[i] : ys[i];
+    p.pooled = pooled;
+    p.total = total;
+    p.observed = permutation_statistic(&p, s);
+    p.alternative = alternative;
+    p.seed = seed;
+    p.iterations = iterations;
+    int32_t blocks = resample_blocks(iterations);
+    p.hits = janet_smalloc(sizeof(int64_t) * (size_t) blocks);
+    spork_parallel_for(workers, blocks, permutation_job, &p);
+    int64_t hits = 0;
+    int oom = 0;
+    for (int32_t i = 0; i < blocks; i++) {
+        if (p.hits[i] < 0) oom = 1;
+        hits += p.hits[i];
+    }
+    janet_sfree(p.hits);
+    janet_sfree(pooled);
+    janet_sfree(ys);
+    janet_sfree(xs);
+    if (oom) JANET_OUT_OF_MEMORY;
+    return janet_wrap_number((double) hits / (double) iterations);
+}
+
+typedef enum {
+    RESAMPLE_MEAN,
+    RESAMPLE_MEDIAN,
+    RESAMPLE_VARIANCE,
+    RESAMPLE_SAMPLE_VARIANCE,
+    RESAMPLE_STANDARD_DEVIATION,
+    RESAMPLE_SAMPLE_STANDARD_DEVIATION
+} ResampleStatistic;
+
+static ResampleStatistic optstatistic(const Janet *argv, int32_t argc, int32_t n) {
+    if (argc <= n || janet_checktype(argv[n], JANET_NIL)) return RESAMPLE_MEAN;
+    const uint8_t *kw = janet_getkeyword(argv, n);
+    if (!janet_cstrcmp(kw, "mean")) return RESAMPLE_MEAN;
+    if (!janet_cstrcmp(kw, "median")) return RESAMPLE_MEDIAN;
+    if (!janet_cstrcmp(kw, "variance")) return RESAMPLE_VARIANCE;
+    if (!janet_cstrcmp(kw, "sample-variance")) return RESAMPLE_SAMPLE_VARIANCE;
+    if (!janet_cstrcmp(kw, "standard-deviation")) return RESAMPLE_STANDARD_DEVIATION;
+    if (!janet_cstrcmp(kw, "sample-standard-deviation")) return RESAMPLE_SAMPLE_STANDARD_DEVIATION;
+    janet_panicf("expected :mean, :median, :variance, :sample-variance, :standard-deviation "
+                 "or :sample-standard-deviation, got %v", argv[n]);
+}
+
+/* The statistic of n > 0 samples, matching the spork/math function of the
+ * same name. The median reorders a. */
+static double resample_statistic(double *a, size_t n, ResampleStatistic stat) {
+    if (stat == RESAMPLE_MEDIAN) {
+        size_t ranks[2];
+        size_t nranks = (size_t) quantile_ranks(n, 0.5, ranks);
+        int depth = 2;
+        for (size_t m = n; m > 1; m >>= 1) depth += 2;
+        select_ranks(a, 0, n, ranks, 0, nranks, depth);
+        return quantile_value(a, n, 0.5);
+    }
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) sum += a[i];
+    double mean = sum / (double) n;
+    if (stat == RESAMPLE_MEAN) return mean;
+    double ss = 0.0;
+    for (size_t i = 0; i < n; i++) ss += (a[i] - mean) * (a[i] - mean);
+    switch (stat) {
+        default:
+        case RESAMPLE_VARIANCE:
+            return ss / (double) n;
+        case RESAMPLE_SAMPLE_VARIANCE:
+            return ss / (double)(n - 1);
+        case RESAMPLE_STANDARD_DEVIATION:
+            return sqrt(ss / (double) n);
+        case RESAMPLE_SAMPLE_STANDARD_DEVIATION:
+            return sqrt(ss / (double)(n - 1));
+    }
+}
+
+typedef struct {
+    const double *xs;
+    size_t n;
+    ResampleStatistic stat;
+    uint64_t seed;
+    size_t iterations;
+    double *out;
+    uint8_t *failed;
+} BootstrapJob;
+
+static void bootstrap_job(void *ctx, int32_t job) {
+    BootstrapJob *b = (BootstrapJob *) ctx;
+    size_t first = (size_t) job * RESAMPLE_BLOCK;
+    size_t count = b->iterations - first;
+    if (count > RESAMPLE_BLOCK) count = RESAMPLE_BLOCK;
+    double *a = janet_malloc(sizeof(double) * b->n);
+    if (a == NULL) {
+        b->failed[job] = 1;
+        return;
+    }
+    ResampleRng rng;
+    rng_seed(&rng, b->seed, (uint64_t) job);
+    for (size_t it = 0; it < count; it++) {
+        for (size_t i = 0; i < b->n; i++) a[i] = b->xs[rng_below(&rng, b->n)];
+        b->out[first + it] = resample_statistic(a, b->n, b->stat);
+    }
+    janet_free(a);
+    b->failed[job] = 0;
+}
+
+/* Fill out with `iterations` bootstrap replicates of a statistic of xs. */
+static void bootstrap_run(const double *xs, size_t n, ResampleStatistic stat, size_t iterations,
+                          uint64_t seed, int32_t workers, double *out) {
+    size_t min = (stat == RESAMPLE_SAMPLE_VARIANCE || stat == RESAMPLE_SAMPLE_STANDARD_DEVIATION) ? 2 : 1;
+    if (n < min) janet_panicf("expected at least %d samples, got %d", (int32_t) min, (int32_t) n);
+    BootstrapJob b;
+    b.xs = xs;
+    b.n = n;
+    b.stat = stat;
+    b.seed = seed;
+    b.iterations = iterations;
+    b.out = out;
+    int32_t blocks = resample_blocks(iterations);
+    b.failed = janet_smalloc((size_t) blocks);
+    spork_parallel_for(workers, blocks, bootstrap_job, &b);
+    int oom = 0;
+    for (int32_t i = 0; i < blocks; i++) oom |= b.failed[i];
+    janet_sfree(b.failed);
+    if (oom) JANET_OUT_OF_MEMORY;
+}
+
+JANET_FN(cfun_cmath_bootstrap,
+        "(math/bootstrap xs &opt statistic k seed workers)",
+        "Resample `xs` with replacement `k` times (default 10000) and return an f64 typed "
+        "array of the `statistic` of each resample. `statistic` is one of `:mean` (the "
+        "default), `:median`, `:variance`, `:sample-variance`, `:standard-deviation` or "
+        "`:sample-standard-deviation`. Resamples are drawn on up to `workers` threads "
+        "(default the number of cpus). With the same 64 bit `seed` the result is the same "
+        "for any number of workers. NaN samples are ignored. Requires spork/tarray.") {
+    janet_arity(argc, 1, 5);
+    size_t n;
+    double *xs = copy_samples(argv, 0, &n);
+    ResampleStatistic stat = optstatistic(argv, argc, 1);
+    size_t iterations = optiterations(argv, argc, 2);
+    uint64_t seed = optseed(argv, argc, 3);
+    int32_t workers = spork_optworkers(argv, argc, 4);
+    JanetTArrayView *out = janet_tarray_view_new(JANET_TARRAY_TYPE_F64, iterations);
+    bootstrap_run(xs, n, stat, iterations, seed, workers, out->as.f64);
+    janet_sfree(xs);
+    return janet_wrap_abstract(out);
+}
+
+JANET_FN(cfun_cmath_bootstrap_ci,
+        "(math/bootstrap-ci xs &opt statistic confidence k seed workers)",
+        "Estimate a percentile bootstrap confidence interval for the `statistic` of `xs` "
+        "from `k` resamples, as with `math/bootstrap`. `confidence` defaults to 0.95. "
+        "Returns a struct with the `:estimate` from `xs` itself and the `:lower` and "
+        "`:upper` bounds of the interval.") {
+    janet_arity(argc, 1, 6);
+    size_t n;
+    double *xs = copy_samples(argv, 0, &n);
+    ResampleStatistic stat = optstatistic(argv, argc, 1);
+    double confidence = janet_optnumber(argv, argc, 2, 0.95);
+    if (!(confidence > 0.0 && confidence < 1.0)) {
+        janet_panic("confidence must be between 0 and 1");
+    }
+    size_t iterations = optiterations(argv, argc, 3);
+    uint64_t seed = optseed(argv, argc, 4);
+    int32_t workers = spork_optworkers(argv, argc, 5);
+    double *reps = janet_smalloc(sizeof(double) * iterations);
+    bootstrap_run(xs, n, stat, iterations, seed, workers, reps);
+    double estimate = resample_statistic(xs, n, stat);
+    double ps[2] = {(1.0 - confidence) / 2.0, (1.0 + confidence) / 2.0};
+    size_t ranks[4];
+    size_t nranks = (size_t) quantile_ranks(iterations, ps[0], ranks);
+    nranks += (size_t) quantile_ranks(iterations, ps[1], ranks + nranks);
+    size_t unique = 0;
+    for (size_t i = 0; i < nranks; i++) {
+        if (unique == 0 || ranks[unique - 1] != ranks[i]) ranks[unique++] = ranks[i];
+    }
+    int depth = 2;
+    for (size_t m = iterations; m > 1; m >>= 1) depth += 2;
+    select_ranks(reps, 0, iterations, ranks, 0, unique, depth);
+    JanetKV *st = janet_struct_begin(3);
+    summary_put(st, "estimate", estimate);
+    summary_put(st, "lower", quantile_value(reps, iterations, ps[0]));
+    summary_put(st, "upper", quantile_value(reps, iterations, ps[1]));
+    janet_sfree(reps);
+    janet_sfree(xs);
+    return janet_wrap_struct(janet_struct_end(st));
+}
+
+/* Merging t-digest (Dunning and Ertl). Samples are buffered and folded into
+ * at most about `compression` centroids whose size is bounded by a scale
+ * function, so the tails stay accurate in constant memory. */
+
+#define DIGEST_BUFFER_FACTOR 5
+
+typedef struct {
+    double mean;
+    double weight;
+} Centroid;
+
+typedef struct {
+    double compression;
+    double total;
+    double min;
+    double max;
+    int32_t merged;
+    int32_t count;
+    int32_t capacity;
+    Centroid *c;
+} Digest;
+
+static int digest_gc(void *p, size_t size);
+static int digest_get(void *p, Janet key, Janet *out);
+static void digest_marshal(void *p, JanetMarshalContext *ctx);
+static void *digest_unmarshal(JanetMarshalContext *ctx);
+
+static const JanetAbstractType digest_type = {
+    .name = "math/digest",
+    .gc = digest_gc,
+    .get = digest_get,
+    .marshal = digest_marshal,
+    .unmarshal = digest_unmarshal
+};
+
+static int digest_gc(void *p, size_t size) {
+    (void) size;
+    Digest *d = (Digest *) p;
+    free(d->c);
+    return 0;
+}
+
+static void digest_init(Digest *d, double compression) {
+    d->compression = compression;
+    d->total = 0.0;
+    d->min = INFINITY;
+    d->max = -INFINITY;
+    d->merged = 0;
+    d->count = 0;
+    /* A merge leaves at most compression + 1 centroids. */
+    int32_t centroids = (int32_t) ceil(compression) + 2;
+    d->capacity = centroids * (1 + DIGEST_BUFFER_FACTOR);
+    d->c = malloc(sizeof(Centroid) * d->capacity);
+    if (d->c == NULL) janet_panic("out of memory");
+}
+
+static int centroid_cmp(const void *a, const void *b) {
+    double x = ((const Centroid *) a)->mean;
+    double y = ((const Centroid *) b)->mean;
+    return (x > y) - (x < y);
+}
+
+/* The k2 scale function. Its normalizer grows with the log of the sample
+ * count, which bounds the number of centroids while keeping the ones in the
+ * tails small. */
+static double digest_norm(const Digest *d) {
+    double n = d->total > d->compression ? d->total : d->compression;
+    return 4.0 * log(n / d->compression) + 24.0;
+}
+
+static double digest_k(const Digest *d, double q) {
+    return d->compression / digest_norm(d) * log(q / (1.0 - q));
+}
+
+static double digest_q(const Digest *d, double k) {
+    return 1.0 / (1.0 + exp(-k * digest_norm(d) / d->compression));
+}
+
+static void digest_compress(Digest *d) {
+    if (d->merged == d->count) return;
+    qsort(d->c, d->count, sizeof(Centroid), centroid_cmp);
+    int32_t out = 0;
+    double so_far = 0.0;
+    double limit = digest_q(d, digest_k(d, 0.0) + 1.0) * d->total;
+    for (int32_t i = 1; i < d->count; i++) {
+        Centroid *cur = d->c + out;
+        Centroid next = d->c[i];
+        if (so_far + cur->weight + next.weight <= limit) {
+            double w = cur->weight + next.weight;
+            cur->mean += (next.mean - cur->mean) * next.weight / w;
+            cur->weight = w;
+        } else {
+            so_far += cur->weight;
+            limit = digest_q(d, digest_k(d, so_far / d->total) + 1.0) * d->total;
+            d->c[++out] = next;
+        }
+    }
+    d->merged = d->count = out + 1;
+}
+
+static void digest_push_centroid(Digest *d, double mean, double weight) {
+    if (d->count == d->capacity) digest_compress(d);
+    d->c[d->count].mean = mean;
+    d->c[d->count].weight = weight;
+    d->count++;
+    d->total += weight;
+}
+
+static void digest_push(void *ctx, double x) {
+    Digest *d = (Digest *) ctx;
+    digest_push_centroid(d, x, 1.0);
+    if (x < d->min) d->min = x;
+    if (x > d->max) d->max = x;
+}
+
+/* Quantile by interpolating between centroid centers, and between the
+ * extreme centroids and the exact minimum and maximum. */
+static double digest_quantile(Digest *d, double q) {
+    digest_compress(d);
+    if (d->count == 0) return janet_unwrap_number(wrap_nan());
+    if (q <= 0.0) return d->min;
+    if (q >= 1.0) return d->max;
+    const Centroid *c = d->c;
+    int32_t n = d->count;
+    double index = q * d->total;
+    if (index < c[0].weight / 2.0) {
+        return d->min + (c[0].mean - d->min) * index / (c[0].weight / 2.0);
+    }
+    double left = c[0].weight / 2.0;
+    for (int32_t i = 0; i < n - 1; i++) {
+        double right = left + (c[i].weight + c[i + 1].weight) / 2.0;
+        if (index < right) {
+            return c[i].mean + (c[i + 1].mean - c[i].mean) * (index - left) / (right - left);
+        }
+        left = right;
+    }
+    double tail = d->total - left;
+    if (tail <= 0.0) return c[n - 1].mean;
+    return c[n - 1].mean + (d->max - c[n - 1].mean) * (index - left) / tail;
+}
+
+static void digest_marshal(void *p, JanetMarshalContext *ctx) {
+    Digest *d = (Digest *) p;
+    digest_compress(d);
+    janet_marshal_abstract(ctx, p);
+    marshal_double(ctx, d->compression);
+    marshal_double(ctx, d->min);
+    marshal_double(ctx, d->max);
+    janet_marshal_int(ctx, d->count);
+    for (int32_t i = 0; i < d->count; i++) {
+        marshal_double(ctx, d->c[i].mean);
+        marshal_double(ctx, d->c[i].weight);
+    }
+}
+
+static void *digest_unmarshal(JanetMarshalContext *ctx) {
+    Digest *d = janet_unmarshal_abstract(ctx, sizeof(Digest));
+    d->c = NULL;
+    d->count = 0;
+    double compression = unmarshal_double(ctx);
+    if (!(compression >= 10.0 && compression <= 100000.0)) janet_panic("invalid digest");
+    digest_init(d, compression);
+    d->min = unmarshal_double(ctx);
+    d->max = unmarshal_double(ctx);
+    int32_t count = janet_unmarshal_int(ctx);
+    if (count < 0 || count > d->capacity) janet_panic("invalid digest");
+    for (int32_t i = 0; i < count; i++) {
+        double mean = unmarshal_double(ctx);
+        double weight = unmarshal_double(ctx);
+        if (!(weight > 0.0 && isfinite(weight))) janet_panic("invalid digest");
+        digest_push_centroid(d, mean, weight);
+    }
+    return d;
+}
+
+static Digest *getdigest(const Janet *argv, int32_t n) {
+    return (Digest *) janet_getabstract(argv, n, &digest_type);
+}
+
+JANET_FN(cfun_cmath_digest,
+        "(math/digest &opt compression xs)",
+        "Create a t-digest, a sketch of a distribution that answers quantile queries over an "
+        "unbounded stream of samples in constant memory. Higher `compression` gives more "
+        "accurate quantiles at the cost of memory, and defaults to 100. `xs` are optional "
+        "initial samples, as in `math/digest-add`. Digests can be merged and sent between threads.") {
+    janet_arity(argc, 0, 2);
+    double compression = janet_optnumber(argv, argc, 0, 100.0);
+    if (!(compression >= 10.0 && compression <= 100000.0)) {
+        janet_panicf("compression must be between 10 and 100000, got %v", argv[0]);
+    }
+    Digest *d = janet_abstract(&digest_type, sizeof(Digest));
+    d->c = NULL;
+    digest_init(d, compression);
+    if (argc > 1 && !janet_checktype(argv[1], JANET_NIL)) each_sample(argv, 1, digest_push, d);
+    return janet_wrap_abstract(d);
+}
+
+JANET_FN(cfun_cmath_digest_add,
+        "(math/digest-add digest xs)",
+        "Add the samples `xs` to a t-digest. `xs` can be a number, an indexed collection of "
+        "numbers or a typed array. NaN samples are ignored. Returns `digest`.") {
+    janet_fixarity(argc, 2);
+    Digest *d = getdigest(argv, 0);
+    each_sample(argv, 1, digest_push, d);
+    return argv[0];
+}
+
+JANET_FN(cfun_cmath_digest_merge,
+        "(math/digest-merge digest other)",
+        "Merge the t-digest `other` into `digest`. Returns `digest`.") {
+    janet_fixarity(argc, 2);
+    Digest *d = getdigest(argv, 0);
+    Digest *o = getdigest(argv, 1);
+    if (o == d) janet_panic("cannot merge a digest into itself");
+    digest_compress(o);
+    for (int32_t i = 0; i < o->count; i++) {
+        digest_push_centroid(d, o->c[i].mean, o->c[i].weight);
+    }
+    if (o->min < d->min) d->min = o->min;
+    if (o->max > d->max) d->max = o->max;
+    return argv[0];
+}
+
+JANET_FN(cfun_cmath_digest_quantile,
+        "(math/digest-quantile digest q)",
+        "Estimate the `q` quantile of the samples in a t-digest, where `q` is between 0 and 1. "
+        "If `q` is indexed, returns an array with an estimate for each element. "
+        "Returns NaN for an empty digest.") {
+    janet_fixarity(argc, 2);
+    Digest *d = getdigest(argv, 0);
+    if (janet_checktype(argv[1], JANET_NUMBER)) {
+        return janet_wrap_number(digest_quantile(d, getprobability(argv[1])));
+    }
+    JanetView qs = janet_getindexed(argv, 1);
+    JanetArray *res = janet_array(qs.len);
+    for (int32_t i = 0; i < qs.len; i++) {
+        double q = getprobability(qs.items[i]);
+        janet_array_push(res, janet_wrap_number(digest_quantile(d, q)));
+    }
+    return janet_wrap_array(res);
+}
+
+JANET_FN(cfun_cmath_digest_count,
+        "(math/digest-count digest)",
+        "Get the number of samples added to a t-digest.") {
+    janet_fixarity(argc, 1);
+    Digest *d = getdigest(argv, 0);
+    return janet_wrap_number(d->total);
+}
+
+static const JanetMethod digest_methods[] = {
+    {"add", cfun_cmath_digest_add},
+    {"merge", cfun_cmath_digest_merge},
+    {"quantile", cfun_cmath_digest_quantile},
+    {"count", cfun_cmath_digest_count},
+    {NULL, NULL}
+};
 
-    return wrap_result(res, argv[2]);
+static int digest_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD)) return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), digest_methods, out);
 }
 
 JANET_MODULE_ENTRY(JanetTable *env) {
+    simd_init();
+    sieve_init();
     JanetRegExt cfuns[] = {
         JANET_REG("jacobi", cfun_cmath_jacobi),
         JANET_REG("invmod", cfun_cmath_invmod),
         JANET_REG("mulmod", cfun_cmath_mulmod),
         JANET_REG("powmod", cfun_cmath_powmod),
+        JANET_REG("bigint", cfun_cmath_bigint),
+        JANET_REG("bigint?", cfun_cmath_bigintp),
+        JANET_REG("gcd", cfun_cmath_gcd),
+        JANET_REG("modulus", cfun_cmath_modulus),
+        JANET_REG("modulus-mulmod", cfun_cmath_modulus_mulmod),
+        JANET_REG("modulus-powmod", cfun_cmath_modulus_powmod),
+        JANET_REG("mulmod-batch", cfun_cmath_mulmod_batch),
+        JANET_REG("powmod-batch", cfun_cmath_powmod_batch),
+        JANET_REG("invmod-batch", cfun_cmath_invmod_batch),
+        JANET_REG("jacobi-batch", cfun_cmath_jacobi_batch),
+        JANET_REG("prime-range", cfun_cmath_prime_range),
+        JANET_REG("prime-mask", cfun_cmath_prime_mask),
+        JANET_REG("pollard-rho", cfun_cmath_pollard_rho),
+        JANET_REG("matrix", cfun_cmath_matrix),
+        JANET_REG("matrix?", cfun_cmath_matrixp),
+        JANET_REG("rows->matrix", cfun_cmath_rows_to_matrix),
+        JANET_REG("matrix->rows", cfun_cmath_matrix_to_rows),
+        JANET_REG("matrix-size", cfun_cmath_matrix_size),
+        JANET_REG("matrix-get", cfun_cmath_matrix_get),
+        JANET_REG("matrix-set", cfun_cmath_matrix_set),
+        JANET_REG("matrix-view", cfun_cmath_matrix_view),
+        JANET_REG("matrix-copy", cfun_cmath_matrix_copy),
+        JANET_REG("matrix-mul", cfun_cmath_matrix_mul),
+        JANET_REG("matrix-trans", cfun_cmath_matrix_trans),
+        JANET_REG("matrix-scale", cfun_cmath_matrix_scale),
+        JANET_REG("matrix-add", cfun_cmath_matrix_add),
+        JANET_REG("matrix-emul", cfun_cmath_matrix_emul),
+        JANET_REG("matrix-det", cfun_cmath_matrix_det),
+        JANET_REG("matrix-lu", cfun_cmath_matrix_lu),
+        JANET_REG("matrix-qr", cfun_cmath_matrix_qr),
+        JANET_REG("matrix-svd", cfun_cmath_matrix_svd),
+        JANET_REG("matrix-cholesky", cfun_cmath_matrix_cholesky),
+        JANET_REG("matrix-solve", cfun_cmath_matrix_solve),
+        JANET_REG("matrix-inverse", cfun_cmath_matrix_inverse),
+        JANET_REG("stats", cfun_cmath_stats),
+        JANET_REG("stats-add", cfun_cmath_stats_add),
+        JANET_REG("stats-merge", cfun_cmath_stats_merge),
+        JANET_REG("stats-summary", cfun_cmath_stats_summary),
+        JANET_REG("digest", cfun_cmath_digest),
+        JANET_REG("digest-add", cfun_cmath_digest_add),
+        JANET_REG("digest-merge", cfun_cmath_digest_merge),
+        JANET_REG("digest-quantile", cfun_cmath_digest_quantile),
+        JANET_REG("digest-count", cfun_cmath_digest_count),
+        JANET_REG("quantiles", cfun_cmath_quantiles),
+        JANET_REG("paired-stats", cfun_cmath_paired_stats),
+        JANET_REG("least-squares", cfun_cmath_least_squares),
+        JANET_REG("permutation-test", cfun_cmath_permutation_test),
+        JANET_REG("bootstrap", cfun_cmath_bootstrap),
+        JANET_REG("bootstrap-ci", cfun_cmath_bootstrap_ci),
         JANET_REG_END
     };
     janet_cfuns_ext(env, "cmath", cfuns);
+    janet_register_abstract_type(&bigint_type);
+    janet_register_abstract_type(&stats_type);
+    janet_register_abstract_type(&digest_type);
 }
@@ -8,6 +8,10 @@
 #include <janet.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "workers.h"
+#include "checksum.h"
 
 static const uint8_t nibble_reverse_lut[16] = {
     0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
@@ -164,6 +168,108 @@ static uint32_t crc32_general(CRC32 *variant, const uint8_t *bytes, size_t len,
     return sum ^ variant->xor;
 }
 
+/*****************/
+/* Combining CRCs */
+/*****************/
+
+/* The GF(2) machinery lives in checksum.h, shared with spork/zip. CRCAny
+ * wraps each variant generated above so any of them can be combined. */
+
+typedef struct {
+    void *variant;
+    int width;
+    uint32_t init;
+    uint32_t xor;
+    uint32_t (*update)(void *variant, const uint8_t *bytes, size_t len, uint32_t sum);
+    uint32_t (*zero)(void *variant, uint32_t sum);
+} CRCAny;
+
+static uint32_t crc8_update(void *variant, const uint8_t *bytes, size_t len, uint32_t sum) {
+    return crc8_general((CRC8 *) variant, bytes, len, (uint8_t) sum);
+}
+
+static uint32_t crc16_update(void *variant, const uint8_t *bytes, size_t len, uint32_t sum) {
+    return crc16_general((CRC16 *) variant, bytes, len, (uint16_t) sum);
+}
+
+static uint32_t crc32_update(void *variant, const uint8_t *bytes, size_t len, uint32_t sum) {
+    return crc32_general((CRC32 *) variant, bytes, len, sum);
+}
+
+static uint32_t crc8_zero(void *variant, uint32_t sum) {
+    return ((CRC8 *) variant)->lut[sum & 0xFF];
+}
+
+static uint32_t crc16_zero(void *variant, uint32_t sum) {
+    CRC16 *crc16 = (CRC16 *) variant;
+    if (crc16->flipped) {
+        return (sum >> 8) ^ crc16->lut[sum & 0xFF];
+    } else {
+        return ((sum << 8) ^ crc16->lut[(sum >> 8) & 0xFF]) & 0xFFFF;
+    }
+}
+
+static uint32_t crc32_zero(void *variant, uint32_t sum) {
+    CRC32 *crc32 = (CRC32 *) variant;
+    if (crc32->flipped) {
+        return (sum >> 8) ^ crc32->lut[sum & 0xFF];
+    } else {
+        return (sum << 8) ^ crc32->lut[sum >> 24];
+    }
+}
+
+/* Advance a CRC register as if len zero bytes were fed through it. */
+static uint32_t crc_shift_zeros(const CRCAny *crc, uint32_t sum, uint64_t len) {
+    return spork_crc_shift_zeros(crc->width, crc->zero, crc->variant, sum, len);
+}
+
+/* Given crc(A), crc(B) and the length of B, get crc(A ++ B). */
+static uint32_t crc_combine(const CRCAny *crc, uint32_t crc_a, uint32_t crc_b, uint64_t len_b) {
+    return crc_shift_zeros(crc, crc_a ^ crc->xor ^ crc->init, len_b) ^ crc_b;
+}
+
+/***********************/
+/* Parallel Checksums */
+/***********************/
+
+#define CRC_DEFAULT_BLOCK_SIZE (1024 * 1024)
+#define CRC_MAX_BLOCK_SIZE (1024 * 1024 * 1024)
+
+typedef struct {
+    const CRCAny *crc;
+    const uint8_t *bytes;
+    size_t len;
+    size_t block_size;
+    uint32_t *sums;
+} CRCJob;
+
+static void crc_block_job(void *ctx, int32_t job) {
+    CRCJob *j = (CRCJob *) ctx;
+    size_t start = (size_t) job * j->block_size;
+    size_t len = j->len - start;
+    if (len > j->block_size) len = j->block_size;
+    j->sums[job] = j->crc->update(j->crc->variant, j->bytes + start, len, j->crc->init);
+}
+
+/* Checksum a contiguous region in blocks spread over workers, folding the
+ * block sums into a running crc of everything before the region. */
+static uint32_t crc_parallel_fold(const CRCAny *crc, uint32_t sum, const uint8_t *bytes, size_t len,
+                                  size_t block_size, int32_t workers, uint32_t *sums) {
+    size_t nblocks = (len + block_size - 1) / block_size;
+    CRCJob job;
+    job.crc = crc;
+    job.bytes = bytes;
+    job.len = len;
+    job.block_size = block_size;
+    job.sums = sums;
+    spork_parallel_for(workers, (int32_t) nblocks, crc_block_job, &job);
+    for (size_t i = 0; i < nblocks; i++) {
+        size_t blen = (i + 1 == nblocks) ? len - i * block_size : block_size;
+        sum = crc_combine(crc, sum, sums[i], blen);
+    }
+    return sum;
+}
+
 /***************/
 /* C Functions */
 /***************/
@@ -238,6 +344,49 @@ static const JanetAbstractType CRC32_AT = {
     .call = crc32_call
 };
 
+static CRCAny crc_getany(const Janet *argv, int32_t n) {
+    CRCAny crc;
+    if (!janet_checktype(argv[n], JANET_ABSTRACT)) {
+        janet_panicf("bad slot #%d, expected crc variant, got %v", n, argv[n]);
+    }
+    void *variant = janet_unwrap_abstract(argv[n]);
+    const JanetAbstractType *at = janet_abstract_type(variant);
+    crc.variant = variant;
+    if (at == &CRC8_AT) {
+        CRC8 *crc8 = (CRC8 *) variant;
+        crc.width = 8;
+        crc.init = crc8->init;
+        crc.xor = crc8->xor;
+        crc.update = crc8_update;
+        crc.zero = crc8_zero;
+    } else if (at == &CRC16_AT) {
+        CRC16 *crc16 = (CRC16 *) variant;
+        crc.width = 16;
+        crc.init = crc16->init;
+        crc.xor = crc16->xor;
+        crc.update = crc16_update;
+        crc.zero = crc16_zero;
+    } else if (at == &CRC32_AT) {
+        CRC32 *crc32 = (CRC32 *) variant;
+        crc.width = 32;
+        crc.init = crc32->init;
+        crc.xor = crc32->xor;
+        crc.update = crc32_update;
+        crc.zero = crc32_zero;
+    } else {
+        janet_panicf("bad slot #%d, expected crc variant, got %v", n, argv[n]);
+    }
+    return crc;
+}
+
+static size_t crc_optblocksize(const Janet *argv, int32_t argc, int32_t n) {
+    size_t block_size = janet_optsize(argv, argc, n, CRC_DEFAULT_BLOCK_SIZE);
+    if (block_size < 1 || block_size > CRC_MAX_BLOCK_SIZE) {
+        janet_panicf("block size must be between 1 and %d, got %v", CRC_MAX_BLOCK_SIZE, argv[n]);
+    }
+    return block_size;
+}
+
 typedef struct {
     const char *name;
     size_t size;
@@ -363,10 +512,85 @@ JANET_FN(cfun_make_variant,
     return janet_wrap_abstract(ret);
 }
 
+JANET_FN(cfun_combine,
+        "(crc/combine variant crc-a crc-b length-b)",
+        "Combine the checksums of two byte sequences A and B into the checksum "
+        "of A followed by B, given only the length of B. Works for any variant.") {
+    janet_fixarity(argc, 4);
+    CRCAny crc = crc_getany(argv, 0);
+    uint32_t crc_a = (uint32_t) janet_getuinteger64(argv, 1);
+    uint32_t crc_b = (uint32_t) janet_getuinteger64(argv, 2);
+    uint64_t len_b = janet_getuinteger64(argv, 3);
+    return janet_wrap_number(crc_combine(&crc, crc_a, crc_b, len_b));
+}
+
+JANET_FN(cfun_parallel,
+        "(crc/parallel variant bytes &opt workers block-size)",
+        "Checksum a byte sequence by splitting it into blocks of `block-size` bytes "
+        "(default 1 MiB), checksumming the blocks on up to `workers` threads "
+        "(default the number of cpus) and combining the results. "
+        "Gives the same result as `(variant bytes)`.") {
+    janet_arity(argc, 2, 4);
+    CRCAny crc = crc_getany(argv, 0);
+    JanetByteView bytes = janet_getbytes(argv, 1);
+    int32_t workers = spork_optworkers(argv, argc, 2);
+    size_t block_size = crc_optblocksize(argv, argc, 3);
+    size_t nblocks = ((size_t) bytes.len + block_size - 1) / block_size;
+    uint32_t empty = crc.init ^ crc.xor;
+    if (nblocks == 0) return janet_wrap_number(empty);
+    uint32_t *sums = janet_smalloc(nblocks * sizeof(uint32_t));
+    uint32_t sum = crc_parallel_fold(&crc, empty, bytes.bytes, (size_t) bytes.len,
+                                     block_size, workers, sums);
+    janet_sfree(sums);
+    return janet_wrap_number(sum);
+}
+
+JANET_FN(cfun_file,
+        "(crc/file variant path &opt workers block-size)",
+        "Checksum the contents of a file. The file is read in batches of large blocks "
+        "(default 1 MiB each) which are checksummed in parallel on up to `workers` threads "
+        "(default the number of cpus), so memory use is bounded by `workers * block-size`.") {
+    janet_arity(argc, 2, 4);
+    CRCAny crc = crc_getany(argv, 0);
+    const char *path = janet_getcstring(argv, 1);
+    int32_t workers = spork_optworkers(argv, argc, 2);
+    size_t block_size = crc_optblocksize(argv, argc, 3);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        janet_panicf("could not open file %s: %s", path, strerror(errno));
+    }
+    size_t batch_size = block_size * (size_t) workers;
+    uint8_t *batch = janet_malloc(batch_size);
+    uint32_t *sums = janet_malloc((size_t) workers * sizeof(uint32_t));
+    if (batch == NULL || sums == NULL) {
+        janet_free(batch);
+        janet_free(sums);
+        fclose(f);
+        JANET_OUT_OF_MEMORY;
+    }
+    uint32_t sum = crc.init ^ crc.xor;
+    size_t nread;
+    while ((nread = fread(batch, 1, batch_size, f)) > 0) {
+        sum = crc_parallel_fold(&crc, sum, batch, nread, block_size, workers, sums);
+        if (nread < batch_size) break;
+    }
+    int failed = ferror(f);
+    janet_free(batch);
+    janet_free(sums);
+    fclose(f);
+    if (failed) {
+        janet_panicf("error reading file %s", path);
+    }
+    return janet_wrap_number(sum);
+}
+
 JANET_MODULE_ENTRY(JanetTable *env) {
     JanetRegExt cfuns[] = {
         JANET_REG("make-variant", cfun_make_variant),
         JANET_REG("named-variant", cfun_named_variant),
+        JANET_REG("combine", cfun_combine),
+        JANET_REG("parallel", cfun_parallel),
+        JANET_REG("file", cfun_file),
         JANET_REG_END
     };
     janet_cfuns_ext(env, "crc", cfuns);
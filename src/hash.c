@@ -0,0 +1,328 @@
+/*
+* Copyright (c) 2026 Calvin Rose and contributors
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+ * Fast non-cryptographic hashes. XXH3 comes from the vendored xxHash header,
+ * wyhash (final version 4, public domain) is short enough to live here.
+ */
+
+#include <janet.h>
+#include <string.h>
+#include "tarray.h"
+
+#define XXH_INLINE_ALL
+#include "../deps/xxhash/xxhash.h"
+
+/**********/
+/* wyhash */
+/**********/
+
+static const uint64_t wyhash_secret[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+static void wymum(uint64_t *a, uint64_t *b) {
+    XXH128_hash_t r = XXH_mult64to128(*a, *b);
+    *a = r.low64;
+    *b = r.high64;
+}
+
+static uint64_t wymix(uint64_t a, uint64_t b) {
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t wyr8(const uint8_t *p) {
+    return XXH_readLE64(p);
+}
+
+static uint64_t wyr4(const uint8_t *p) {
+    return XXH_readLE32(p);
+}
+
+static uint64_t wyr3(const uint8_t *p, size_t k) {
+    return (((uint64_t) p[0]) << 16) | (((uint64_t) p[k >> 1]) << 8) | p[k - 1];
+}
+
+static uint64_t wyhash(const uint8_t *p, size_t len, uint64_t seed) {
+    const uint64_t *secret = wyhash_secret;
+    uint64_t a, b;
+    seed ^= wymix(seed ^ secret[0], secret[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = wyr3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ secret[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ secret[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ secret[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(wyr8(p) ^ secret[1], wyr8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+/***********/
+/* Hashers */
+/***********/
+
+typedef enum {
+    HASH_XXH3_64,
+    HASH_XXH3_128,
+    HASH_WYHASH
+} HashKind;
+
+static const char *hash_kind_names[] = {
+    "xxh3",
+    "xxh3-128",
+    "wyhash"
+};
+
+typedef struct {
+    HashKind kind;
+    uint64_t seed;
+} Hasher;
+
+typedef struct {
+    Hasher hasher;
+    XXH3_state_t *state;
+} HashState;
+
+/* 128 bit hashes are returned as 16 byte strings in canonical (big endian) order */
+static Janet hash_wrap128(XXH128_hash_t h) {
+    XXH128_canonical_t canon;
+    XXH128_canonicalFromHash(&canon, h);
+    return janet_stringv(canon.digest, sizeof(canon.digest));
+}
+
+static Janet hasher_oneshot(const Hasher *hasher, const uint8_t *bytes, size_t len) {
+    switch (hasher->kind) {
+        default:
+        case HASH_XXH3_64:
+            return janet_wrap_u64(XXH3_64bits_withSeed(bytes, len, hasher->seed));
+        case HASH_XXH3_128:
+            return hash_wrap128(XXH3_128bits_withSeed(bytes, len, hasher->seed));
+        case HASH_WYHASH:
+            return janet_wrap_u64(wyhash(bytes, len, hasher->seed));
+    }
+}
+
+/* Get bytes from strings, buffers or typed arrays, with optional start and end. */
+static JanetByteView hash_getslice(int32_t argc, const Janet *argv, int32_t n) {
+    JanetByteView bytes = janet_gettarray_bytes(argv, n);
+    int32_t start = 0, end = bytes.len;
+    if (argc > n + 1 && !janet_checktype(argv[n + 1], JANET_NIL)) {
+        start = janet_gethalfrange(argv, n + 1, bytes.len, "start");
+    }
+    if (argc > n + 2 && !janet_checktype(argv[n + 2], JANET_NIL)) {
+        end = janet_gethalfrange(argv, n + 2, bytes.len, "end");
+    }
+    if (end < start) end = start;
+    bytes.bytes += start;
+    bytes.len = end - start;
+    return bytes;
+}
+
+static Janet hasher_call(void *p, int32_t argc, Janet *argv) {
+    janet_arity(argc, 1, 3);
+    JanetByteView bytes = hash_getslice(argc, argv, 0);
+    return hasher_oneshot((Hasher *) p, bytes.bytes, (size_t) bytes.len);
+}
+
+static void hasher_tostring(void *p, JanetBuffer *buffer) {
+    Hasher *hasher = (Hasher *) p;
+    janet_buffer_push_cstring(buffer, hash_kind_names[hasher->kind]);
+}
+
+static const JanetAbstractType hasher_type = {
+    .name = "hash/hasher",
+    .tostring = hasher_tostring,
+    .call = hasher_call
+};
+
+static int hash_state_gc(void *p, size_t size) {
+    (void) size;
+    HashState *state = (HashState *) p;
+    XXH3_freeState(state->state);
+    return 0;
+}
+
+static int hash_state_get(void *p, Janet key, Janet *out);
+
+static const JanetAbstractType hash_state_type = {
+    .name = "hash/state",
+    .gc = hash_state_gc,
+    .get = hash_state_get
+};
+
+static void hash_state_reset(HashState *state) {
+    if (state->hasher.kind == HASH_XXH3_64) {
+        XXH3_64bits_reset_withSeed(state->state, state->hasher.seed);
+    } else {
+        XXH3_128bits_reset_withSeed(state->state, state->hasher.seed);
+    }
+}
+
+static Janet make_hasher(int32_t argc, Janet *argv, HashKind kind) {
+    janet_arity(argc, 0, 1);
+    Hasher *hasher = janet_abstract(&hasher_type, sizeof(Hasher));
+    hasher->kind = kind;
+    hasher->seed = (argc > 0 && !janet_checktype(argv[0], JANET_NIL))
+                   ? janet_getuinteger64(argv, 0)
+                   : 0;
+    return janet_wrap_abstract(hasher);
+}
+
+/***************/
+/* C Functions */
+/***************/
+
+JANET_FN(cfun_xxh3,
+        "(hash/xxh3 &opt seed)",
+        "Create a 64 bit XXH3 hasher with an optional 64 bit seed. The hasher "
+        "can be called like a function, `(hasher bytes &opt start end)`, and returns "
+        "the hash as an `int/u64`. `bytes` can be a string, buffer or contiguous typed array.") {
+    return make_hasher(argc, argv, HASH_XXH3_64);
+}
+
+JANET_FN(cfun_xxh3_128,
+        "(hash/xxh3-128 &opt seed)",
+        "Create a 128 bit XXH3 hasher with an optional 64 bit seed. Calling the hasher "
+        "returns the hash as a 16 byte string in canonical (big endian) order.") {
+    return make_hasher(argc, argv, HASH_XXH3_128);
+}
+
+JANET_FN(cfun_wyhash,
+        "(hash/wyhash &opt seed)",
+        "Create a 64 bit wyhash hasher with an optional 64 bit seed. Calling the hasher "
+        "returns the hash as an `int/u64`. wyhash is fastest on short keys, but can only "
+        "hash whole byte sequences - it cannot be used with `hash/stream`.") {
+    return make_hasher(argc, argv, HASH_WYHASH);
+}
+
+JANET_FN(cfun_stream,
+        "(hash/stream hasher)",
+        "Create a streaming hash state from an XXH3 hasher. Data can be fed to the "
+        "state incrementally with `hash/update`, and `hash/digest` returns the same "
+        "hash as calling the hasher on all of the data at once.") {
+    janet_fixarity(argc, 1);
+    Hasher *hasher = janet_getabstract(argv, 0, &hasher_type);
+    if (hasher->kind == HASH_WYHASH) {
+        janet_panic("wyhash does not support streaming");
+    }
+    XXH3_state_t *xstate = XXH3_createState();
+    if (xstate == NULL) {
+        JANET_OUT_OF_MEMORY;
+    }
+    HashState *state = janet_abstract(&hash_state_type, sizeof(HashState));
+    state->hasher = *hasher;
+    state->state = xstate;
+    hash_state_reset(state);
+    return janet_wrap_abstract(state);
+}
+
+JANET_FN(cfun_update,
+        "(hash/update state bytes &opt start end)",
+        "Feed more bytes into a streaming hash state. Returns the state.") {
+    janet_arity(argc, 2, 4);
+    HashState *state = janet_getabstract(argv, 0, &hash_state_type);
+    JanetByteView bytes = hash_getslice(argc, argv, 1);
+    if (state->hasher.kind == HASH_XXH3_64) {
+        XXH3_64bits_update(state->state, bytes.bytes, (size_t) bytes.len);
+    } else {
+        XXH3_128bits_update(state->state, bytes.bytes, (size_t) bytes.len);
+    }
+    return argv[0];
+}
+
+JANET_FN(cfun_digest,
+        "(hash/digest state)",
+        "Get the hash of all bytes fed into a streaming hash state so far. "
+        "The state is not modified and can continue to be updated.") {
+    janet_fixarity(argc, 1);
+    HashState *state = janet_getabstract(argv, 0, &hash_state_type);
+    if (state->hasher.kind == HASH_XXH3_64) {
+        return janet_wrap_u64(XXH3_64bits_digest(state->state));
+    } else {
+        return hash_wrap128(XXH3_128bits_digest(state->state));
+    }
+}
+
+JANET_FN(cfun_reset,
+        "(hash/reset state)",
+        "Reset a streaming hash state as if no bytes had been fed into it. Returns the state.") {
+    janet_fixarity(argc, 1);
+    HashState *state = janet_getabstract(argv, 0, &hash_state_type);
+    hash_state_reset(state);
+    return argv[0];
+}
+
+static const JanetMethod hash_state_methods[] = {
+    {"update", cfun_update},
+    {"digest", cfun_digest},
+    {"reset", cfun_reset},
+    {NULL, NULL}
+};
+
+static int hash_state_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD)) return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), hash_state_methods, out);
+}
+
+JANET_MODULE_ENTRY(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_REG("xxh3", cfun_xxh3),
+        JANET_REG("xxh3-128", cfun_xxh3_128),
+        JANET_REG("wyhash", cfun_wyhash),
+        JANET_REG("stream", cfun_stream),
+        JANET_REG("update", cfun_update),
+        JANET_REG("digest", cfun_digest),
+        JANET_REG("reset", cfun_reset),
+        JANET_REG_END
+    };
+    janet_cfuns_ext(env, "hash", cfuns);
+}
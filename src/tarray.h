@@ -24,6 +24,8 @@
 #define JANET_TYPED_ARRAYS_H_defined
 
 #include <janet.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -78,6 +80,96 @@ JANET_API JanetTArrayBuffer *janet_gettarray_buffer(const Janet *argv, int32_t n
 JANET_API JanetTArrayView *janet_gettarray_view(const Janet *argv, int32_t n, JanetTArrayType type);
 JanetTArrayView *janet_gettarray_any(const Janet *argv, int32_t n);
 
+/* Header only helpers for other native modules. Native modules are loaded
+ * independently of each other, so instead of linking against spork/tarray
+ * these recognize typed arrays by the name of their abstract type. */
+
+static inline size_t janet_tarray_type_size(JanetTArrayType type) {
+    switch (type) {
+        case JANET_TARRAY_TYPE_U8:
+        case JANET_TARRAY_TYPE_S8:
+            return 1;
+        case JANET_TARRAY_TYPE_U16:
+        case JANET_TARRAY_TYPE_S16:
+            return 2;
+        case JANET_TARRAY_TYPE_U32:
+        case JANET_TARRAY_TYPE_S32:
+        case JANET_TARRAY_TYPE_F32:
+            return 4;
+        default:
+            return 8;
+    }
+}
+
+/* Get a typed array view, or NULL if x is not one. */
+static inline JanetTArrayView *janet_checktarray_view(Janet x) {
+    if (!janet_checktype(x, JANET_ABSTRACT)) return NULL;
+    void *p = janet_unwrap_abstract(x);
+    if (strcmp(janet_abstract_type(p)->name, "ta/view")) return NULL;
+    return (JanetTArrayView *) p;
+}
+
+/* Like janet_getbytes, but also accepts typed array buffers and contiguous
+ * typed array views, exposing their raw memory. */
+static inline JanetByteView janet_gettarray_bytes(const Janet *argv, int32_t n) {
+    JanetByteView view;
+    if (janet_checktype(argv[n], JANET_ABSTRACT)) {
+        void *p = janet_unwrap_abstract(argv[n]);
+        const char *name = janet_abstract_type(p)->name;
+        size_t size = 0;
+        if (!strcmp(name, "ta/view")) {
+            JanetTArrayView *ta = (JanetTArrayView *) p;
+            if (ta->stride != 1 && ta->size > 1) {
+                janet_panicf("bad slot #%d, expected contiguous typed array, got stride %d",
+                             n, (int32_t) ta->stride);
+            }
+            view.bytes = ta->as.u8;
+            size = ta->size * janet_tarray_type_size(ta->type);
+        } else if (!strcmp(name, "ta/buffer")) {
+            JanetTArrayBuffer *buf = (JanetTArrayBuffer *) p;
+            view.bytes = buf->data;
+            size = buf->size;
+        } else {
+            return janet_getbytes(argv, n);
+        }
+        if (size > INT32_MAX) janet_panicf("bad slot #%d, typed array too large", n);
+        view.len = (int32_t) size;
+        return view;
+    }
+    return janet_getbytes(argv, n);
+}
+
+/* Create a new zeroed typed array of `size` elements. The abstract types are
+ * looked up in the registry, so spork/tarray must have been imported. */
+static inline JanetTArrayView *janet_tarray_view_new(JanetTArrayType type, size_t size) {
+    const JanetAbstractType *buffer_type = janet_get_abstract_type(janet_csymbolv("ta/buffer"));
+    const JanetAbstractType *view_type = janet_get_abstract_type(janet_csymbolv("ta/view"));
+    if (buffer_type == NULL || view_type == NULL) {
+        janet_panic("spork/tarray must be imported to create typed arrays");
+    }
+    size_t bytes = size * janet_tarray_type_size(type);
+    JanetTArrayBuffer *buffer = janet_abstract(buffer_type, sizeof(JanetTArrayBuffer));
+    buffer->data = NULL;
+    buffer->size = 0;
+#ifdef JANET_BIG_ENDIAN
+    buffer->flags = 1;
+#else
+    buffer->flags = 0;
+#endif
+    if (bytes > 0) {
+        buffer->data = (uint8_t *) calloc(bytes, 1);
+        if (buffer->data == NULL) janet_panic("out of memory");
+        buffer->size = bytes;
+    }
+    JanetTArrayView *view = janet_abstract(view_type, sizeof(JanetTArrayView));
+    view->as.u8 = buffer->data;
+    view->buffer = buffer;
+    view->size = size;
+    view->stride = 1;
+    view->type = type;
+    return view;
+}
+
 #ifdef __cplusplus
 }
 #endif
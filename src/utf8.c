@@ -21,6 +21,8 @@
  */
 
 #include <janet.h>
+#include <string.h>
+#include "tarray.h"
 
 /* TODO: It might be wise to disallow overlong sequences for security reasons.
  * See https://www.cl.cam.ac.uk/~mgk25/ucs/examples/UTF-8-test.txt for a list
@@ -132,12 +134,500 @@ JANET_FN(cfun_utf8_prefixtowidth,
     return janet_wrap_integer(n);
 }
 
+/* Bulk operations. Validation follows "Validating UTF-8 In Less Than One
+ * Instruction Per Byte" (Keiser and Lemire, 2021) on x86, and every other
+ * pass skips over runs of ASCII a word at a time. Input is strictly checked:
+ * overlong forms, surrogates and codepoints above U+10FFFF are rejected. */
+
+#define UTF8_ASCII_MASK 0x8080808080808080ULL
+
+static int utf8_ascii_word(const uint8_t *s) {
+    uint64_t w;
+    memcpy(&w, s, 8);
+    return !(w & UTF8_ASCII_MASK);
+}
+
+/* Returns the offset of the first invalid sequence, or len if all is valid */
+static size_t utf8_validate_scalar(const uint8_t *s, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        if (i + 8 <= len && utf8_ascii_word(s + i)) {
+            i += 8;
+            continue;
+        }
+        uint8_t a = s[i];
+        if (a < 0x80) {
+            i++;
+            continue;
+        }
+        size_t n;
+        uint8_t lo = 0x80, hi = 0xBF;
+        if (a >= 0xC2 && a <= 0xDF) {
+            n = 1;
+        } else if (a >= 0xE0 && a <= 0xEF) {
+            n = 2;
+            if (a == 0xE0) lo = 0xA0;
+            if (a == 0xED) hi = 0x9F;
+        } else if (a >= 0xF0 && a <= 0xF4) {
+            n = 3;
+            if (a == 0xF0) lo = 0x90;
+            if (a == 0xF4) hi = 0x8F;
+        } else {
+            return i;
+        }
+        if (i + n >= len) return i;
+        if (s[i + 1] < lo || s[i + 1] > hi) return i;
+        for (size_t j = 2; j <= n; j++) {
+            if ((s[i + j] & 0xC0) != 0x80) return i;
+        }
+        i += n + 1;
+    }
+    return len;
+}
+
+static int utf8_simd_level = 0;
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define UTF8_X86
+#include <immintrin.h>
+
+#define UTF8_SSSE3 1
+#define UTF8_AVX2 2
+
+/* Error classes for a pair of adjacent bytes, found by looking up the high
+ * and low nibble of the first byte and the high nibble of the second. */
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+#define UTF8_BYTE_1_HIGH \
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, \
+    TOO_SHORT | OVERLONG_2, \
+    TOO_SHORT, \
+    TOO_SHORT | OVERLONG_3 | SURROGATE, \
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+
+#define UTF8_BYTE_1_LOW \
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, \
+    CARRY | OVERLONG_2, \
+    CARRY, \
+    CARRY, \
+    CARRY | TOO_LARGE, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+
+#define UTF8_BYTE_2_HIGH \
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4, \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE, \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+/* Check one block, given the block before it. Returns the error bits, and
+ * updates *incomplete with any sequence cut off at the end of the block. */
+__attribute__((target("ssse3")))
+static __m128i utf8_check_ssse3(__m128i input, __m128i prev, __m128i *incomplete) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    if (!_mm_movemask_epi8(input)) return *incomplete;
+    const __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+    const __m128i byte_1_high = _mm_shuffle_epi8(_mm_setr_epi8(UTF8_BYTE_1_HIGH),
+                                _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    const __m128i byte_1_low = _mm_shuffle_epi8(_mm_setr_epi8(UTF8_BYTE_1_LOW),
+                               _mm_and_si128(prev1, nibble));
+    const __m128i byte_2_high = _mm_shuffle_epi8(_mm_setr_epi8(UTF8_BYTE_2_HIGH),
+                                _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    const __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+    const __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+    const __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+    const __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+    const __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+    const __m128i must_continue = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8((char) 0x80));
+    *incomplete = _mm_subs_epu8(input, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1)));
+    return _mm_xor_si128(must_continue, special);
+}
+
+__attribute__((target("ssse3")))
+static int utf8_valid_ssse3(const uint8_t *s, size_t len) {
+    __m128i prev = _mm_setzero_si128();
+    __m128i incomplete = _mm_setzero_si128();
+    __m128i error = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i input = _mm_loadu_si128((const __m128i *)(s + i));
+        error = _mm_or_si128(error, utf8_check_ssse3(input, prev, &incomplete));
+        prev = input;
+    }
+    /* Pad the last block with ASCII, which also catches a sequence cut off at the end */
+    uint8_t last[16] = {0};
+    memcpy(last, s + i, len - i);
+    const __m128i input = _mm_loadu_si128((const __m128i *) last);
+    error = _mm_or_si128(error, utf8_check_ssse3(input, prev, &incomplete));
+    error = _mm_or_si128(error, incomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+__attribute__((target("avx2")))
+static __m256i utf8_check_avx2(__m256i input, __m256i prev, __m256i *incomplete) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    if (!_mm256_movemask_epi8(input)) return *incomplete;
+    const __m256i carried = _mm256_permute2x128_si256(prev, input, 0x21);
+    const __m256i prev1 = _mm256_alignr_epi8(input, carried, 15);
+    const __m256i byte_1_high = _mm256_shuffle_epi8(_mm256_setr_epi8(UTF8_BYTE_1_HIGH, UTF8_BYTE_1_HIGH),
+                                _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    const __m256i byte_1_low = _mm256_shuffle_epi8(_mm256_setr_epi8(UTF8_BYTE_1_LOW, UTF8_BYTE_1_LOW),
+                               _mm256_and_si256(prev1, nibble));
+    const __m256i byte_2_high = _mm256_shuffle_epi8(_mm256_setr_epi8(UTF8_BYTE_2_HIGH, UTF8_BYTE_2_HIGH),
+                                _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    const __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+    const __m256i prev2 = _mm256_alignr_epi8(input, carried, 14);
+    const __m256i prev3 = _mm256_alignr_epi8(input, carried, 13);
+    const __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    const __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    const __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                  _mm256_set1_epi8((char) 0x80));
+    *incomplete = _mm256_subs_epu8(input, _mm256_setr_epi8(
+                                       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                       (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1)));
+    return _mm256_xor_si256(must_continue, special);
+}
+
+__attribute__((target("avx2")))
+static int utf8_valid_avx2(const uint8_t *s, size_t len) {
+    __m256i prev = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    __m256i error = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i input = _mm256_loadu_si256((const __m256i *)(s + i));
+        error = _mm256_or_si256(error, utf8_check_avx2(input, prev, &incomplete));
+        prev = input;
+    }
+    uint8_t last[32] = {0};
+    memcpy(last, s + i, len - i);
+    const __m256i input = _mm256_loadu_si256((const __m256i *) last);
+    error = _mm256_or_si256(error, utf8_check_avx2(input, prev, &incomplete));
+    error = _mm256_or_si256(error, incomplete);
+    return _mm256_testz_si256(error, error);
+}
+
+/* Count bytes that do not continue a sequence, which are signed bytes above 0xBF */
+__attribute__((target("avx2")))
+static size_t utf8_count_avx2(const uint8_t *s, size_t len, size_t *consumed) {
+    const __m256i limit = _mm256_set1_epi8((char) 0xBF);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+        count += (size_t) __builtin_popcount((unsigned) _mm256_movemask_epi8(_mm256_cmpgt_epi8(x, limit)));
+    }
+    *consumed = i;
+    return count;
+}
+
+__attribute__((target("ssse3")))
+static size_t utf8_count_ssse3(const uint8_t *s, size_t len, size_t *consumed) {
+    const __m128i limit = _mm_set1_epi8((char) 0xBF);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+        count += (size_t) __builtin_popcount((unsigned) _mm_movemask_epi8(_mm_cmpgt_epi8(x, limit)));
+    }
+    *consumed = i;
+    return count;
+}
+
+static void utf8_simd_init(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        utf8_simd_level = UTF8_AVX2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        utf8_simd_level = UTF8_SSSE3;
+    }
+}
+
+#else
+
+static void utf8_simd_init(void) {
+}
+
+#endif
+
+static int utf8_valid(const uint8_t *s, size_t len) {
+#ifdef UTF8_X86
+    if (utf8_simd_level == UTF8_AVX2) return utf8_valid_avx2(s, len);
+    if (utf8_simd_level == UTF8_SSSE3) return utf8_valid_ssse3(s, len);
+#endif
+    return utf8_validate_scalar(s, len) == len;
+}
+
+/* Number of codepoints in valid UTF-8 */
+static size_t utf8_count(const uint8_t *s, size_t len) {
+    size_t count = 0;
+    size_t i = 0;
+#ifdef UTF8_X86
+    if (utf8_simd_level == UTF8_AVX2) count = utf8_count_avx2(s, len, &i);
+    if (utf8_simd_level == UTF8_SSSE3) count = utf8_count_ssse3(s, len, &i);
+#endif
+    for (; i < len; i++) {
+        count += (s[i] & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+static JanetByteView utf8_getvalid(const Janet *argv, int32_t n) {
+    JanetByteView view = janet_gettarray_bytes(argv, n);
+    if (!utf8_valid(view.bytes, (size_t) view.len)) {
+        janet_panicf("invalid utf-8 at byte %d",
+                     (int32_t) utf8_validate_scalar(view.bytes, (size_t) view.len));
+    }
+    return view;
+}
+
+/* Decode the codepoint at s[*i] from valid UTF-8 and advance past it */
+static uint32_t utf8_next(const uint8_t *s, size_t *i) {
+    uint32_t a = s[(*i)++];
+    if (a < 0x80) return a;
+    if (a < 0xE0) {
+        return ((a & 0x1F) << 6) | (s[(*i)++] & 0x3F);
+    }
+    if (a < 0xF0) {
+        uint32_t r = ((a & 0x0F) << 12) | ((uint32_t)(s[*i] & 0x3F) << 6) | (s[*i + 1] & 0x3F);
+        *i += 2;
+        return r;
+    }
+    uint32_t r = ((a & 0x07) << 18) | ((uint32_t)(s[*i] & 0x3F) << 12) |
+                 ((uint32_t)(s[*i + 1] & 0x3F) << 6) | (s[*i + 2] & 0x3F);
+    *i += 3;
+    return r;
+}
+
+static size_t utf8_put(uint32_t rune, uint8_t *out) {
+    if (rune < 0x80) {
+        out[0] = (uint8_t) rune;
+        return 1;
+    }
+    if (rune < 0x800) {
+        out[0] = (uint8_t)(0xC0 | (rune >> 6));
+        out[1] = (uint8_t)(0x80 | (rune & 0x3F));
+        return 2;
+    }
+    if (rune < 0x10000) {
+        out[0] = (uint8_t)(0xE0 | (rune >> 12));
+        out[1] = (uint8_t)(0x80 | ((rune >> 6) & 0x3F));
+        out[2] = (uint8_t)(0x80 | (rune & 0x3F));
+        return 3;
+    }
+    out[0] = (uint8_t)(0xF0 | (rune >> 18));
+    out[1] = (uint8_t)(0x80 | ((rune >> 12) & 0x3F));
+    out[2] = (uint8_t)(0x80 | ((rune >> 6) & 0x3F));
+    out[3] = (uint8_t)(0x80 | (rune & 0x3F));
+    return 4;
+}
+
+static uint32_t utf16_read(const uint8_t *p, int big_endian) {
+    return big_endian ? ((uint32_t) p[0] << 8) | p[1] : ((uint32_t) p[1] << 8) | p[0];
+}
+
+static void utf16_write(uint32_t unit, uint8_t *p, int big_endian) {
+    p[big_endian ? 0 : 1] = (uint8_t)(unit >> 8);
+    p[big_endian ? 1 : 0] = (uint8_t) unit;
+}
+
+/* Decode the codepoint at UTF-16 code unit *i, advancing past it. Returns
+ * -1 for an unpaired surrogate. */
+static int32_t utf16_next(const uint8_t *s, size_t units, size_t *i, int big_endian) {
+    uint32_t a = utf16_read(s + 2 * *i, big_endian);
+    (*i)++;
+    if (a < 0xD800 || a > 0xDFFF) return (int32_t) a;
+    if (a > 0xDBFF || *i >= units) return -1;
+    uint32_t b = utf16_read(s + 2 * *i, big_endian);
+    if (b < 0xDC00 || b > 0xDFFF) return -1;
+    (*i)++;
+    return (int32_t)(0x10000 + ((a - 0xD800) << 10) + (b - 0xDC00));
+}
+
+JANET_FN(cfun_utf8_validp,
+        "(utf8/valid? bytes)",
+        "Check if a string, buffer or typed array is well formed UTF-8. Overlong encodings, "
+        "surrogates and codepoints above U+10FFFF are rejected. Uses SIMD on x86 where available.") {
+    janet_fixarity(argc, 1);
+    JanetByteView view = janet_gettarray_bytes(argv, 0);
+    return janet_wrap_boolean(utf8_valid(view.bytes, (size_t) view.len));
+}
+
+JANET_FN(cfun_utf8_count,
+        "(utf8/count bytes)",
+        "Count the codepoints in UTF-8 encoded bytes. Raises an error if the input is not valid UTF-8.") {
+    janet_fixarity(argc, 1);
+    JanetByteView view = utf8_getvalid(argv, 0);
+    return janet_wrap_number((double) utf8_count(view.bytes, (size_t) view.len));
+}
+
+JANET_FN(cfun_utf8_decode_all,
+        "(utf8/decode-all bytes)",
+        "Decode UTF-8 into a new :uint32 typed array of codepoints. "
+        "Raises an error if the input is not valid UTF-8. Requires spork/tarray to be imported.") {
+    janet_fixarity(argc, 1);
+    JanetByteView view = utf8_getvalid(argv, 0);
+    size_t len = (size_t) view.len;
+    JanetTArrayView *ta = janet_tarray_view_new(JANET_TARRAY_TYPE_U32, utf8_count(view.bytes, len));
+    uint32_t *out = ta->as.u32;
+    size_t i = 0;
+    while (i < len) {
+        if (i + 8 <= len && utf8_ascii_word(view.bytes + i)) {
+            for (int j = 0; j < 8; j++) *out++ = view.bytes[i + j];
+            i += 8;
+            continue;
+        }
+        *out++ = utf8_next(view.bytes, &i);
+    }
+    return janet_wrap_abstract(ta);
+}
+
+JANET_FN(cfun_utf8_to_utf16,
+        "(utf8/to-utf16 bytes &opt big-endian)",
+        "Convert UTF-8 to UTF-16, little endian unless `big-endian` is true. Returns a string. "
+        "Raises an error if the input is not valid UTF-8.") {
+    janet_arity(argc, 1, 2);
+    JanetByteView view = utf8_getvalid(argv, 0);
+    int big_endian = janet_optboolean(argv, argc, 1, 0);
+    size_t len = (size_t) view.len;
+    size_t units = utf8_count(view.bytes, len);
+    for (size_t i = 0; i < len; i++) {
+        units += view.bytes[i] >= 0xF0;
+    }
+    if (units > INT32_MAX / 2) janet_panic("output too large");
+    uint8_t *out = janet_string_begin((int32_t)(2 * units));
+    uint8_t *p = out;
+    size_t i = 0;
+    while (i < len) {
+        uint32_t rune = utf8_next(view.bytes, &i);
+        if (rune >= 0x10000) {
+            rune -= 0x10000;
+            utf16_write(0xD800 | (rune >> 10), p, big_endian);
+            utf16_write(0xDC00 | (rune & 0x3FF), p + 2, big_endian);
+            p += 4;
+        } else {
+            utf16_write(rune, p, big_endian);
+            p += 2;
+        }
+    }
+    return janet_wrap_string(janet_string_end(out));
+}
+
+JANET_FN(cfun_utf8_from_utf16,
+        "(utf8/from-utf16 bytes &opt big-endian)",
+        "Convert UTF-16, little endian unless `big-endian` is true, to UTF-8. Returns a string. "
+        "`bytes` can also be a :uint16 typed array. Raises an error on unpaired surrogates.") {
+    janet_arity(argc, 1, 2);
+    JanetByteView view = janet_gettarray_bytes(argv, 0);
+    int big_endian = janet_optboolean(argv, argc, 1, 0);
+    if (view.len & 1) janet_panicf("utf-16 input must have an even number of bytes, got %d", view.len);
+    size_t units = (size_t) view.len / 2;
+    size_t outlen = 0;
+    size_t i = 0;
+    while (i < units) {
+        size_t at = i;
+        int32_t rune = utf16_next(view.bytes, units, &i, big_endian);
+        if (rune < 0) janet_panicf("unpaired surrogate at byte %d", (int32_t)(2 * at));
+        outlen += rune < 0x80 ? 1 : rune < 0x800 ? 2 : rune < 0x10000 ? 3 : 4;
+    }
+    if (outlen > INT32_MAX) janet_panic("output too large");
+    uint8_t *out = janet_string_begin((int32_t) outlen);
+    uint8_t *p = out;
+    i = 0;
+    while (i < units) {
+        p += utf8_put((uint32_t) utf16_next(view.bytes, units, &i, big_endian), p);
+    }
+    return janet_wrap_string(janet_string_end(out));
+}
+
+JANET_FN(cfun_utf8_to_latin1,
+        "(utf8/to-latin1 bytes)",
+        "Convert UTF-8 to Latin-1 (ISO 8859-1). Returns a string. Raises an error if the "
+        "input is not valid UTF-8 or contains codepoints above U+FF.") {
+    janet_fixarity(argc, 1);
+    JanetByteView view = utf8_getvalid(argv, 0);
+    size_t len = (size_t) view.len;
+    uint8_t *out = janet_string_begin((int32_t) utf8_count(view.bytes, len));
+    uint8_t *p = out;
+    size_t i = 0;
+    while (i < len) {
+        if (i + 8 <= len && utf8_ascii_word(view.bytes + i)) {
+            memcpy(p, view.bytes + i, 8);
+            p += 8;
+            i += 8;
+            continue;
+        }
+        size_t at = i;
+        uint32_t rune = utf8_next(view.bytes, &i);
+        if (rune > 0xFF) janet_panicf("codepoint U+%X at byte %d is not in latin-1", rune, (int32_t) at);
+        *p++ = (uint8_t) rune;
+    }
+    return janet_wrap_string(janet_string_end(out));
+}
+
+JANET_FN(cfun_utf8_from_latin1,
+        "(utf8/from-latin1 bytes)",
+        "Convert Latin-1 (ISO 8859-1) to UTF-8. Returns a string.") {
+    janet_fixarity(argc, 1);
+    JanetByteView view = janet_gettarray_bytes(argv, 0);
+    size_t len = (size_t) view.len;
+    size_t outlen = len;
+    for (size_t i = 0; i < len; i++) {
+        outlen += view.bytes[i] >> 7;
+    }
+    if (outlen > INT32_MAX) janet_panic("output too large");
+    uint8_t *out = janet_string_begin((int32_t) outlen);
+    uint8_t *p = out;
+    size_t i = 0;
+    while (i < len) {
+        if (i + 8 <= len && utf8_ascii_word(view.bytes + i)) {
+            memcpy(p, view.bytes + i, 8);
+            p += 8;
+            i += 8;
+            continue;
+        }
+        p += utf8_put(view.bytes[i++], p);
+    }
+    return janet_wrap_string(janet_string_end(out));
+}
+
 JANET_MODULE_ENTRY(JanetTable *env) {
     JanetRegExt cfuns[] = {
         JANET_REG("decode-rune", cfun_utf8_decode_rune),
         JANET_REG("encode-rune", cfun_utf8_encode_rune),
         JANET_REG("prefix->width", cfun_utf8_prefixtowidth),
+        JANET_REG("valid?", cfun_utf8_validp),
+        JANET_REG("count", cfun_utf8_count),
+        JANET_REG("decode-all", cfun_utf8_decode_all),
+        JANET_REG("to-utf16", cfun_utf8_to_utf16),
+        JANET_REG("from-utf16", cfun_utf8_from_utf16),
+        JANET_REG("to-latin1", cfun_utf8_to_latin1),
+        JANET_REG("from-latin1", cfun_utf8_from_latin1),
         JANET_REG_END
     };
+    utf8_simd_init();
     janet_cfuns_ext(env, "utf8", cfuns);
 }
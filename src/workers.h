@@ -0,0 +1,136 @@
+/*
+* Copyright (c) 2026 Calvin Rose and contributors
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+ * Tiny fork/join helper shared by native modules that want to spread a
+ * fixed number of independent jobs over OS threads. Header only so that
+ * each module stays a single shared object.
+ *
+ * Job functions run outside of the Janet VM - they must not allocate Janet
+ * values or panic. Record failures in the job context and report them once
+ * spork_parallel_for returns.
+ */
+
+#ifndef SPORK_WORKERS_H_defined
+#define SPORK_WORKERS_H_defined
+
+#include <janet.h>
+
+#ifdef JANET_WINDOWS
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define SPORK_MAX_WORKERS 256
+
+typedef void (*SporkJobFn)(void *ctx, int32_t job);
+
+typedef struct {
+    SporkJobFn fn;
+    void *ctx;
+    int32_t count;
+    JanetAtomicInt next;
+} SporkJobQueue;
+
+static int32_t spork_cpu_count(void) {
+#ifdef JANET_WINDOWS
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int32_t) info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (int32_t) n;
+#else
+    return 1;
+#endif
+}
+
+/* Get a worker count from an optional argument, defaulting to the number of cpus. */
+static int32_t spork_optworkers(const Janet *argv, int32_t argc, int32_t n) {
+    int32_t workers = (argc > n && !janet_checktype(argv[n], JANET_NIL))
+                      ? janet_getnat(argv, n)
+                      : spork_cpu_count();
+    if (workers < 1) workers = 1;
+    if (workers > SPORK_MAX_WORKERS) workers = SPORK_MAX_WORKERS;
+    return workers;
+}
+
+static void spork_jobs_drain(SporkJobQueue *queue) {
+    for (;;) {
+        int32_t job = janet_atomic_inc(&queue->next) - 1;
+        if (job >= queue->count) break;
+        queue->fn(queue->ctx, job);
+    }
+}
+
+#ifdef JANET_WINDOWS
+static DWORD WINAPI spork_worker_main(LPVOID p) {
+    spork_jobs_drain((SporkJobQueue *) p);
+    return 0;
+}
+#else
+static void *spork_worker_main(void *p) {
+    spork_jobs_drain((SporkJobQueue *) p);
+    return NULL;
+}
+#endif
+
+/* Run fn(ctx, 0) ... fn(ctx, count - 1) on up to `workers` threads, including
+ * the calling thread. Blocks until every job has finished. If a thread cannot
+ * be started, the remaining threads pick up its share of the work. */
+static void spork_parallel_for(int32_t workers, int32_t count, SporkJobFn fn, void *ctx) {
+    SporkJobQueue queue;
+    queue.fn = fn;
+    queue.ctx = ctx;
+    queue.count = count;
+    queue.next = 0;
+    if (workers > count) workers = count;
+    if (workers > SPORK_MAX_WORKERS) workers = SPORK_MAX_WORKERS;
+    int32_t started = 0;
+#ifdef JANET_WINDOWS
+    HANDLE threads[SPORK_MAX_WORKERS];
+    for (int32_t i = 1; i < workers; i++) {
+        HANDLE h = CreateThread(NULL, 0, spork_worker_main, &queue, 0, NULL);
+        if (h == NULL) break;
+        threads[started++] = h;
+    }
+    spork_jobs_drain(&queue);
+    for (int32_t i = 0; i < started; i++) {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+#else
+    pthread_t threads[SPORK_MAX_WORKERS];
+    for (int32_t i = 1; i < workers; i++) {
+        if (pthread_create(&threads[started], NULL, spork_worker_main, &queue)) break;
+        started++;
+    }
+    spork_jobs_drain(&queue);
+    for (int32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+}
+
+#endif /* SPORK_WORKERS_H_defined */
@@ -2,31 +2,184 @@
  * Wrapper around miniz for compression functionality.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <janet.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
 #include "../deps/miniz/miniz.h"
+#include "workers.h"
+#include "checksum.h"
+
+#ifdef JANET_WINDOWS
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <utime.h>
+#endif
 
 /* helpers */
 
+static void put_le16(uint8_t *p, uint16_t x) {
+    p[0] = (uint8_t) x;
+    p[1] = (uint8_t)(x >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t x) {
+    put_le16(p, (uint16_t) x);
+    put_le16(p + 2, (uint16_t)(x >> 16));
+}
+
+static void put_le64(uint8_t *p, uint64_t x) {
+    put_le32(p, (uint32_t) x);
+    put_le32(p + 4, (uint32_t)(x >> 32));
+}
+
 static mz_uint miniz_optflags(const Janet *argv, int32_t argc, int32_t n) {
     if (argc <= n || janet_checktype(argv[n], JANET_NIL)) return 0;
     return (mz_uint) janet_getflags(argv, n, "ipcslh6rfw") << 8;
 }
 
+/* Parallel deflate
+ *
+ * Like pigz, input is cut into blocks that are compressed independently on
+ * worker threads. Every block but the last ends with a sync flush, which
+ * leaves the output byte aligned and not final, so the compressed blocks can
+ * simply be concatenated into one deflate stream. Checksums are computed per
+ * block and combined afterwards. */
+
+#define ZIP_PARALLEL_BLOCK (256 * 1024)
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    int flags; /* tdefl flags, or -1 to only checksum the block */
+    int last;
+    uint8_t *out;
+    size_t out_len;
+    size_t out_capacity;
+    uint32_t crc;
+    uint32_t adler;
+    int failed;
+} DeflateBlock;
+
+static mz_bool deflate_block_out(const void *buf, int len, void *user) {
+    DeflateBlock *block = user;
+    if (block->out_len + (size_t) len > block->out_capacity) {
+        size_t capacity = 2 * block->out_capacity + (size_t) len;
+        uint8_t *out = realloc(block->out, capacity);
+        if (out == NULL) return MZ_FALSE;
+        block->out = out;
+        block->out_capacity = capacity;
+    }
+    memcpy(block->out + block->out_len, buf, (size_t) len);
+    block->out_len += (size_t) len;
+    return MZ_TRUE;
+}
+
+static void deflate_block_job(void *ctx, int32_t job) {
+    DeflateBlock *block = ((DeflateBlock *) ctx) + job;
+    block->crc = (uint32_t) mz_crc32(MZ_CRC32_INIT, block->data, block->len);
+    block->adler = (uint32_t) mz_adler32(MZ_ADLER32_INIT, block->data, block->len);
+    if (block->flags < 0) return;
+    tdefl_compressor *deflator = malloc(sizeof(tdefl_compressor));
+    if (deflator == NULL) {
+        block->failed = 1;
+        return;
+    }
+    tdefl_init(deflator, deflate_block_out, block, block->flags);
+    tdefl_status status = tdefl_compress_buffer(deflator, block->data, block->len,
+                          block->last ? TDEFL_FINISH : TDEFL_SYNC_FLUSH);
+    if (status != (block->last ? TDEFL_STATUS_DONE : TDEFL_STATUS_OKAY)) block->failed = 1;
+    free(deflator);
+}
+
+/* Split data into blocks, returning the number of blocks written to `blocks`.
+ * Passing NULL only counts them. Empty data still gets one (final) block. */
+static size_t deflate_split(DeflateBlock *blocks, const uint8_t *data, size_t len, int flags) {
+    size_t count = len == 0 ? 1 : (len + ZIP_PARALLEL_BLOCK - 1) / ZIP_PARALLEL_BLOCK;
+    if (blocks == NULL) return count;
+    for (size_t i = 0; i < count; i++) {
+        DeflateBlock *block = blocks + i;
+        memset(block, 0, sizeof(DeflateBlock));
+        block->data = data + i * ZIP_PARALLEL_BLOCK;
+        block->len = (i + 1 == count) ? len - i * ZIP_PARALLEL_BLOCK : ZIP_PARALLEL_BLOCK;
+        block->flags = flags;
+        block->last = (i + 1 == count);
+    }
+    return count;
+}
+
+static void deflate_blocks_free(DeflateBlock *blocks, size_t count) {
+    for (size_t i = 0; i < count; i++) free(blocks[i].out);
+    free(blocks);
+}
+
+static int deflate_level_flags(int32_t level) {
+    return (int) tdefl_create_comp_flags_from_zip_params(level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+}
+
 /* General compression functionality */
 
+/* Compress into a zlib stream with the blocks spread over worker threads. */
+static void compress_parallel(JanetBuffer *buffer, JanetByteView bytes, int32_t level, int32_t workers) {
+    size_t count = deflate_split(NULL, bytes.bytes, (size_t) bytes.len, 0);
+    DeflateBlock *blocks = calloc(count, sizeof(DeflateBlock));
+    if (blocks == NULL) {
+        JANET_OUT_OF_MEMORY;
+    }
+    deflate_split(blocks, bytes.bytes, (size_t) bytes.len, deflate_level_flags(level));
+    spork_parallel_for(workers, (int32_t) count, deflate_block_job, blocks);
+    uint64_t total = 6;
+    uint32_t adler = blocks[0].adler;
+    for (size_t i = 0; i < count; i++) {
+        if (blocks[i].failed) {
+            deflate_blocks_free(blocks, count);
+            janet_panic("compression failed");
+        }
+        total += blocks[i].out_len;
+        if (i > 0) adler = spork_adler32_combine(adler, blocks[i].adler, blocks[i].len);
+    }
+    if (total > (uint64_t)(INT32_MAX - buffer->count)) {
+        deflate_blocks_free(blocks, count);
+        janet_panic("too large to compress");
+    }
+    /* zlib header with the level hint zlib itself would write */
+    uint8_t header[2] = {0x78, level < 2 ? 0x01 : level < 6 ? 0x5E : level == 6 ? 0x9C : 0xDA};
+    janet_buffer_push_bytes(buffer, header, 2);
+    for (size_t i = 0; i < count; i++) {
+        janet_buffer_push_bytes(buffer, blocks[i].out, (int32_t) blocks[i].out_len);
+    }
+    uint8_t trailer[4] = {(uint8_t)(adler >> 24), (uint8_t)(adler >> 16), (uint8_t)(adler >> 8), (uint8_t) adler};
+    janet_buffer_push_bytes(buffer, trailer, 4);
+    deflate_blocks_free(blocks, count);
+}
+
 JANET_FN(cfun_compress,
-        "(zip/compress bytes &opt level into)",
+        "(zip/compress bytes &opt level into workers)",
         "Compress data and write to a buffer. Different compression levels can "
         "be used - higher compression levels trade smaller output with longer compression times. "
-        "Returns `into`. If `into` not provided, a new buffer is created.") {
-    janet_arity(argc, 1, 3);
+        "Returns `into`. If `into` not provided, a new buffer is created. If `workers` is given, "
+        "large inputs are cut into blocks that are compressed in parallel on up to that many threads. "
+        "The output is still a single zlib stream.") {
+    janet_arity(argc, 1, 4);
     JanetByteView bytes = janet_getbytes(argv, 0);
     int32_t level = janet_optinteger(argv, argc, 1, MZ_DEFAULT_LEVEL);
     if (level < 0 || level > 10) {
         janet_panicf("compression level must be between 0 and 10, got %d", level);
     }
     JanetBuffer *buffer = janet_optbuffer(argv, argc, 2, (bytes.len / 2) + 10);
+    if (argc > 3 && !janet_checktype(argv[3], JANET_NIL)) {
+        int32_t workers = spork_optworkers(argv, argc, 3);
+        if (workers > 1 && bytes.len > ZIP_PARALLEL_BLOCK) {
+            compress_parallel(buffer, bytes, level, workers);
+            return janet_wrap_buffer(buffer);
+        }
+    }
     mz_ulong dest_len;
     int status;
     do {
@@ -67,30 +220,594 @@ JANET_FN(cfun_decompress,
     return janet_wrap_buffer(buffer);
 }
 
+/* Streaming compression
+ *
+ * Compressors and decompressors that work on a chunk at a time, with zlib,
+ * gzip or raw deflate framing. tdefl and tinfl handle zlib themselves, gzip
+ * headers and trailers are done here. */
+
+enum {
+    ZIP_FORMAT_ZLIB,
+    ZIP_FORMAT_GZIP,
+    ZIP_FORMAT_RAW
+};
+
+static int zip_optformat(const Janet *argv, int32_t argc, int32_t n) {
+    if (argc <= n || janet_checktype(argv[n], JANET_NIL)) return ZIP_FORMAT_ZLIB;
+    JanetKeyword kw = janet_getkeyword(argv, n);
+    if (!janet_cstrcmp(kw, "zlib")) return ZIP_FORMAT_ZLIB;
+    if (!janet_cstrcmp(kw, "gzip")) return ZIP_FORMAT_GZIP;
+    if (!janet_cstrcmp(kw, "raw")) return ZIP_FORMAT_RAW;
+    janet_panicf("expected :zlib, :gzip or :raw, got %v", argv[n]);
+}
+
+static int32_t zip_optlevel(const Janet *argv, int32_t argc, int32_t n) {
+    int32_t level = janet_optinteger(argv, argc, n, MZ_DEFAULT_LEVEL);
+    if (level < 0 || level > 10) {
+        janet_panicf("compression level must be between 0 and 10, got %d", level);
+    }
+    return level;
+}
+
+typedef struct {
+    tdefl_compressor *deflator;
+    int format;
+    int32_t level;
+    int started;
+    int finished;
+    uint32_t crc;
+    uint32_t size;
+} ZipCompressor;
+
+static int compressor_gc(void *p, size_t size) {
+    (void) size;
+    ZipCompressor *c = p;
+    free(c->deflator);
+    c->deflator = NULL;
+    return 0;
+}
+
+static int compressor_get(void *p, Janet key, Janet *out);
+
+static const JanetAbstractType zip_compressor_type = {
+    .name = "zip/compressor",
+    .gc = compressor_gc,
+    .get = compressor_get
+};
+
+/* The caller allocates the deflator, so one shot compression can use scratch
+ * memory that is released if compression panics. */
+static void compressor_init(ZipCompressor *c, tdefl_compressor *deflator, int format, int32_t level) {
+    c->format = format;
+    c->level = level;
+    c->started = 0;
+    c->finished = 0;
+    c->crc = (uint32_t) mz_crc32(MZ_CRC32_INIT, NULL, 0);
+    c->size = 0;
+    c->deflator = deflator;
+    int flags = deflate_level_flags(level);
+    if (format == ZIP_FORMAT_ZLIB) flags |= TDEFL_WRITE_ZLIB_HEADER;
+    tdefl_init(c->deflator, NULL, NULL, flags);
+}
+
+/* Feed bytes to the compressor and append whatever it produces to `into`. */
+static void compressor_run(ZipCompressor *c, const uint8_t *bytes, size_t len, tdefl_flush flush, JanetBuffer *into) {
+    if (c->finished) janet_panic("compressor is already finished");
+    if (!c->started && c->format == ZIP_FORMAT_GZIP) {
+        /* No name or mtime, OS unknown */
+        uint8_t header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+        header[8] = c->level >= 9 ? 2 : c->level == 1 ? 4 : 0;
+        janet_buffer_push_bytes(into, header, sizeof(header));
+    }
+    c->started = 1;
+    if (c->format == ZIP_FORMAT_GZIP) {
+        c->crc = (uint32_t) mz_crc32(c->crc, bytes, len);
+        c->size += (uint32_t) len;
+    }
+    for (;;) {
+        janet_buffer_extra(into, 16 * 1024);
+        size_t in_size = len;
+        size_t space = (size_t)(into->capacity - into->count);
+        size_t out_size = space;
+        tdefl_status status = tdefl_compress(c->deflator, bytes, &in_size, into->data + into->count, &out_size, flush);
+        bytes += in_size;
+        len -= in_size;
+        into->count += (int32_t) out_size;
+        if (status < 0) {
+            c->finished = 1;
+            janet_panic("compression failed");
+        }
+        if (status == TDEFL_STATUS_DONE) break;
+        if (len == 0 && out_size < space) break;
+    }
+    if (flush == TDEFL_FINISH) {
+        c->finished = 1;
+        if (c->format == ZIP_FORMAT_GZIP) {
+            uint8_t trailer[8];
+            put_le32(trailer, c->crc);
+            put_le32(trailer + 4, c->size);
+            janet_buffer_push_bytes(into, trailer, sizeof(trailer));
+        }
+    }
+}
+
+JANET_FN(cfun_compressor,
+        "(zip/compressor &opt format level)",
+        "Create a streaming compressor. `format` is one of :zlib (the default), :gzip or :raw for "
+        "deflate data without any framing. Feed it data with `zip/compressor-write` and complete "
+        "the stream with `zip/compressor-finish`. Compressors also have :write, :flush and :finish methods.") {
+    janet_arity(argc, 0, 2);
+    int format = zip_optformat(argv, argc, 0);
+    int32_t level = zip_optlevel(argv, argc, 1);
+    ZipCompressor *c = janet_abstract(&zip_compressor_type, sizeof(ZipCompressor));
+    c->deflator = NULL;
+    tdefl_compressor *deflator = malloc(sizeof(tdefl_compressor));
+    if (deflator == NULL) {
+        JANET_OUT_OF_MEMORY;
+    }
+    compressor_init(c, deflator, format, level);
+    return janet_wrap_abstract(c);
+}
+
+JANET_FN(cfun_compressor_write,
+        "(zip/compressor-write compressor bytes &opt into)",
+        "Compress a chunk of data, appending any output that is ready to `into`, or a new buffer. "
+        "Output may lag behind input until the compressor is flushed or finished. Returns the buffer.") {
+    janet_arity(argc, 2, 3);
+    ZipCompressor *c = janet_getabstract(argv, 0, &zip_compressor_type);
+    JanetByteView bytes = janet_getbytes(argv, 1);
+    JanetBuffer *into = janet_optbuffer(argv, argc, 2, bytes.len / 2 + 16);
+    compressor_run(c, bytes.bytes, (size_t) bytes.len, TDEFL_NO_FLUSH, into);
+    return janet_wrap_buffer(into);
+}
+
+JANET_FN(cfun_compressor_flush,
+        "(zip/compressor-flush compressor &opt into)",
+        "Flush all pending output of a compressor to `into`, or a new buffer, so that a reader can "
+        "decompress everything written so far. Flushing often makes compression worse. Returns the buffer.") {
+    janet_arity(argc, 1, 2);
+    ZipCompressor *c = janet_getabstract(argv, 0, &zip_compressor_type);
+    JanetBuffer *into = janet_optbuffer(argv, argc, 1, 64);
+    compressor_run(c, NULL, 0, TDEFL_SYNC_FLUSH, into);
+    return janet_wrap_buffer(into);
+}
+
+JANET_FN(cfun_compressor_finish,
+        "(zip/compressor-finish compressor &opt into)",
+        "Complete a compressed stream, appending the remaining output and trailer to `into`, or "
+        "a new buffer. The compressor cannot be written to afterwards. Returns the buffer.") {
+    janet_arity(argc, 1, 2);
+    ZipCompressor *c = janet_getabstract(argv, 0, &zip_compressor_type);
+    JanetBuffer *into = janet_optbuffer(argv, argc, 1, 64);
+    compressor_run(c, NULL, 0, TDEFL_FINISH, into);
+    free(c->deflator);
+    c->deflator = NULL;
+    return janet_wrap_buffer(into);
+}
+
+static const JanetMethod compressor_methods[] = {
+    {"write", cfun_compressor_write},
+    {"flush", cfun_compressor_flush},
+    {"finish", cfun_compressor_finish},
+    {NULL, NULL}
+};
+
+static int compressor_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD)) return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), compressor_methods, out);
+}
+
+enum {
+    INFLATE_GZIP_HEADER,
+    INFLATE_BODY,
+    INFLATE_GZIP_TRAILER,
+    INFLATE_MEMBER_END,
+    INFLATE_DONE
+};
+
+enum {
+    GZIP_FIXED,
+    GZIP_XLEN,
+    GZIP_EXTRA,
+    GZIP_NAME,
+    GZIP_COMMENT,
+    GZIP_HCRC
+};
+
+typedef struct {
+    tinfl_decompressor inflator;
+    uint8_t *dict;
+    size_t dict_ofs;
+    int format;
+    int state;
+    int field;
+    uint8_t gzip_flags;
+    uint32_t field_left;
+    uint8_t scratch[10];
+    uint32_t scratch_len;
+    uint32_t crc;
+    uint32_t size;
+} ZipDecompressor;
+
+static int decompressor_gc(void *p, size_t size) {
+    (void) size;
+    ZipDecompressor *d = p;
+    free(d->dict);
+    d->dict = NULL;
+    return 0;
+}
+
+static int decompressor_get(void *p, Janet key, Janet *out);
+
+static const JanetAbstractType zip_decompressor_type = {
+    .name = "zip/decompressor",
+    .gc = decompressor_gc,
+    .get = decompressor_get
+};
+
+static void decompressor_member(ZipDecompressor *d) {
+    tinfl_init(&d->inflator);
+    d->dict_ofs = 0;
+    d->state = d->format == ZIP_FORMAT_GZIP ? INFLATE_GZIP_HEADER : INFLATE_BODY;
+    d->field = GZIP_FIXED;
+    d->scratch_len = 0;
+    d->crc = (uint32_t) mz_crc32(MZ_CRC32_INIT, NULL, 0);
+    d->size = 0;
+}
+
+static void decompressor_init(ZipDecompressor *d, int format) {
+    d->format = format;
+    d->dict = malloc(TINFL_LZ_DICT_SIZE);
+    if (d->dict == NULL) {
+        JANET_OUT_OF_MEMORY;
+    }
+    decompressor_member(d);
+}
+
+/* Move to the next optional gzip header field that is present. */
+static void gzip_next_field(ZipDecompressor *d, int after) {
+    int field = after + 1;
+    if (after == GZIP_HCRC) {
+        d->state = INFLATE_BODY;
+        return;
+    }
+    if (field == GZIP_XLEN && !(d->gzip_flags & 4)) field = GZIP_NAME;
+    if (field == GZIP_EXTRA && d->field_left == 0) field = GZIP_NAME;
+    if (field == GZIP_NAME && !(d->gzip_flags & 8)) field = GZIP_COMMENT;
+    if (field == GZIP_COMMENT && !(d->gzip_flags & 16)) field = GZIP_HCRC;
+    if (field == GZIP_HCRC && !(d->gzip_flags & 2)) {
+        d->state = INFLATE_BODY;
+        return;
+    }
+    d->field = field;
+    d->scratch_len = 0;
+    if (field == GZIP_HCRC) d->field_left = 2;
+}
+
+/* Consume gzip header bytes, returning how many were used. */
+static size_t gzip_header(ZipDecompressor *d, const uint8_t *bytes, size_t len) {
+    size_t i = 0;
+    while (i < len && d->state == INFLATE_GZIP_HEADER) {
+        uint8_t b = bytes[i++];
+        switch (d->field) {
+            case GZIP_FIXED:
+                d->scratch[d->scratch_len++] = b;
+                if (d->scratch_len < 10) break;
+                if (d->scratch[0] != 0x1F || d->scratch[1] != 0x8B || d->scratch[2] != 8 || (d->scratch[3] & 0xE0)) {
+                    janet_panic("invalid gzip header");
+                }
+                d->gzip_flags = d->scratch[3];
+                gzip_next_field(d, GZIP_FIXED);
+                break;
+            case GZIP_XLEN:
+                d->scratch[d->scratch_len++] = b;
+                if (d->scratch_len < 2) break;
+                d->field_left = d->scratch[0] | ((uint32_t) d->scratch[1] << 8);
+                gzip_next_field(d, GZIP_XLEN);
+                break;
+            case GZIP_EXTRA:
+            case GZIP_HCRC:
+                if (--d->field_left == 0) gzip_next_field(d, d->field);
+                break;
+            case GZIP_NAME:
+            case GZIP_COMMENT:
+                if (b == 0) gzip_next_field(d, d->field);
+                break;
+        }
+    }
+    return i;
+}
+
+/* Feed bytes to the decompressor and append the output to `into`. */
+static void decompressor_run(ZipDecompressor *d, const uint8_t *bytes, size_t len, JanetBuffer *into) {
+    mz_uint32 flags = TINFL_FLAG_HAS_MORE_INPUT;
+    if (d->format == ZIP_FORMAT_ZLIB) flags |= TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32;
+    while (len > 0) {
+        switch (d->state) {
+            case INFLATE_DONE:
+                janet_panic("trailing data after compressed stream");
+            case INFLATE_MEMBER_END:
+                /* Concatenated gzip members decompress to the concatenated data */
+                decompressor_member(d);
+                break;
+            case INFLATE_GZIP_HEADER: {
+                size_t used = gzip_header(d, bytes, len);
+                bytes += used;
+                len -= used;
+                break;
+            }
+            case INFLATE_GZIP_TRAILER:
+                d->scratch[d->scratch_len++] = *bytes++;
+                len--;
+                if (d->scratch_len == 8) {
+                    uint32_t crc = d->scratch[0] | ((uint32_t) d->scratch[1] << 8)
+                                   | ((uint32_t) d->scratch[2] << 16) | ((uint32_t) d->scratch[3] << 24);
+                    uint32_t size = d->scratch[4] | ((uint32_t) d->scratch[5] << 8)
+                                    | ((uint32_t) d->scratch[6] << 16) | ((uint32_t) d->scratch[7] << 24);
+                    if (crc != d->crc || size != d->size) janet_panic("gzip checksum mismatch");
+                    d->state = INFLATE_MEMBER_END;
+                }
+                break;
+            case INFLATE_BODY: {
+                size_t in_size = len;
+                size_t out_size = TINFL_LZ_DICT_SIZE - d->dict_ofs;
+                tinfl_status status = tinfl_decompress(&d->inflator, bytes, &in_size,
+                                                       d->dict, d->dict + d->dict_ofs, &out_size, flags);
+                bytes += in_size;
+                len -= in_size;
+                if (out_size > 0) {
+                    janet_buffer_push_bytes(into, d->dict + d->dict_ofs, (int32_t) out_size);
+                    if (d->format == ZIP_FORMAT_GZIP) {
+                        d->crc = (uint32_t) mz_crc32(d->crc, d->dict + d->dict_ofs, out_size);
+                        d->size += (uint32_t) out_size;
+                    }
+                    d->dict_ofs = (d->dict_ofs + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+                }
+                if (status == TINFL_STATUS_ADLER32_MISMATCH) janet_panic("zlib checksum mismatch");
+                if (status < 0) janet_panic("corrupt deflate stream");
+                if (status == TINFL_STATUS_DONE) {
+                    d->state = d->format == ZIP_FORMAT_GZIP ? INFLATE_GZIP_TRAILER : INFLATE_DONE;
+                    d->scratch_len = 0;
+                }
+                break;
+            }
+        }
+    }
+    /* Drain output that tinfl is still holding once the input is used up */
+    while (d->state == INFLATE_BODY) {
+        size_t in_size = 0;
+        size_t out_size = TINFL_LZ_DICT_SIZE - d->dict_ofs;
+        tinfl_status status = tinfl_decompress(&d->inflator, bytes, &in_size,
+                                               d->dict, d->dict + d->dict_ofs, &out_size, flags);
+        if (out_size > 0) {
+            janet_buffer_push_bytes(into, d->dict + d->dict_ofs, (int32_t) out_size);
+            if (d->format == ZIP_FORMAT_GZIP) {
+                d->crc = (uint32_t) mz_crc32(d->crc, d->dict + d->dict_ofs, out_size);
+                d->size += (uint32_t) out_size;
+            }
+            d->dict_ofs = (d->dict_ofs + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+        if (status == TINFL_STATUS_ADLER32_MISMATCH) janet_panic("zlib checksum mismatch");
+        if (status < 0) janet_panic("corrupt deflate stream");
+        if (status == TINFL_STATUS_DONE) {
+            d->state = d->format == ZIP_FORMAT_GZIP ? INFLATE_GZIP_TRAILER : INFLATE_DONE;
+            d->scratch_len = 0;
+        }
+        if (status != TINFL_STATUS_HAS_MORE_OUTPUT) break;
+    }
+}
+
+static void decompressor_finish(ZipDecompressor *d) {
+    if (d->state != INFLATE_DONE && d->state != INFLATE_MEMBER_END) {
+        janet_panic("compressed stream is truncated");
+    }
+}
+
+JANET_FN(cfun_decompressor,
+        "(zip/decompressor &opt format)",
+        "Create a streaming decompressor for :zlib (the default), :gzip or :raw deflate data. "
+        "Feed it compressed chunks with `zip/decompressor-write` and check that the stream was "
+        "complete with `zip/decompressor-finish`. Decompressors also have :write and :finish methods.") {
+    janet_arity(argc, 0, 1);
+    int format = zip_optformat(argv, argc, 0);
+    ZipDecompressor *d = janet_abstract(&zip_decompressor_type, sizeof(ZipDecompressor));
+    decompressor_init(d, format);
+    return janet_wrap_abstract(d);
+}
+
+JANET_FN(cfun_decompressor_write,
+        "(zip/decompressor-write decompressor bytes &opt into)",
+        "Decompress a chunk of compressed data, appending the output to `into`, or a new buffer. "
+        "Checksums are verified as soon as the end of the stream is seen. Returns the buffer.") {
+    janet_arity(argc, 2, 3);
+    ZipDecompressor *d = janet_getabstract(argv, 0, &zip_decompressor_type);
+    JanetByteView bytes = janet_getbytes(argv, 1);
+    JanetBuffer *into = janet_optbuffer(argv, argc, 2, bytes.len * 2 + 16);
+    decompressor_run(d, bytes.bytes, (size_t) bytes.len, into);
+    return janet_wrap_buffer(into);
+}
+
+JANET_FN(cfun_decompressor_finish,
+        "(zip/decompressor-finish decompressor)",
+        "Check that a decompressor has seen a complete stream, raising an error if the input was "
+        "truncated. Returns nil.") {
+    janet_fixarity(argc, 1);
+    ZipDecompressor *d = janet_getabstract(argv, 0, &zip_decompressor_type);
+    decompressor_finish(d);
+    return janet_wrap_nil();
+}
+
+static const JanetMethod decompressor_methods[] = {
+    {"write", cfun_decompressor_write},
+    {"finish", cfun_decompressor_finish},
+    {NULL, NULL}
+};
+
+static int decompressor_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD)) return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), decompressor_methods, out);
+}
+
+JANET_FN(cfun_deflate,
+        "(zip/deflate bytes &opt format level into)",
+        "Compress data in one go with :zlib (the default), :gzip or :raw framing, appending to "
+        "`into` or a new buffer. Returns the buffer.") {
+    janet_arity(argc, 1, 4);
+    JanetByteView bytes = janet_getbytes(argv, 0);
+    int format = zip_optformat(argv, argc, 1);
+    int32_t level = zip_optlevel(argv, argc, 2);
+    JanetBuffer *into = janet_optbuffer(argv, argc, 3, bytes.len / 2 + 32);
+    ZipCompressor c;
+    compressor_init(&c, janet_smalloc(sizeof(tdefl_compressor)), format, level);
+    compressor_run(&c, bytes.bytes, (size_t) bytes.len, TDEFL_FINISH, into);
+    janet_sfree(c.deflator);
+    return janet_wrap_buffer(into);
+}
+
+JANET_FN(cfun_inflate,
+        "(zip/inflate bytes &opt format into)",
+        "Decompress :zlib (the default), :gzip or :raw deflate data in one go, appending to `into` "
+        "or a new buffer. Concatenated gzip members are all decompressed. Returns the buffer.") {
+    janet_arity(argc, 1, 3);
+    JanetByteView bytes = janet_getbytes(argv, 0);
+    int format = zip_optformat(argv, argc, 1);
+    JanetBuffer *into = janet_optbuffer(argv, argc, 2, bytes.len * 2 + 16);
+    ZipDecompressor *d = janet_smalloc(sizeof(ZipDecompressor));
+    d->dict = janet_smalloc(TINFL_LZ_DICT_SIZE);
+    d->format = format;
+    decompressor_member(d);
+    decompressor_run(d, bytes.bytes, (size_t) bytes.len, into);
+    decompressor_finish(d);
+    janet_sfree(d->dict);
+    janet_sfree(d);
+    return janet_wrap_buffer(into);
+}
+
 /* Zip reading */
 
+/* The archive comes first so a reader can be used as an mz_zip_archive. */
+typedef struct {
+    mz_zip_archive archive;
+    Janet source;
+    char *path;
+    void *map;
+    size_t map_len;
+} ZipReader;
+
+static void *zip_map_file(const char *path, size_t *len) {
+#ifdef JANET_WINDOWS
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER size;
+    void *map = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+            map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    *len = map == NULL ? 0 : (size_t) size.QuadPart;
+    return map;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *map = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) map = NULL;
+    } else if (st.st_size == 0) {
+        errno = EINVAL;
+    }
+    close(fd);
+    *len = map == NULL ? 0 : (size_t) st.st_size;
+    return map;
+#endif
+}
+
+static void zip_unmap_file(void *map, size_t len) {
+#ifdef JANET_WINDOWS
+    (void) len;
+    UnmapViewOfFile(map);
+#else
+    munmap(map, len);
+#endif
+}
+
+static void reader_release(ZipReader *reader) {
+    mz_zip_reader_end(&reader->archive);
+    if (reader->map != NULL) {
+        zip_unmap_file(reader->map, reader->map_len);
+        reader->map = NULL;
+    }
+}
+
 static int reader_gc(void *p, size_t size) {
     (void) size;
-    mz_zip_archive *archive = p;
-    mz_zip_reader_end(archive);
+    ZipReader *reader = p;
+    reader_release(reader);
+    free(reader->path);
+    return 0;
+}
+
+static int reader_gcmark(void *p, size_t size) {
+    (void) size;
+    janet_mark(((ZipReader *) p)->source);
     return 0;
 }
 
 static const JanetAbstractType zip_reader_type = {
     .name = "zip/reader",
-    .gc = reader_gc
+    .gc = reader_gc,
+    .gcmark = reader_gcmark
 };
 
+static ZipReader *zip_reader_new(void) {
+    ZipReader *reader = janet_abstract(&zip_reader_type, sizeof(ZipReader));
+    mz_zip_zero_struct(&reader->archive);
+    reader->source = janet_wrap_nil();
+    reader->path = NULL;
+    reader->map = NULL;
+    reader->map_len = 0;
+    return reader;
+}
+
 JANET_FN(cfun_read_file,
         "(zip/read-file filename &opt flags)",
         "Read a file as a zip archive. Returns a new zip reader.") {
     janet_arity(argc, 1, 2);
     const char *path = janet_getcstring(argv, 0);
-    mz_zip_archive *archive = janet_abstract(&zip_reader_type, sizeof(mz_zip_archive));
     mz_uint flags = miniz_optflags(argv, argc, 1);
-    mz_zip_zero_struct(archive);
-    mz_zip_reader_init_file_v2(archive, path, MZ_DEFAULT_COMPRESSION, flags, 0);
-    return janet_wrap_abstract(archive);
+    ZipReader *reader = zip_reader_new();
+    reader->path = strdup(path);
+    mz_zip_reader_init_file_v2(&reader->archive, path, MZ_DEFAULT_COMPRESSION, flags, 0);
+    return janet_wrap_abstract(reader);
+}
+
+JANET_FN(cfun_map_file,
+        "(zip/map-file filename &opt flags)",
+        "Memory map a file and read it as a zip archive. Unlike `zip/read-file`, entries are read "
+        "straight from the mapping instead of through stdio, and several threads can extract "
+        "from it at once. Returns a new zip reader.") {
+    janet_arity(argc, 1, 2);
+    const char *path = janet_getcstring(argv, 0);
+    mz_uint flags = miniz_optflags(argv, argc, 1);
+    ZipReader *reader = zip_reader_new();
+    reader->map = zip_map_file(path, &reader->map_len);
+    if (reader->map == NULL) {
+        janet_panicf("could not map %s: %s", path, strerror(errno));
+    }
+    reader->path = strdup(path);
+    if (!mz_zip_reader_init_mem(&reader->archive, reader->map, reader->map_len, flags)) {
+        reader_release(reader);
+        janet_panicf("could not read %s as a zip archive: %s", path,
+                     mz_zip_get_error_string(mz_zip_get_last_error(&reader->archive)));
+    }
+    return janet_wrap_abstract(reader);
 }
 
 JANET_FN(cfun_read_bytes,
@@ -98,11 +815,11 @@ JANET_FN(cfun_read_bytes,
         "Read a byte sequence as a zip archive. Returns a new zip reader.") {
     janet_arity(argc, 1, 2);
     JanetByteView bytes = janet_getbytes(argv, 0);
-    mz_zip_archive *archive = janet_abstract(&zip_reader_type, sizeof(mz_zip_archive));
     mz_uint flags = miniz_optflags(argv, argc, 1);
-    mz_zip_zero_struct(archive);
-    mz_zip_reader_init_mem(archive, bytes.bytes, bytes.len, flags);
-    return janet_wrap_abstract(archive);
+    ZipReader *reader = zip_reader_new();
+    reader->source = argv[0];
+    mz_zip_reader_init_mem(&reader->archive, bytes.bytes, bytes.len, flags);
+    return janet_wrap_abstract(reader);
 }
 
 JANET_FN(cfun_reader_count,
@@ -117,8 +834,8 @@ JANET_FN(cfun_reader_close,
         "(zip/reader-close reader)",
         "Close a reader and free related memory.") {
     janet_fixarity(argc, 1);
-    mz_zip_archive *archive = janet_getabstract(argv, 0, &zip_reader_type);
-    mz_zip_reader_end(archive);
+    ZipReader *reader = janet_getabstract(argv, 0, &zip_reader_type);
+    reader_release(reader);
     return janet_wrap_nil();
 }
 
@@ -262,6 +979,349 @@ JANET_FN(cfun_reader_extract,
     return janet_wrap_buffer(into);
 }
 
+/* Parallel extraction */
+
+typedef struct {
+    mz_uint index;
+    char *path;
+    int failed;
+} ZipExtractJob;
+
+typedef struct {
+    mz_zip_archive *archive;
+    ZipExtractJob *jobs;
+} ZipExtractBatch;
+
+static void zip_extract_job(void *ctx, int32_t i) {
+    ZipExtractBatch *batch = ctx;
+    ZipExtractJob *job = batch->jobs + i;
+    /* Sets the modification time of the file as well */
+    if (!mz_zip_reader_extract_to_file(batch->archive, job->index, job->path, 0)) {
+        job->failed = 1;
+    }
+}
+
+/* Reject absolute paths and parent directory references so that an archive
+ * cannot write outside of the destination directory. */
+static int zip_path_is_safe(const char *name) {
+    if (name[0] == '/' || name[0] == '\\' || name[0] == '\0') return 0;
+    if (strchr(name, ':') != NULL) return 0;
+    const char *part = name;
+    for (;;) {
+        size_t len = strcspn(part, "/\\");
+        if (len == 2 && part[0] == '.' && part[1] == '.') return 0;
+        if (part[len] == '\0') return 1;
+        part += len + 1;
+    }
+}
+
+static int zip_mkdir(const char *path) {
+#ifdef JANET_WINDOWS
+    int status = _mkdir(path);
+#else
+    int status = mkdir(path, 0755);
+#endif
+    return status == 0 || errno == EEXIST;
+}
+
+/* Create every directory leading up to the last separator in path. */
+static int zip_mkdirs(char *path, size_t dest_len) {
+    for (char *c = path + dest_len + 1; *c; c++) {
+#ifdef JANET_WINDOWS
+        if (*c != '/' && *c != '\\') continue;
+#else
+        if (*c != '/') continue;
+#endif
+        char sep = *c;
+        *c = '\0';
+        int ok = zip_mkdir(path);
+        *c = sep;
+        if (!ok) return 0;
+    }
+    return 1;
+}
+
+static void zip_extract_cleanup(ZipExtractJob *jobs, int32_t count, ZipReader *temp) {
+    for (int32_t i = 0; i < count; i++) janet_sfree(jobs[i].path);
+    janet_sfree(jobs);
+    if (temp != NULL) {
+        reader_release(temp);
+        janet_sfree(temp);
+    }
+}
+
+static int zip_extract_wanted(mz_zip_archive *archive, mz_uint index, Janet filter) {
+    if (janet_checktype(filter, JANET_NIL)) return 1;
+    char name[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
+    mz_zip_reader_get_filename(archive, index, name, sizeof(name));
+    Janet arg = janet_cstringv(name);
+    return janet_truthy(janet_call(janet_unwrap_function(filter), 1, &arg));
+}
+
+JANET_FN(cfun_reader_extract_all,
+        "(zip/extract-all reader dest &opt filter workers)",
+        "Extract entries of a zip archive into the directory `dest`, keeping the directory "
+        "structure and modification times stored in the archive. `filter` selects what to "
+        "extract: nil for everything, an array of filenames or indices, or a function that is "
+        "called with each filename and returns truthy to extract it. Files are written in "
+        "parallel on up to `workers` threads (default the number of cpus). Entries with absolute "
+        "paths or `..` components are rejected. Returns the number of entries extracted.") {
+    janet_arity(argc, 2, 4);
+    ZipReader *reader = janet_getabstract(argv, 0, &zip_reader_type);
+    JanetByteView dest = janet_getbytes(argv, 1);
+    Janet filter = argc > 2 ? argv[2] : janet_wrap_nil();
+    int32_t workers = spork_optworkers(argv, argc, 3);
+    mz_zip_archive *archive = &reader->archive;
+    if (archive->m_zip_mode != MZ_ZIP_MODE_READING) janet_panic("zip reader is not open");
+
+    /* Pick entries */
+    const Janet *items = NULL;
+    int32_t count = (int32_t) mz_zip_reader_get_num_files(archive);
+    if (janet_indexed_view(filter, &items, &count)) {
+        filter = janet_wrap_nil();
+    } else if (!janet_checktype(filter, JANET_NIL) && !janet_checktype(filter, JANET_FUNCTION)) {
+        janet_panicf("expected nil, indexed or function filter, got %v", filter);
+    }
+    ZipExtractJob *jobs = janet_smalloc(sizeof(ZipExtractJob) * (size_t)(count > 0 ? count : 1));
+    int32_t njobs = 0;
+    for (int32_t i = 0; i < count; i++) {
+        mz_uint index = (mz_uint) i;
+        if (items != NULL) {
+            if (janet_checktype(items[i], JANET_STRING)) {
+                int found = mz_zip_reader_locate_file(archive, (const char *) janet_unwrap_string(items[i]), NULL, 0);
+                if (found < 0) {
+                    zip_extract_cleanup(jobs, njobs, NULL);
+                    janet_panicf("no file %v in zip archive", items[i]);
+                }
+                index = (mz_uint) found;
+            } else {
+                index = (mz_uint) janet_getinteger(items, i);
+            }
+            if (index >= mz_zip_reader_get_num_files(archive)) {
+                zip_extract_cleanup(jobs, njobs, NULL);
+                janet_panicf("zip entry index %d out of range", (int32_t) index);
+            }
+        }
+        if (!zip_extract_wanted(archive, index, filter)) continue;
+        mz_zip_archive_file_stat st;
+        if (!mz_zip_reader_file_stat(archive, index, &st)) {
+            zip_extract_cleanup(jobs, njobs, NULL);
+            janet_panicf("could not stat zip entry %d", (int32_t) index);
+        }
+        if (!zip_path_is_safe(st.m_filename)) {
+            zip_extract_cleanup(jobs, njobs, NULL);
+            janet_panicf("unsafe path in zip archive: %s", st.m_filename);
+        }
+        if (!st.m_is_supported) {
+            zip_extract_cleanup(jobs, njobs, NULL);
+            janet_panicf("unsupported zip entry: %s", st.m_filename);
+        }
+        size_t name_len = strlen(st.m_filename);
+        char *path = janet_smalloc((size_t) dest.len + name_len + 2);
+        memcpy(path, dest.bytes, (size_t) dest.len);
+        path[dest.len] = '/';
+        memcpy(path + dest.len + 1, st.m_filename, name_len + 1);
+        jobs[njobs].index = index;
+        jobs[njobs].path = path;
+        jobs[njobs].failed = 0;
+        njobs++;
+    }
+
+    /* Directories are made up front on this thread, files go to the workers */
+    char *dest_path = janet_smalloc((size_t) dest.len + 1);
+    memcpy(dest_path, dest.bytes, (size_t) dest.len);
+    dest_path[dest.len] = '\0';
+    int ok = zip_mkdir(dest_path);
+    janet_sfree(dest_path);
+    int32_t nfiles = 0;
+    for (int32_t i = 0; ok && i < njobs; i++) {
+        ok = zip_mkdirs(jobs[i].path, (size_t) dest.len);
+        /* Directory entries need not end in a separator */
+        if (ok && mz_zip_reader_is_file_a_directory(archive, jobs[i].index)) {
+            ok = zip_mkdir(jobs[i].path);
+            continue;
+        }
+        /* Keep files before directories */
+        ZipExtractJob job = jobs[i];
+        jobs[i] = jobs[nfiles];
+        jobs[nfiles++] = job;
+    }
+    if (!ok) {
+        const char *reason = strerror(errno);
+        zip_extract_cleanup(jobs, njobs, NULL);
+        janet_panicf("could not create directories in %S: %s", janet_string(dest.bytes, dest.len), reason);
+    }
+
+    /* stdio readers share one FILE, so map the archive for the workers */
+    ZipReader *temp = NULL;
+    ZipExtractBatch batch;
+    batch.archive = archive;
+    batch.jobs = jobs;
+    if (archive->m_zip_type == MZ_ZIP_TYPE_FILE && reader->path != NULL && workers > 1 && nfiles > 1) {
+        temp = janet_smalloc(sizeof(ZipReader));
+        memset(temp, 0, sizeof(ZipReader));
+        temp->map = zip_map_file(reader->path, &temp->map_len);
+        if (temp->map != NULL && mz_zip_reader_init_mem(&temp->archive, temp->map, temp->map_len, 0)
+                && mz_zip_reader_get_num_files(&temp->archive) == mz_zip_reader_get_num_files(archive)) {
+            batch.archive = &temp->archive;
+        } else {
+            workers = 1;
+        }
+    } else if (archive->m_zip_type == MZ_ZIP_TYPE_FILE) {
+        workers = 1;
+    }
+    spork_parallel_for(workers, nfiles, zip_extract_job, &batch);
+
+    /* Writing files touches their directories, so set directory times last */
+    for (int32_t i = nfiles; i < njobs; i++) {
+        mz_zip_archive_file_stat st;
+        if (mz_zip_reader_file_stat(archive, jobs[i].index, &st)) {
+#ifdef JANET_WINDOWS
+            struct _utimbuf times;
+            times.actime = st.m_time;
+            times.modtime = st.m_time;
+            _utime(jobs[i].path, &times);
+#else
+            struct utimbuf times;
+            times.actime = st.m_time;
+            times.modtime = st.m_time;
+            utime(jobs[i].path, &times);
+#endif
+        }
+    }
+    for (int32_t i = 0; i < nfiles; i++) {
+        if (jobs[i].failed) {
+            Janet path = janet_cstringv(jobs[i].path);
+            zip_extract_cleanup(jobs, njobs, temp);
+            janet_panicf("failed to extract %v", path);
+        }
+    }
+    zip_extract_cleanup(jobs, njobs, temp);
+    return janet_wrap_integer(njobs);
+}
+
+/* Streaming entry reading */
+
+typedef struct {
+    Janet reader;
+    mz_zip_archive *archive;
+    mz_zip_reader_extract_iter_state *iter;
+    int owns_read_buf;
+} ZipEntryReader;
+
+/* Free the iterator without going through the archive, which may already be
+ * gone when both are collected in the same cycle. miniz uses malloc and free
+ * unless told otherwise. */
+static void zip_entry_discard(ZipEntryReader *entry) {
+    if (entry->iter == NULL) return;
+    if (entry->owns_read_buf) free(entry->iter->pRead_buf);
+    free(entry->iter->pWrite_buf);
+    free(entry->iter);
+    entry->iter = NULL;
+}
+
+static int zip_entry_gc(void *p, size_t size) {
+    (void) size;
+    zip_entry_discard((ZipEntryReader *) p);
+    return 0;
+}
+
+static int zip_entry_gcmark(void *p, size_t size) {
+    (void) size;
+    janet_mark(((ZipEntryReader *) p)->reader);
+    return 0;
+}
+
+static int zip_entry_get(void *p, Janet key, Janet *out);
+
+static const JanetAbstractType zip_entry_reader_type = {
+    .name = "zip/entry-reader",
+    .gc = zip_entry_gc,
+    .gcmark = zip_entry_gcmark,
+    .get = zip_entry_get
+};
+
+static void zip_entry_check_reader(ZipEntryReader *entry) {
+    if (entry->archive->m_zip_mode != MZ_ZIP_MODE_READING) {
+        zip_entry_discard(entry);
+        janet_panic("zip reader was closed");
+    }
+}
+
+JANET_FN(cfun_open_entry,
+        "(zip/open-entry reader idx-or-filename &opt flags)",
+        "Open a file in a zip archive for reading in chunks with `zip/entry-read`, so that "
+        "large files can be processed without decompressing them into memory at once. "
+        "Returns a new entry reader.") {
+    janet_arity(argc, 2, 3);
+    mz_zip_archive *archive = janet_getabstract(argv, 0, &zip_reader_type);
+    mz_uint flags = miniz_optflags(argv, argc, 2);
+    mz_zip_reader_extract_iter_state *iter;
+    if (janet_checktype(argv[1], JANET_STRING)) {
+        iter = mz_zip_reader_extract_file_iter_new(archive, janet_getcstring(argv, 1), flags);
+    } else {
+        iter = mz_zip_reader_extract_iter_new(archive, (mz_uint) janet_getinteger(argv, 1), flags);
+    }
+    if (iter == NULL) {
+        janet_panicf("could not open zip entry %v: %s", argv[1],
+                     mz_zip_get_error_string(mz_zip_get_last_error(archive)));
+    }
+    ZipEntryReader *entry = janet_abstract(&zip_entry_reader_type, sizeof(ZipEntryReader));
+    entry->reader = argv[0];
+    entry->archive = archive;
+    entry->iter = iter;
+    entry->owns_read_buf = archive->m_zip_type != MZ_ZIP_TYPE_MEMORY;
+    return janet_wrap_abstract(entry);
+}
+
+JANET_FN(cfun_entry_read,
+        "(zip/entry-read entry &opt n into)",
+        "Decompress up to `n` bytes (default 65536) from an entry reader and append them to "
+        "`into`, or a new buffer. Returns the buffer, or nil once the whole entry has been read. "
+        "The checksum of the entry is verified at the end, raising an error on a mismatch.") {
+    janet_arity(argc, 1, 3);
+    ZipEntryReader *entry = janet_getabstract(argv, 0, &zip_entry_reader_type);
+    int32_t n = janet_optnat(argv, argc, 1, 65536);
+    if (n == 0) janet_panic("expected a positive number of bytes to read");
+    if (entry->iter == NULL) return janet_wrap_nil();
+    zip_entry_check_reader(entry);
+    JanetBuffer *into = janet_optbuffer(argv, argc, 2, n);
+    janet_buffer_extra(into, n);
+    size_t got = mz_zip_reader_extract_iter_read(entry->iter, into->data + into->count, (size_t) n);
+    if (got == 0) {
+        mz_bool ok = mz_zip_reader_extract_iter_free(entry->iter);
+        entry->iter = NULL;
+        if (!ok) {
+            janet_panicf("failed to read zip entry: %s",
+                         mz_zip_get_error_string(mz_zip_get_last_error(entry->archive)));
+        }
+        return janet_wrap_nil();
+    }
+    into->count += (int32_t) got;
+    return janet_wrap_buffer(into);
+}
+
+JANET_FN(cfun_entry_close,
+        "(zip/entry-close entry)",
+        "Close an entry reader before it has been read to the end, freeing its buffers.") {
+    janet_fixarity(argc, 1);
+    ZipEntryReader *entry = janet_getabstract(argv, 0, &zip_entry_reader_type);
+    zip_entry_discard(entry);
+    return janet_wrap_nil();
+}
+
+static const JanetMethod zip_entry_methods[] = {
+    {"read", cfun_entry_read},
+    {"close", cfun_entry_close},
+    {NULL, NULL}
+};
+
+static int zip_entry_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD)) return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), zip_entry_methods, out);
+}
+
 /* Zip writing */
 
 static int writer_gc(void *p, size_t size) {
@@ -321,7 +1381,6 @@ JANET_FN(cfun_writer_add_bytes,
     JanetByteView bytes = janet_getbytes(argv, 2);
     const char *comment = janet_optcstring(argv, argc, 3, NULL);
     mz_uint flags = miniz_optflags(argv, argc, 4);
-    // TODO - handle pre-compressed data better
     if (!mz_zip_writer_add_mem_ex(archive, path, bytes.bytes, bytes.len, comment, (comment != NULL) ? strlen(comment) : 0, flags, 0, 0)) {
         janet_panic("adding bytes failed!");
     }
@@ -365,6 +1424,706 @@ JANET_FN(cfun_writer_finalize,
     }
 }
 
+/* Streaming zip writing
+ *
+ * Entries are compressed chunk by chunk and written to the sink as soon as
+ * tdefl produces output. Sizes and checksums are not known up front, so every
+ * entry uses a data descriptor after its data, and only the central directory
+ * is kept in memory until the archive is finished. */
+
+#define ZIP_LOCAL_HEADER_SIG 0x04034b50
+#define ZIP_DESCRIPTOR_SIG 0x08074b50
+#define ZIP_CENTRAL_HEADER_SIG 0x02014b50
+#define ZIP_END_SIG 0x06054b50
+#define ZIP64_END_SIG 0x06064b50
+#define ZIP64_LOCATOR_SIG 0x07064b50
+#define ZIP_FLAG_DESCRIPTOR (1 << 3)
+#define ZIP_FLAG_UTF8 (1 << 11)
+#define ZIP_DIR_ATTRIBUTE 0x10
+
+typedef struct {
+    Janet sink;
+    JanetBuffer *buffer;
+    FILE *file;
+    tdefl_compressor *deflator;
+    uint64_t offset;
+    uint64_t entries;
+    uint8_t *central;
+    size_t central_count;
+    size_t central_capacity;
+    int in_entry;
+    int finished;
+    int failed;
+    /* Current entry */
+    uint8_t *name;
+    size_t name_len;
+    uint8_t *comment;
+    size_t comment_len;
+    uint16_t method;
+    uint16_t dos_time;
+    uint16_t dos_date;
+    uint32_t crc;
+    uint64_t comp_size;
+    uint64_t uncomp_size;
+    uint64_t local_offset;
+    int local_zip64;
+} ZipStreamWriter;
+
+static void zip_stream_free_entry(ZipStreamWriter *w) {
+    free(w->name);
+    free(w->comment);
+    w->name = NULL;
+    w->comment = NULL;
+    w->in_entry = 0;
+}
+
+static int zip_stream_gc(void *p, size_t size) {
+    (void) size;
+    ZipStreamWriter *w = p;
+    zip_stream_free_entry(w);
+    free(w->deflator);
+    free(w->central);
+    return 0;
+}
+
+static int zip_stream_gcmark(void *p, size_t size) {
+    (void) size;
+    ZipStreamWriter *w = p;
+    janet_mark(w->sink);
+    return 0;
+}
+
+static const JanetAbstractType zip_stream_writer_type = {
+    .name = "zip/stream-writer",
+    .gc = zip_stream_gc,
+    .gcmark = zip_stream_gcmark
+};
+
+static void zip_dos_time(time_t t, uint16_t *dos_time, uint16_t *dos_date) {
+    struct tm *tm = localtime(&t);
+    if (tm == NULL || tm->tm_year < 80) {
+        /* 1980-01-01, the earliest time a zip file can hold */
+        *dos_time = 0;
+        *dos_date = (1 << 5) | 1;
+        return;
+    }
+    *dos_time = (uint16_t)((tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec >> 1));
+    *dos_date = (uint16_t)(((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday);
+}
+
+/* Write raw bytes to the sink. Does not panic so it can be used as a tdefl
+ * callback - returns 0 on failure. */
+static int zip_stream_emit(ZipStreamWriter *w, const void *data, size_t len) {
+    if (len == 0) return 1;
+    if (w->file != NULL) {
+        if (fwrite(data, 1, len, w->file) != len) return 0;
+    } else {
+        if (len > (size_t)(INT32_MAX - w->buffer->count)) return 0;
+        janet_buffer_push_bytes(w->buffer, data, (int32_t) len);
+    }
+    w->offset += len;
+    return 1;
+}
+
+static mz_bool zip_stream_deflate_out(const void *buf, int len, void *user) {
+    ZipStreamWriter *w = user;
+    if (!zip_stream_emit(w, buf, (size_t) len)) return MZ_FALSE;
+    w->comp_size += (uint64_t) len;
+    return MZ_TRUE;
+}
+
+static void zip_stream_check(ZipStreamWriter *w, int ok) {
+    if (ok) return;
+    w->failed = 1;
+    if (w->file != NULL) {
+        janet_panic("failed to write to zip file");
+    }
+    janet_panic("zip output buffer full, drain it between writes");
+}
+
+static void zip_stream_usable(ZipStreamWriter *w) {
+    if (w->failed) janet_panic("zip stream writer failed earlier and cannot be used");
+    if (w->finished) janet_panic("zip stream writer is already finished");
+}
+
+static void zip_stream_central_push(ZipStreamWriter *w, const uint8_t *data, size_t len) {
+    if (w->central_count + len > w->central_capacity) {
+        size_t capacity = 2 * w->central_capacity + len + 1024;
+        uint8_t *central = realloc(w->central, capacity);
+        if (central == NULL) {
+            JANET_OUT_OF_MEMORY;
+        }
+        w->central = central;
+        w->central_capacity = capacity;
+    }
+    memcpy(w->central + w->central_count, data, len);
+    w->central_count += len;
+}
+
+/* Start a new entry by writing its local header. The sizes and checksum are
+ * left as zero and follow the data in a descriptor. Readers only expect a
+ * zip64 descriptor after a local header with a zip64 extra field, so one is
+ * reserved when `zip64` is set, which callers do when the size is unknown or
+ * too large. Returns 0 if the sink could not be written. */
+static int zip_stream_entry_begin(ZipStreamWriter *w, JanetByteView name, JanetByteView comment,
+                                   uint16_t method, time_t mtime, int zip64) {
+    if (name.len > 0xFFFF) janet_panic("zip entry name too long");
+    if (comment.len > 0xFFFF) janet_panic("zip entry comment too long");
+    w->name = malloc(name.len + 1);
+    w->comment = malloc(comment.len + 1);
+    if (w->name == NULL || w->comment == NULL) {
+        zip_stream_free_entry(w);
+        JANET_OUT_OF_MEMORY;
+    }
+    memcpy(w->name, name.bytes, name.len);
+    memcpy(w->comment, comment.bytes, comment.len);
+    w->name_len = name.len;
+    w->comment_len = comment.len;
+    w->method = method;
+    zip_dos_time(mtime, &w->dos_time, &w->dos_date);
+    w->crc = (uint32_t) mz_crc32(MZ_CRC32_INIT, NULL, 0);
+    w->comp_size = 0;
+    w->uncomp_size = 0;
+    w->local_offset = w->offset;
+    w->local_zip64 = zip64;
+    w->in_entry = 1;
+    uint8_t header[30] = {0};
+    put_le32(header, ZIP_LOCAL_HEADER_SIG);
+    put_le16(header + 4, zip64 ? 45 : 20);
+    put_le16(header + 6, ZIP_FLAG_DESCRIPTOR | ZIP_FLAG_UTF8);
+    put_le16(header + 8, method);
+    put_le16(header + 10, w->dos_time);
+    put_le16(header + 12, w->dos_date);
+    if (zip64) {
+        put_le32(header + 18, 0xFFFFFFFFu);
+        put_le32(header + 22, 0xFFFFFFFFu);
+        put_le16(header + 28, 20);
+    }
+    put_le16(header + 26, (uint16_t) name.len);
+    if (!zip_stream_emit(w, header, sizeof(header)) || !zip_stream_emit(w, name.bytes, name.len)) return 0;
+    if (zip64) {
+        /* Sizes follow in the descriptor */
+        uint8_t extra[20] = {0};
+        put_le16(extra, 0x0001);
+        put_le16(extra + 2, 16);
+        return zip_stream_emit(w, extra, sizeof(extra));
+    }
+    return 1;
+}
+
+/* Whether an entry of known sizes needs zip64 fields in its local header. */
+static int zip_stream_sizes_zip64(uint64_t comp_size, uint64_t uncomp_size) {
+    return comp_size > 0xFFFFFFFFu || uncomp_size > 0xFFFFFFFFu;
+}
+
+/* Finish the current entry with a data descriptor and record it in the
+ * central directory. The descriptor is zip64 exactly when the local header
+ * has a zip64 extra field, and the central directory only uses zip64 fields
+ * when they are needed. Returns 0 if the sink could not be written. */
+static int zip_stream_entry_end(ZipStreamWriter *w) {
+    int zip64_sizes = zip_stream_sizes_zip64(w->comp_size, w->uncomp_size);
+    if (zip64_sizes && !w->local_zip64) {
+        zip_stream_free_entry(w);
+        w->failed = 1;
+        janet_panic("zip entry too large without zip64 local header");
+    }
+    int zip64 = zip64_sizes || w->local_offset > 0xFFFFFFFFu;
+    uint8_t descriptor[24];
+    put_le32(descriptor, ZIP_DESCRIPTOR_SIG);
+    put_le32(descriptor + 4, w->crc);
+    size_t descriptor_len;
+    if (w->local_zip64) {
+        put_le64(descriptor + 8, w->comp_size);
+        put_le64(descriptor + 16, w->uncomp_size);
+        descriptor_len = 24;
+    } else {
+        put_le32(descriptor + 8, (uint32_t) w->comp_size);
+        put_le32(descriptor + 12, (uint32_t) w->uncomp_size);
+        descriptor_len = 16;
+    }
+    if (!zip_stream_emit(w, descriptor, descriptor_len)) return 0;
+    int is_dir = w->name_len > 0 && w->name[w->name_len - 1] == '/';
+    uint8_t header[46] = {0};
+    put_le32(header, ZIP_CENTRAL_HEADER_SIG);
+    put_le16(header + 4, (zip64 || w->local_zip64) ? 45 : 20);
+    put_le16(header + 6, (zip64 || w->local_zip64) ? 45 : 20);
+    put_le16(header + 8, ZIP_FLAG_DESCRIPTOR | ZIP_FLAG_UTF8);
+    put_le16(header + 10, w->method);
+    put_le16(header + 12, w->dos_time);
+    put_le16(header + 14, w->dos_date);
+    put_le32(header + 16, w->crc);
+    put_le32(header + 20, zip64 ? 0xFFFFFFFFu : (uint32_t) w->comp_size);
+    put_le32(header + 24, zip64 ? 0xFFFFFFFFu : (uint32_t) w->uncomp_size);
+    put_le16(header + 28, (uint16_t) w->name_len);
+    put_le16(header + 30, zip64 ? 28 : 0);
+    put_le16(header + 32, (uint16_t) w->comment_len);
+    put_le32(header + 38, is_dir ? ZIP_DIR_ATTRIBUTE : 0);
+    put_le32(header + 42, zip64 ? 0xFFFFFFFFu : (uint32_t) w->local_offset);
+    zip_stream_central_push(w, header, sizeof(header));
+    zip_stream_central_push(w, w->name, w->name_len);
+    if (zip64) {
+        uint8_t extra[28];
+        put_le16(extra, 0x0001);
+        put_le16(extra + 2, 24);
+        put_le64(extra + 4, w->uncomp_size);
+        put_le64(extra + 12, w->comp_size);
+        put_le64(extra + 20, w->local_offset);
+        zip_stream_central_push(w, extra, sizeof(extra));
+    }
+    zip_stream_central_push(w, w->comment, w->comment_len);
+    zip_stream_free_entry(w);
+    w->entries++;
+    return 1;
+}
+
+JANET_FN(cfun_stream_writer,
+        "(zip/stream-writer sink)",
+        "Create a zip writer that streams the archive into `sink` as it is built, instead of "
+        "holding it in memory. `sink` is either a buffer, which the archive is appended to, or a "
+        "file opened for binary writing. To stream to a `core/stream` such as a socket, use a buffer "
+        "and write it out and clear it between calls. Only the central directory is kept until "
+        "`zip/stream-finish`.") {
+    janet_fixarity(argc, 1);
+    JanetBuffer *buffer = NULL;
+    FILE *file = NULL;
+    if (janet_checktype(argv[0], JANET_BUFFER)) {
+        buffer = janet_unwrap_buffer(argv[0]);
+    } else {
+        int32_t fflags;
+        int32_t needed_flags = JANET_FILE_WRITE | JANET_FILE_BINARY;
+        file = janet_getfile(argv, 0, &fflags);
+        if ((fflags & needed_flags) != needed_flags) {
+            janet_panicf("file must be opened in binary mode and writable");
+        }
+    }
+    ZipStreamWriter *w = janet_abstract(&zip_stream_writer_type, sizeof(ZipStreamWriter));
+    memset(w, 0, sizeof(ZipStreamWriter));
+    w->sink = argv[0];
+    w->buffer = buffer;
+    w->file = file;
+    return janet_wrap_abstract(w);
+}
+
+JANET_FN(cfun_stream_begin,
+        "(zip/stream-begin writer path &opt level comment time)",
+        "Start a new entry in a streaming zip writer. Data is then added with `zip/stream-write` "
+        "and the entry is completed with `zip/stream-end`. `level` is a compression level from 0 "
+        "to 10, where 0 stores the data uncompressed. `time` is the modification time in seconds "
+        "since the epoch, defaulting to now. Paths ending in a slash are directories. Returns the writer.") {
+    janet_arity(argc, 2, 5);
+    ZipStreamWriter *w = janet_getabstract(argv, 0, &zip_stream_writer_type);
+    JanetByteView path = janet_getbytes(argv, 1);
+    int32_t level = janet_optinteger(argv, argc, 2, MZ_DEFAULT_LEVEL);
+    if (level < 0 || level > 10) {
+        janet_panicf("compression level must be between 0 and 10, got %d", level);
+    }
+    JanetByteView comment = {NULL, 0};
+    if (argc > 3 && !janet_checktype(argv[3], JANET_NIL)) comment = janet_getbytes(argv, 3);
+    time_t mtime = (argc > 4 && !janet_checktype(argv[4], JANET_NIL))
+                   ? (time_t) janet_getnumber(argv, 4)
+                   : time(NULL);
+    zip_stream_usable(w);
+    if (w->in_entry) janet_panic("previous zip entry was not ended");
+    int is_dir = path.len > 0 && path.bytes[path.len - 1] == '/';
+    uint16_t method = (level == 0 || is_dir) ? 0 : MZ_DEFLATED;
+    if (method == MZ_DEFLATED) {
+        if (w->deflator == NULL) {
+            w->deflator = malloc(sizeof(tdefl_compressor));
+            if (w->deflator == NULL) {
+                JANET_OUT_OF_MEMORY;
+            }
+        }
+        mz_uint flags = tdefl_create_comp_flags_from_zip_params(level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+        tdefl_init(w->deflator, zip_stream_deflate_out, w, (int) flags);
+    }
+    /* Sizes are not known yet, so reserve zip64 sizes as Info-ZIP does for
+     * streamed input. Directories never have data. */
+    zip_stream_check(w, zip_stream_entry_begin(w, path, comment, method, mtime, !is_dir));
+    return argv[0];
+}
+
+JANET_FN(cfun_stream_write,
+        "(zip/stream-write writer bytes)",
+        "Add a chunk of data to the current entry of a streaming zip writer. Compressed output "
+        "is written to the sink as it is produced. Returns the writer.") {
+    janet_fixarity(argc, 2);
+    ZipStreamWriter *w = janet_getabstract(argv, 0, &zip_stream_writer_type);
+    JanetByteView bytes = janet_getbytes(argv, 1);
+    zip_stream_usable(w);
+    if (!w->in_entry) janet_panic("no zip entry started, call zip/stream-begin first");
+    if (w->name_len > 0 && w->name[w->name_len - 1] == '/' && bytes.len > 0) {
+        janet_panic("cannot write data to a directory entry");
+    }
+    w->crc = (uint32_t) mz_crc32(w->crc, bytes.bytes, bytes.len);
+    w->uncomp_size += (uint64_t) bytes.len;
+    if (w->method == 0) {
+        zip_stream_check(w, zip_stream_emit(w, bytes.bytes, bytes.len));
+        w->comp_size += (uint64_t) bytes.len;
+    } else {
+        tdefl_status status = tdefl_compress_buffer(w->deflator, bytes.bytes, bytes.len, TDEFL_NO_FLUSH);
+        zip_stream_check(w, status == TDEFL_STATUS_OKAY);
+    }
+    return argv[0];
+}
+
+JANET_FN(cfun_stream_end,
+        "(zip/stream-end writer)",
+        "Complete the current entry of a streaming zip writer. Returns the writer.") {
+    janet_fixarity(argc, 1);
+    ZipStreamWriter *w = janet_getabstract(argv, 0, &zip_stream_writer_type);
+    zip_stream_usable(w);
+    if (!w->in_entry) janet_panic("no zip entry started, call zip/stream-begin first");
+    if (w->method != 0) {
+        tdefl_status status = tdefl_compress_buffer(w->deflator, NULL, 0, TDEFL_FINISH);
+        zip_stream_check(w, status == TDEFL_STATUS_DONE);
+    }
+    zip_stream_check(w, zip_stream_entry_end(w));
+    return argv[0];
+}
+
+JANET_FN(cfun_stream_finish,
+        "(zip/stream-finish writer &opt comment)",
+        "Write the central directory of a streaming zip writer, completing the archive. The "
+        "writer cannot be used afterwards. Files are flushed but not closed. Returns the sink.") {
+    janet_arity(argc, 1, 2);
+    ZipStreamWriter *w = janet_getabstract(argv, 0, &zip_stream_writer_type);
+    JanetByteView comment = {NULL, 0};
+    if (argc > 1 && !janet_checktype(argv[1], JANET_NIL)) comment = janet_getbytes(argv, 1);
+    if (comment.len > 0xFFFF) janet_panic("zip archive comment too long");
+    zip_stream_usable(w);
+    if (w->in_entry) janet_panic("last zip entry was not ended");
+    uint64_t central_offset = w->offset;
+    uint64_t central_size = w->central_count;
+    zip_stream_check(w, zip_stream_emit(w, w->central, w->central_count));
+    int zip64 = w->entries >= 0xFFFF
+                || central_offset >= 0xFFFFFFFFu
+                || central_size >= 0xFFFFFFFFu;
+    if (zip64) {
+        uint64_t end64_offset = w->offset;
+        uint8_t end64[56] = {0};
+        put_le32(end64, ZIP64_END_SIG);
+        put_le64(end64 + 4, sizeof(end64) - 12);
+        put_le16(end64 + 12, 45);
+        put_le16(end64 + 14, 45);
+        put_le64(end64 + 24, w->entries);
+        put_le64(end64 + 32, w->entries);
+        put_le64(end64 + 40, central_size);
+        put_le64(end64 + 48, central_offset);
+        zip_stream_check(w, zip_stream_emit(w, end64, sizeof(end64)));
+        uint8_t locator[20] = {0};
+        put_le32(locator, ZIP64_LOCATOR_SIG);
+        put_le64(locator + 8, end64_offset);
+        put_le32(locator + 16, 1);
+        zip_stream_check(w, zip_stream_emit(w, locator, sizeof(locator)));
+    }
+    uint8_t end[22] = {0};
+    put_le32(end, ZIP_END_SIG);
+    put_le16(end + 8, zip64 ? 0xFFFF : (uint16_t) w->entries);
+    put_le16(end + 10, zip64 ? 0xFFFF : (uint16_t) w->entries);
+    put_le32(end + 12, zip64 ? 0xFFFFFFFFu : (uint32_t) central_size);
+    put_le32(end + 16, zip64 ? 0xFFFFFFFFu : (uint32_t) central_offset);
+    put_le16(end + 20, (uint16_t) comment.len);
+    zip_stream_check(w, zip_stream_emit(w, end, sizeof(end)));
+    zip_stream_check(w, zip_stream_emit(w, comment.bytes, comment.len));
+    if (w->file != NULL) fflush(w->file);
+    w->finished = 1;
+    free(w->deflator);
+    free(w->central);
+    w->deflator = NULL;
+    w->central = NULL;
+    w->central_count = 0;
+    w->central_capacity = 0;
+    return w->sink;
+}
+
+/* Adding many entries at once */
+
+typedef struct {
+    const char *path;
+    JanetByteView data;
+    size_t first_block;
+    size_t block_count;
+    int stored;
+} ZipAddEntry;
+
+static ZipAddEntry zip_add_entry(const Janet *pair) {
+    ZipAddEntry entry;
+    entry.path = janet_getcstring(pair, 0);
+    entry.data = janet_getbytes(pair, 1);
+    size_t path_len = strlen(entry.path);
+    if (path_len > 0xFFFF) janet_panic("zip entry name too long");
+    entry.stored = path_len > 0 && entry.path[path_len - 1] == '/';
+    if (entry.stored && entry.data.len > 0) {
+        janet_panicf("directory entry %s cannot have data", entry.path);
+    }
+    entry.first_block = 0;
+    entry.block_count = 0;
+    return entry;
+}
+
+JANET_FN(cfun_writer_add_all,
+        "(zip/add-all writer entries &opt level workers)",
+        "Add many entries to a zip writer or streaming zip writer at once, compressing them in "
+        "parallel on up to `workers` threads (default the number of cpus). `entries` is either a "
+        "table or struct mapping paths to data, or an array of `[path data]` tuples, which keeps "
+        "the order of entries. Large entries are also split into blocks that are compressed "
+        "concurrently. The compressed data is held in memory until it is written, which happens "
+        "in order on the calling thread. Returns the writer.") {
+    janet_arity(argc, 2, 4);
+    mz_zip_archive *archive = janet_checkabstract(argv[0], &zip_writer_type);
+    ZipStreamWriter *stream = NULL;
+    if (archive == NULL) {
+        stream = janet_getabstract(argv, 0, &zip_stream_writer_type);
+        zip_stream_usable(stream);
+        if (stream->in_entry) janet_panic("previous zip entry was not ended");
+    }
+    int32_t level = janet_optinteger(argv, argc, 2, MZ_DEFAULT_LEVEL);
+    if (level < 0 || level > 10) {
+        janet_panicf("compression level must be between 0 and 10, got %d", level);
+    }
+    int32_t workers = spork_optworkers(argv, argc, 3);
+
+    /* Collect entries */
+    int32_t count;
+    ZipAddEntry *entries;
+    const JanetKV *kvs = NULL;
+    int32_t cap = 0;
+    if (janet_dictionary_view(argv[1], &kvs, &count, &cap)) {
+        entries = janet_smalloc(sizeof(ZipAddEntry) * (size_t)(count > 0 ? count : 1));
+        int32_t i = 0;
+        for (const JanetKV *kv = janet_dictionary_next(kvs, cap, NULL); kv != NULL; kv = janet_dictionary_next(kvs, cap, kv)) {
+            Janet pair[2] = {kv->key, kv->value};
+            entries[i++] = zip_add_entry(pair);
+        }
+    } else {
+        const Janet *items;
+        if (!janet_indexed_view(argv[1], &items, &count)) {
+            janet_panicf("expected dictionary or array of [path data] entries, got %v", argv[1]);
+        }
+        entries = janet_smalloc(sizeof(ZipAddEntry) * (size_t)(count > 0 ? count : 1));
+        for (int32_t i = 0; i < count; i++) {
+            const Janet *pair;
+            int32_t pair_len;
+            if (!janet_indexed_view(items[i], &pair, &pair_len) || pair_len != 2) {
+                janet_panicf("expected [path data] entry, got %v", items[i]);
+            }
+            entries[i] = zip_add_entry(pair);
+        }
+    }
+
+    /* Compress every block of every entry in one batch */
+    int flags = level == 0 ? -1 : deflate_level_flags(level);
+    size_t nblocks = 0;
+    for (int32_t i = 0; i < count; i++) {
+        entries[i].first_block = nblocks;
+        entries[i].block_count = deflate_split(NULL, entries[i].data.bytes, (size_t) entries[i].data.len, flags);
+        nblocks += entries[i].block_count;
+    }
+    if (nblocks > INT32_MAX) janet_panic("too many blocks to compress");
+    DeflateBlock *blocks = calloc(nblocks > 0 ? nblocks : 1, sizeof(DeflateBlock));
+    if (blocks == NULL) {
+        JANET_OUT_OF_MEMORY;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        deflate_split(blocks + entries[i].first_block, entries[i].data.bytes, (size_t) entries[i].data.len,
+                      entries[i].stored ? -1 : flags);
+    }
+    spork_parallel_for(workers, (int32_t) nblocks, deflate_block_job, blocks);
+    for (size_t i = 0; i < nblocks; i++) {
+        if (blocks[i].failed) {
+            deflate_blocks_free(blocks, nblocks);
+            janet_sfree(entries);
+            janet_panic("compression failed");
+        }
+    }
+
+    /* Write entries in order */
+    for (int32_t i = 0; i < count; i++) {
+        ZipAddEntry *entry = entries + i;
+        DeflateBlock *first = blocks + entry->first_block;
+        int stored = entry->stored || flags < 0;
+        uint32_t crc = first->crc;
+        size_t comp_len = 0;
+        for (size_t j = 0; j < entry->block_count; j++) {
+            if (j > 0) crc = spork_crc32_combine(crc, first[j].crc, first[j].len);
+            comp_len += first[j].out_len;
+        }
+        int ok;
+        if (stream != NULL) {
+            JanetByteView name = {(const uint8_t *) entry->path, (int32_t) strlen(entry->path)};
+            JanetByteView comment = {NULL, 0};
+            uint64_t written = stored ? (uint64_t) entry->data.len : (uint64_t) comp_len;
+            ok = zip_stream_entry_begin(stream, name, comment, stored ? 0 : MZ_DEFLATED, time(NULL),
+                                        zip_stream_sizes_zip64(written, (uint64_t) entry->data.len));
+            if (stored) {
+                ok = ok && zip_stream_emit(stream, entry->data.bytes, (size_t) entry->data.len);
+                stream->comp_size = (uint64_t) entry->data.len;
+            } else {
+                for (size_t j = 0; j < entry->block_count; j++) {
+                    ok = ok && zip_stream_emit(stream, first[j].out, first[j].out_len);
+                }
+                stream->comp_size = comp_len;
+            }
+            stream->crc = crc;
+            stream->uncomp_size = (uint64_t) entry->data.len;
+            ok = ok && zip_stream_entry_end(stream);
+            if (!ok) {
+                deflate_blocks_free(blocks, nblocks);
+                janet_sfree(entries);
+                zip_stream_check(stream, 0);
+            }
+            continue;
+        }
+        if (stored) {
+            ok = mz_zip_writer_add_mem_ex(archive, entry->path, entry->data.bytes, (size_t) entry->data.len,
+                                          NULL, 0, 0, 0, 0);
+        } else {
+            /* miniz wants the compressed data in one piece */
+            uint8_t *comp = first->out;
+            if (entry->block_count > 1) {
+                comp = malloc(comp_len);
+                if (comp == NULL) {
+                    JANET_OUT_OF_MEMORY;
+                }
+                size_t at = 0;
+                for (size_t j = 0; j < entry->block_count; j++) {
+                    memcpy(comp + at, first[j].out, first[j].out_len);
+                    at += first[j].out_len;
+                }
+            }
+            ok = mz_zip_writer_add_mem_ex(archive, entry->path, comp, comp_len, NULL, 0,
+                                          (mz_uint) level | MZ_ZIP_FLAG_COMPRESSED_DATA,
+                                          (mz_uint64) entry->data.len, crc);
+            if (comp != first->out) free(comp);
+        }
+        if (!ok) {
+            deflate_blocks_free(blocks, nblocks);
+            janet_sfree(entries);
+            janet_panicf("adding %s failed!", entry->path);
+        }
+    }
+    deflate_blocks_free(blocks, nblocks);
+    janet_sfree(entries);
+    return argv[0];
+}
+
+/* Copying and pre-compressed entries */
+
+/* Get a crc-32 as returned by zip/stat (a signed 32 bit integer) or by
+ * spork/crc (an unsigned one). */
+static uint32_t zip_getcrc(const Janet *argv, int32_t n) {
+    double x = janet_getnumber(argv, n);
+    if (x != (double)(int64_t) x || x < -2147483648.0 || x > 4294967295.0) {
+        janet_panicf("bad slot #%d, expected 32 bit checksum, got %v", n, argv[n]);
+    }
+    return (uint32_t)(int64_t) x;
+}
+
+static mz_uint zip_getindex(mz_zip_archive *archive, const Janet *argv, int32_t n) {
+    if (janet_checktype(argv[n], JANET_STRING)) {
+        int index = mz_zip_reader_locate_file(archive, janet_getcstring(argv, n), NULL, 0);
+        if (index < 0) janet_panicf("no file %v in zip archive", argv[n]);
+        return (mz_uint) index;
+    }
+    int32_t index = janet_getinteger(argv, n);
+    if (index < 0 || (mz_uint) index >= mz_zip_reader_get_num_files(archive)) {
+        janet_panicf("zip entry index %d out of range", index);
+    }
+    return (mz_uint) index;
+}
+
+JANET_FN(cfun_writer_add_from_reader,
+        "(zip/add-from-reader writer reader idx-or-filename)",
+        "Copy an entry from a zip reader into a zip writer or streaming zip writer without "
+        "decompressing and recompressing it. The name, comment, time and checksum are kept. "
+        "Returns the writer.") {
+    janet_fixarity(argc, 3);
+    mz_zip_archive *archive = janet_checkabstract(argv[0], &zip_writer_type);
+    mz_zip_archive *source = janet_getabstract(argv, 1, &zip_reader_type);
+    if (source->m_zip_mode != MZ_ZIP_MODE_READING) janet_panic("zip reader is not open");
+    mz_uint index = zip_getindex(source, argv, 2);
+    if (archive != NULL) {
+        if (!mz_zip_writer_add_from_zip_reader(archive, source, index)) {
+            janet_panicf("copying zip entry failed: %s",
+                         mz_zip_get_error_string(mz_zip_get_last_error(archive)));
+        }
+        return argv[0];
+    }
+    ZipStreamWriter *w = janet_getabstract(argv, 0, &zip_stream_writer_type);
+    zip_stream_usable(w);
+    if (w->in_entry) janet_panic("previous zip entry was not ended");
+    mz_zip_archive_file_stat st;
+    if (!mz_zip_reader_file_stat(source, index, &st)) {
+        janet_panicf("could not stat zip entry %d", (int32_t) index);
+    }
+    if (st.m_method != 0 && st.m_method != MZ_DEFLATED) {
+        janet_panicf("unsupported compression method %d for %s", (int32_t) st.m_method, st.m_filename);
+    }
+    mz_zip_reader_extract_iter_state *iter = mz_zip_reader_extract_iter_new(source, index, MZ_ZIP_FLAG_COMPRESSED_DATA);
+    if (iter == NULL) {
+        janet_panicf("could not open zip entry %s: %s", st.m_filename,
+                     mz_zip_get_error_string(mz_zip_get_last_error(source)));
+    }
+    JanetByteView name = {(const uint8_t *) st.m_filename, (int32_t) strlen(st.m_filename)};
+    JanetByteView comment = {(const uint8_t *) st.m_comment, (int32_t) st.m_comment_size};
+    int ok = zip_stream_entry_begin(w, name, comment, (uint16_t) st.m_method, st.m_time,
+                                    zip_stream_sizes_zip64(st.m_comp_size, st.m_uncomp_size));
+    uint8_t chunk[16 * 1024];
+    uint64_t copied = 0;
+    while (ok) {
+        size_t got = mz_zip_reader_extract_iter_read(iter, chunk, sizeof(chunk));
+        if (got == 0) break;
+        ok = zip_stream_emit(w, chunk, got);
+        copied += got;
+    }
+    mz_zip_reader_extract_iter_free(iter);
+    if (ok && copied != st.m_comp_size) {
+        w->failed = 1;
+        janet_panicf("failed to read zip entry %s", st.m_filename);
+    }
+    w->crc = st.m_crc32;
+    w->comp_size = st.m_comp_size;
+    w->uncomp_size = st.m_uncomp_size;
+    zip_stream_check(w, ok && zip_stream_entry_end(w));
+    return argv[0];
+}
+
+JANET_FN(cfun_writer_add_compressed,
+        "(zip/add-compressed writer path data size crc &opt comment)",
+        "Add raw deflate data that was compressed elsewhere, for example with "
+        "`(zip/deflate bytes :raw)`, to a zip writer or streaming zip writer. `size` is the "
+        "uncompressed size and `crc` the crc-32 of the uncompressed data. Nothing is checked, "
+        "so wrong values make a corrupt archive. Returns the writer.") {
+    janet_arity(argc, 5, 6);
+    mz_zip_archive *archive = janet_checkabstract(argv[0], &zip_writer_type);
+    const char *path = janet_getcstring(argv, 1);
+    JanetByteView data = janet_getbytes(argv, 2);
+    size_t size = janet_getsize(argv, 3);
+    uint32_t crc = zip_getcrc(argv, 4);
+    const char *comment = janet_optcstring(argv, argc, 5, NULL);
+    size_t comment_len = comment == NULL ? 0 : strlen(comment);
+    if (archive != NULL) {
+        if (!mz_zip_writer_add_mem_ex(archive, path, data.bytes, (size_t) data.len, comment, (mz_uint16) comment_len,
+                                      MZ_DEFAULT_LEVEL | MZ_ZIP_FLAG_COMPRESSED_DATA, (mz_uint64) size, crc)) {
+            janet_panic("adding compressed bytes failed!");
+        }
+        return argv[0];
+    }
+    ZipStreamWriter *w = janet_getabstract(argv, 0, &zip_stream_writer_type);
+    zip_stream_usable(w);
+    if (w->in_entry) janet_panic("previous zip entry was not ended");
+    JanetByteView name = {(const uint8_t *) path, (int32_t) strlen(path)};
+    JanetByteView comment_view = {(const uint8_t *) comment, (int32_t) comment_len};
+    int ok = zip_stream_entry_begin(w, name, comment_view, MZ_DEFLATED, time(NULL),
+                                    zip_stream_sizes_zip64((uint64_t) data.len, (uint64_t) size))
+             && zip_stream_emit(w, data.bytes, (size_t) data.len);
+    w->crc = crc;
+    w->comp_size = (uint64_t) data.len;
+    w->uncomp_size = (uint64_t) size;
+    zip_stream_check(w, ok && zip_stream_entry_end(w));
+    return argv[0];
+}
+
 /* Extra */
 
 JANET_FN(cfun_version,
@@ -378,23 +2137,45 @@ JANET_MODULE_ENTRY(JanetTable *env) {
     JanetRegExt cfuns[] = {
         JANET_REG("compress", cfun_compress),
         JANET_REG("decompress", cfun_decompress),
+        JANET_REG("deflate", cfun_deflate),
+        JANET_REG("inflate", cfun_inflate),
+        JANET_REG("compressor", cfun_compressor),
+        JANET_REG("compressor-write", cfun_compressor_write),
+        JANET_REG("compressor-flush", cfun_compressor_flush),
+        JANET_REG("compressor-finish", cfun_compressor_finish),
+        JANET_REG("decompressor", cfun_decompressor),
+        JANET_REG("decompressor-write", cfun_decompressor_write),
+        JANET_REG("decompressor-finish", cfun_decompressor_finish),
         JANET_REG("read-file", cfun_read_file),
         JANET_REG("read-bytes", cfun_read_bytes),
+        JANET_REG("map-file", cfun_map_file),
         JANET_REG("stat", cfun_reader_stat),
         JANET_REG("reader-close", cfun_reader_close),
         JANET_REG("reader-count", cfun_reader_count),
         JANET_REG("extract", cfun_reader_extract),
+        JANET_REG("extract-all", cfun_reader_extract_all),
         JANET_REG("get-filename", cfun_reader_idx_to_path),
         JANET_REG("locate-file", cfun_reader_locate),
         JANET_REG("file-directory?", cfun_reader_is_directory),
         JANET_REG("file-supported?", cfun_reader_is_supported),
         JANET_REG("file-encrypted?", cfun_reader_is_encrypted),
+        JANET_REG("open-entry", cfun_open_entry),
+        JANET_REG("entry-read", cfun_entry_read),
+        JANET_REG("entry-close", cfun_entry_close),
         JANET_REG("write-file", cfun_write_file),
         JANET_REG("write-buffer", cfun_write_buffer),
         JANET_REG("add-file", cfun_writer_add_file),
         JANET_REG("add-bytes", cfun_writer_add_bytes),
         JANET_REG("writer-close", cfun_writer_close),
         JANET_REG("writer-finalize", cfun_writer_finalize),
+        JANET_REG("stream-writer", cfun_stream_writer),
+        JANET_REG("stream-begin", cfun_stream_begin),
+        JANET_REG("stream-write", cfun_stream_write),
+        JANET_REG("stream-end", cfun_stream_end),
+        JANET_REG("stream-finish", cfun_stream_finish),
+        JANET_REG("add-all", cfun_writer_add_all),
+        JANET_REG("add-from-reader", cfun_writer_add_from_reader),
+        JANET_REG("add-compressed", cfun_writer_add_compressed),
         JANET_REG("version", cfun_version),
         JANET_REG_END
     };